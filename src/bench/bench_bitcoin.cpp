@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <crypto/blake2b.h>
+#include <crypto/sha3_256.h>
 
 #include <key.h>
 #include <validation.h>
@@ -41,6 +43,8 @@ main(int argc, char** argv)
         return 0;
     }
 
+    SHA3_256AutoDetect();
+    BLAKE2bAutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
@@ -0,0 +1,147 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <checkqueue.h>
+#include <clientversion.h>
+#include <hash.h>
+#include <key.h>
+#include <primitives/block.h>
+#include <script/interpreter.h>
+#include <script/sigcache.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <util.h>
+#include <validation.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+static const int MIN_CORES = 2;
+static const size_t CHAIN_BLOCKS = 16;
+static const size_t BLOCK_TXS = 200;
+static const int OVERLAP_BLOCKS = 8;
+
+/** A synthetic chain of blocks full of single-input P2PKH spends, and the coins they spend. */
+struct SyntheticChain
+{
+    std::vector<CDataStream> blocks;
+    CTransaction txCredit;
+
+    SyntheticChain() : txCredit(MakeCredit())
+    {
+        for (size_t b = 0; b < CHAIN_BLOCKS; b++) {
+            CBlock block;
+            for (size_t t = 0; t < BLOCK_TXS; t++) {
+                block.vtx.push_back(MakeTransactionRef(MakeSpend(b * BLOCK_TXS + t)));
+            }
+            blocks.emplace_back(SER_DISK, CLIENT_VERSION);
+            blocks.back() << block;
+        }
+    }
+
+private:
+    CKey key;
+
+    CTransaction MakeCredit()
+    {
+        key.MakeNewKey(true);
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vout.resize(CHAIN_BLOCKS * BLOCK_TXS);
+        for (CTxOut& out : tx.vout) {
+            out.nValue = 1;
+            out.scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+        }
+        return CTransaction(tx);
+    }
+
+    CMutableTransaction MakeSpend(uint32_t n)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(txCredit.GetHash(), n);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1;
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(txCredit.vout[n].scriptPubKey, tx, 0, SIGHASH_ALL, 1, SIGVERSION_BASE);
+        key.Sign(hash, vchSig);
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig = CScript() << vchSig << ToByteVector(key.GetPubKey());
+        return tx;
+    }
+};
+
+/**
+ * Replays the chain the way ConnectTip does: read each block, prepare its
+ * script checks and hand them to the check threads. Waiting after every
+ * block is what validation does normally; waiting once per OVERLAP_BLOCKS
+ * blocks is what -parblocks does during initial block download.
+ */
+static void ReplayChainScriptChecks(benchmark::State& state, int nOverlapBlocks)
+{
+    InitSignatureCache();
+    const SyntheticChain chain;
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC;
+
+    CCheckQueue<CBlockScriptCheck> queue(128);
+    boost::thread_group tg;
+    for (int i = 1; i < std::max(MIN_CORES, GetNumCores()); i++) {
+        tg.create_thread([&]{ queue.Thread(); });
+    }
+
+    while (state.KeepRunning()) {
+        std::vector<std::shared_ptr<CBlock>> blocks;
+        std::vector<std::unique_ptr<std::vector<PrecomputedTransactionData>>> txdatas;
+        std::vector<std::unique_ptr<std::atomic<bool>>> failed;
+        std::unique_ptr<CCheckQueueControl<CBlockScriptCheck>> control;
+        for (size_t b = 0; b < chain.blocks.size(); b++) {
+            if (!control)
+                control.reset(new CCheckQueueControl<CBlockScriptCheck>(&queue));
+            CDataStream stream(chain.blocks[b]);
+            blocks.push_back(std::make_shared<CBlock>());
+            stream >> *blocks.back();
+            const CBlock& block = *blocks.back();
+
+            txdatas.emplace_back(new std::vector<PrecomputedTransactionData>());
+            std::vector<PrecomputedTransactionData>& txdata = *txdatas.back();
+            txdata.reserve(block.vtx.size());
+            failed.emplace_back(new std::atomic<bool>(false));
+            std::vector<CBlockScriptCheck> vChecks;
+            for (const CTransactionRef& tx : block.vtx) {
+                txdata.emplace_back(*tx);
+                CScriptCheck check(chain.txCredit.vout[tx->vin[0].prevout.n], *tx, 0, flags, false, &txdata.back());
+                vChecks.emplace_back(check, nOverlapBlocks > 1 ? failed.back().get() : nullptr);
+            }
+            control->Add(vChecks);
+
+            if ((b + 1) % nOverlapBlocks == 0 || b + 1 == chain.blocks.size()) {
+                bool fOk = control->Wait();
+                assert(fOk);
+                control.reset();
+                for (const auto& fFailed : failed) {
+                    assert(!*fFailed);
+                }
+            }
+        }
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void ReplayChainScriptChecksPerBlock(benchmark::State& state)
+{
+    ReplayChainScriptChecks(state, 1);
+}
+
+static void ReplayChainScriptChecksOverlapped(benchmark::State& state)
+{
+    ReplayChainScriptChecks(state, OVERLAP_BLOCKS);
+}
+
+BENCHMARK(ReplayChainScriptChecksPerBlock, 2);
+BENCHMARK(ReplayChainScriptChecksOverlapped, 2);
@@ -5,8 +5,10 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <wallet/crypter.h>
 
+#include <unordered_map>
 #include <vector>
 
 // FIXME: Dedup with SetupDummyInputs in test/transaction_tests.cpp.
@@ -85,3 +87,59 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+// Insert and lookup throughput of the coins cache map, against the
+// std::unordered_map it replaced.
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> UnorderedCoinsMap;
+
+static std::vector<COutPoint> RandomOutPoints(size_t count)
+{
+    FastRandomContext rng(true);
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        outpoints.emplace_back(rng.rand256(), rng.randrange(4));
+    }
+    return outpoints;
+}
+
+template <typename Map>
+static void CoinsMapInsert(benchmark::State& state)
+{
+    const std::vector<COutPoint> outpoints = RandomOutPoints(100000);
+    while (state.KeepRunning()) {
+        Map map;
+        for (const COutPoint& outpoint : outpoints) {
+            map.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::tuple<>());
+        }
+        assert(map.size() == outpoints.size());
+    }
+}
+
+template <typename Map>
+static void CoinsMapLookup(benchmark::State& state)
+{
+    const std::vector<COutPoint> outpoints = RandomOutPoints(200000);
+    Map map;
+    for (size_t i = 0; i < outpoints.size(); i += 2) {
+        map.emplace(std::piecewise_construct, std::forward_as_tuple(outpoints[i]), std::tuple<>());
+    }
+    while (state.KeepRunning()) {
+        // Half of the lookups hit.
+        size_t found = 0;
+        for (const COutPoint& outpoint : outpoints) {
+            found += map.find(outpoint) != map.end();
+        }
+        assert(found == map.size());
+    }
+}
+
+static void CCoinsMapInsert(benchmark::State& state) { CoinsMapInsert<CCoinsMap>(state); }
+static void CCoinsMapInsertUnordered(benchmark::State& state) { CoinsMapInsert<UnorderedCoinsMap>(state); }
+static void CCoinsMapLookup(benchmark::State& state) { CoinsMapLookup<CCoinsMap>(state); }
+static void CCoinsMapLookupUnordered(benchmark::State& state) { CoinsMapLookup<UnorderedCoinsMap>(state); }
+
+BENCHMARK(CCoinsMapInsert, 30);
+BENCHMARK(CCoinsMapInsertUnordered, 10);
+BENCHMARK(CCoinsMapLookup, 20);
+BENCHMARK(CCoinsMapLookupUnordered, 8);
@@ -0,0 +1,78 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <key.h>
+#include <pubkey.h>
+#include <random.h>
+#include <uint256.h>
+
+#include <string>
+#include <vector>
+
+/** Runs a benchmark on one field arithmetic backend and restores the selected one afterwards.
+ *  Backends that are not compiled in (fe51 without __int128) fall back to ref10. */
+class ED25519Backend
+{
+    const std::string m_previous;
+public:
+    explicit ED25519Backend(const char* name) : m_previous(ed25519_backend_name())
+    {
+        if (!ed25519_select_backend(name))
+            ed25519_select_backend("ref10");
+    }
+    ~ED25519Backend() { ed25519_select_backend(m_previous.c_str()); }
+};
+
+static void ED25519Sign(benchmark::State& state, const char* backend)
+{
+    ED25519Backend select(backend);
+    CKey key;
+    key.MakeNewKey(true);
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    while (state.KeepRunning()) {
+        key.Sign(hash, vchSig);
+    }
+}
+
+static void ED25519Verify(benchmark::State& state, const char* backend)
+{
+    ED25519Backend select(backend);
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    key.Sign(hash, vchSig);
+    while (state.KeepRunning()) {
+        assert(pubkey.Verify(hash, vchSig));
+    }
+}
+
+static void ED25519AddScalar(benchmark::State& state, const char* backend)
+{
+    ED25519Backend select(backend);
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 tweak = GetRandHash();
+    while (state.KeepRunning()) {
+        ed25519_add_scalar((unsigned char*)pubkey.begin(), nullptr, tweak.begin());
+    }
+}
+
+static void ED25519Sign_ref10(benchmark::State& state) { ED25519Sign(state, "ref10"); }
+static void ED25519Sign_fe51(benchmark::State& state) { ED25519Sign(state, "fe51"); }
+static void ED25519Verify_ref10(benchmark::State& state) { ED25519Verify(state, "ref10"); }
+static void ED25519Verify_fe51(benchmark::State& state) { ED25519Verify(state, "fe51"); }
+static void ED25519AddScalar_ref10(benchmark::State& state) { ED25519AddScalar(state, "ref10"); }
+static void ED25519AddScalar_fe51(benchmark::State& state) { ED25519AddScalar(state, "fe51"); }
+
+BENCHMARK(ED25519Sign_ref10, 15 * 1000);
+BENCHMARK(ED25519Sign_fe51, 24 * 1000);
+BENCHMARK(ED25519Verify_ref10, 4800);
+BENCHMARK(ED25519Verify_fe51, 13 * 1000);
+BENCHMARK(ED25519AddScalar_ref10, 13 * 1000);
+BENCHMARK(ED25519AddScalar_fe51, 33 * 1000);
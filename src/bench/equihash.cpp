@@ -0,0 +1,89 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <crypto/common.h>
+#include <crypto/equihash.h>
+#include <crypto/equihash_solver.h>
+#include <pow.h>
+#include <util.h>
+
+#include <assert.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** Solves one nonce per iteration, so the rate is comparable across solvers and thread counts. */
+static void EquihashSolve(benchmark::State& state, const std::string& name, unsigned int n, unsigned int k, unsigned int nThreads)
+{
+    std::unique_ptr<CEquihashSolver> solver = CreateEquihashSolver(name, n, k, nThreads);
+    eh_HashState base_state;
+    EhInitialiseState(n, k, base_state);
+    const std::string header = "Equihash solver benchmark";
+    crypto_generichash_blake2b_update(&base_state, (const unsigned char*)header.data(), header.size());
+
+    uint32_t nonce = 0;
+    while (state.KeepRunning()) {
+        eh_HashState curr_state = base_state;
+        unsigned char V[32] = {};
+        WriteLE32(V, nonce++);
+        crypto_generichash_blake2b_update(&curr_state, V, sizeof(V));
+        solver->Solve(curr_state,
+            [](std::vector<unsigned char> soln) { return false; },
+            [](EhSolverCancelCheck pos) { return false; });
+    }
+}
+
+/**
+ * Plain OptimisedSolve() that allocates its working memory on every call,
+ * as a baseline for the arena the "default" solver keeps between nonces.
+ */
+static void EquihashSolveNoArena(benchmark::State& state, unsigned int n, unsigned int k)
+{
+    eh_HashState base_state;
+    EhInitialiseState(n, k, base_state);
+    const std::string header = "Equihash solver benchmark";
+    crypto_generichash_blake2b_update(&base_state, (const unsigned char*)header.data(), header.size());
+
+    uint32_t nonce = 0;
+    while (state.KeepRunning()) {
+        eh_HashState curr_state = base_state;
+        unsigned char V[32] = {};
+        WriteLE32(V, nonce++);
+        crypto_generichash_blake2b_update(&curr_state, V, sizeof(V));
+        EhOptimisedSolve(n, k, curr_state,
+            [](std::vector<unsigned char> soln) { return false; },
+            [](EhSolverCancelCheck pos) { return false; });
+    }
+}
+
+static void EquihashSolve96_5_default(benchmark::State& state) { EquihashSolve(state, "default", 96, 5, 1); }
+static void EquihashSolve96_5_noarena(benchmark::State& state) { EquihashSolveNoArena(state, 96, 5); }
+static void EquihashSolve200_9_default(benchmark::State& state) { EquihashSolve(state, "default", 200, 9, 1); }
+static void EquihashSolve200_9_noarena(benchmark::State& state) { EquihashSolveNoArena(state, 200, 9); }
+static void EquihashSolve96_5_tromp(benchmark::State& state) { EquihashSolve(state, "tromp", 96, 5, 1); }
+static void EquihashSolve200_9_tromp(benchmark::State& state) { EquihashSolve(state, "tromp", 200, 9, 1); }
+static void EquihashSolve200_9_tromp_threads(benchmark::State& state) { EquihashSolve(state, "tromp", 200, 9, GetNumCores()); }
+
+BENCHMARK(EquihashSolve96_5_default, 1);
+BENCHMARK(EquihashSolve96_5_noarena, 1);
+BENCHMARK(EquihashSolve200_9_default, 1);
+BENCHMARK(EquihashSolve200_9_noarena, 1);
+BENCHMARK(EquihashSolve96_5_tromp, 20);
+BENCHMARK(EquihashSolve200_9_tromp, 1);
+BENCHMARK(EquihashSolve200_9_tromp_threads, 1);
+
+/** Full header check as done for every header during sync, on the 200,9 mainnet genesis solution. */
+static void EquihashVerifyHeader(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const CBlockHeader header = chainParams->GenesisBlock().GetBlockHeader();
+    while (state.KeepRunning()) {
+        bool valid = CheckEquihashSolution(&header, *chainParams);
+        assert(valid);
+    }
+}
+
+BENCHMARK(EquihashVerifyHeader, 200);
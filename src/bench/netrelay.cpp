@@ -0,0 +1,178 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <compat.h>
+#include <fs.h>
+#include <net.h>
+#include <netbase.h>
+#include <protocol.h>
+#include <random.h>
+#include <scheduler.h>
+#include <sync.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <assert.h>
+
+#include <vector>
+
+#ifndef WIN32
+
+static const int RELAY_PEERS = 16;
+static const size_t RELAY_PAYLOAD_SIZE = 1000 * 1000;
+
+/** Takes every accepted peer as fully connected without a version handshake. */
+class RelayEvents : public NetEventsInterface
+{
+public:
+    CCriticalSection cs;
+    std::vector<CNode*> vNodes;
+
+    bool ProcessMessages(CNode* pnode, std::atomic<bool>& interrupt) override { return false; }
+    bool SendMessages(CNode* pnode, std::atomic<bool>& interrupt) override { return true; }
+    void InitializeNode(CNode* pnode) override
+    {
+        pnode->fSuccessfullyConnected = true;
+        LOCK(cs);
+        vNodes.push_back(pnode);
+    }
+    void FinalizeNode(NodeId id, bool& update_connection_time) override {}
+};
+
+static uint16_t GetFreeLoopbackPort()
+{
+    SOCKET hSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(hSocket != INVALID_SOCKET);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    int nBind = bind(hSocket, (struct sockaddr*)&addr, len);
+    assert(nBind == 0);
+    int nName = getsockname(hSocket, (struct sockaddr*)&addr, &len);
+    assert(nName == 0);
+    CloseSocket(hSocket);
+    return ntohs(addr.sin_port);
+}
+
+/**
+ * Relays a block-sized message to RELAY_PEERS loopback peers and waits until
+ * every peer has read all of it, the way a node announces a new block to its
+ * high-bandwidth peers. Only the number of network threads differs between
+ * the variants.
+ */
+static void RelayToLoopbackPeers(benchmark::State& state, int nSocketThreads)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    fs::path pathTemp = fs::temp_directory_path() / strprintf("bench_bitcoin_%lu_%i", (unsigned long)GetTime(), GetRandInt(100000));
+    fs::create_directories(pathTemp);
+    gArgs.ForceSetArg("-datadir", pathTemp.string());
+    gArgs.ForceSetArg("-dnsseed", "0");
+    ClearDatadirCache();
+
+    const uint16_t nPort = GetFreeLoopbackPort();
+    RelayEvents events;
+    CScheduler scheduler;
+    CConnman connman(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max()));
+    CConnman::Options options;
+    options.nMaxConnections = RELAY_PEERS + 1;
+    options.m_msgproc = &events;
+    options.nSendBufferMaxSize = 2 * RELAY_PAYLOAD_SIZE;
+    options.nReceiveFloodSize = 1000 * DEFAULT_MAXRECEIVEBUFFER;
+    options.vBinds.push_back(CService(CNetAddr(in_addr{htonl(INADDR_LOOPBACK)}), nPort));
+    options.m_use_addrman_outgoing = false;
+#ifdef USE_EPOLL
+    options.socketEventsMode = SocketEventsMode::Epoll;
+#endif
+    options.nSocketThreads = nSocketThreads;
+    bool fStarted = connman.Start(scheduler, options);
+    assert(fStarted);
+
+    std::vector<SOCKET> vClients;
+    for (int i = 0; i < RELAY_PEERS; i++) {
+        SOCKET hSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        assert(hSocket != INVALID_SOCKET);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(nPort);
+        int nConnect = connect(hSocket, (struct sockaddr*)&addr, sizeof(addr));
+        assert(nConnect == 0);
+        bool fNonBlocking = SetSocketNonBlocking(hSocket, true);
+        assert(fNonBlocking);
+        vClients.push_back(hSocket);
+    }
+    for (int64_t nStart = GetTimeMillis(); ; MilliSleep(1)) {
+        LOCK(events.cs);
+        if (events.vNodes.size() == (size_t)RELAY_PEERS)
+            break;
+        assert(GetTimeMillis() - nStart < 10000);
+    }
+
+    const std::vector<unsigned char> payload(RELAY_PAYLOAD_SIZE, 0x5a);
+    const size_t nMessageSize = CMessageHeader::HEADER_SIZE + RELAY_PAYLOAD_SIZE;
+    std::vector<char> buf(0x10000);
+    while (state.KeepRunning()) {
+        {
+            LOCK(events.cs);
+            for (CNode* pnode : events.vNodes) {
+                CSerializedNetMsg msg;
+                msg.data = payload;
+                msg.command = NetMsgType::BLOCK;
+                connman.PushMessage(pnode, std::move(msg));
+            }
+        }
+
+        std::vector<size_t> vRemaining(vClients.size(), nMessageSize);
+        size_t nPending = vClients.size();
+        while (nPending > 0) {
+            std::vector<struct pollfd> vPollFds;
+            std::vector<size_t> vIndex;
+            for (size_t i = 0; i < vClients.size(); i++) {
+                if (vRemaining[i] > 0) {
+                    vPollFds.push_back({(int)vClients[i], POLLIN, 0});
+                    vIndex.push_back(i);
+                }
+            }
+            int nReady = poll(vPollFds.data(), vPollFds.size(), 10000);
+            assert(nReady > 0);
+            for (size_t j = 0; j < vPollFds.size(); j++) {
+                if (!(vPollFds[j].revents & POLLIN))
+                    continue;
+                size_t i = vIndex[j];
+                ssize_t nBytes = recv(vClients[i], buf.data(), std::min(buf.size(), vRemaining[i]), MSG_DONTWAIT);
+                assert(nBytes > 0 || (nBytes < 0 && WSAGetLastError() == WSAEWOULDBLOCK));
+                if (nBytes > 0) {
+                    vRemaining[i] -= nBytes;
+                    if (vRemaining[i] == 0)
+                        nPending--;
+                }
+            }
+        }
+    }
+
+    for (SOCKET& hSocket : vClients)
+        CloseSocket(hSocket);
+    connman.Interrupt();
+    connman.Stop();
+    ClearDatadirCache();
+    fs::remove_all(pathTemp);
+}
+
+static void RelayToLoopbackPeersOneThread(benchmark::State& state)
+{
+    RelayToLoopbackPeers(state, 1);
+}
+
+static void RelayToLoopbackPeersFourThreads(benchmark::State& state)
+{
+    RelayToLoopbackPeers(state, 4);
+}
+
+BENCHMARK(RelayToLoopbackPeersOneThread, 5);
+BENCHMARK(RelayToLoopbackPeersFourThreads, 5);
+
+#endif // WIN32
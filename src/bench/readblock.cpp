@@ -0,0 +1,75 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <fs.h>
+#include <random.h>
+#include <streams.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <assert.h>
+
+/**
+ * Reads back an indexed block from a block file the way rescans and
+ * verifychain walk the chain, with and without checking its Equihash
+ * solution again. The mainnet genesis block is the only 200,9 solution at
+ * hand; its tiny body makes the difference look larger than on a full block.
+ */
+static void ReadBlockFromDiskIndexed(benchmark::State& state, bool fParanoid)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const CChainParams& chainparams = Params();
+    const CBlock& genesis = chainparams.GenesisBlock();
+
+    fs::path pathTemp = fs::temp_directory_path() / strprintf("bench_bitcoin_%lu_%i", (unsigned long)GetTime(), GetRandInt(100000));
+    fs::create_directories(pathTemp);
+    gArgs.ForceSetArg("-datadir", pathTemp.string());
+    ClearDatadirCache();
+
+    CDiskBlockPos pos(0, 0);
+    {
+        CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
+        assert(!fileout.IsNull());
+        fileout << FLATDATA(chainparams.MessageStart()) << (unsigned int)::GetSerializeSize(genesis, SER_DISK, CLIENT_VERSION);
+        pos.nPos = 8;
+        fileout << genesis;
+    }
+
+    const uint256 hash = genesis.GetHash();
+    CBlockIndex index(genesis);
+    index.phashBlock = &hash;
+    index.nFile = pos.nFile;
+    index.nDataPos = pos.nPos;
+    index.nStatus = BLOCK_HAVE_DATA;
+    index.RaiseValidity(BLOCK_VALID_TREE);
+
+    const bool fParanoidBefore = fParanoidBlockReads;
+    fParanoidBlockReads = fParanoid;
+    while (state.KeepRunning()) {
+        CBlock block;
+        assert(ReadBlockFromDisk(block, &index, chainparams.GetConsensus()));
+    }
+    fParanoidBlockReads = fParanoidBefore;
+
+    ClearDatadirCache();
+    fs::remove_all(pathTemp);
+}
+
+static void ReadBlockFromDiskTrusted(benchmark::State& state)
+{
+    ReadBlockFromDiskIndexed(state, false);
+}
+
+static void ReadBlockFromDiskParanoid(benchmark::State& state)
+{
+    ReadBlockFromDiskIndexed(state, true);
+}
+
+BENCHMARK(ReadBlockFromDiskTrusted, 5000);
+BENCHMARK(ReadBlockFromDiskParanoid, 200);
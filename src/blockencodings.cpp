@@ -15,15 +15,23 @@
 
 #include <unordered_map>
 
-CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const std::vector<bool>& vPrefill) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-        shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
+        header(block) {
     FillShortTxIDSelector();
-    //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
-    prefilledtxn[0] = {0, block.vtx[0]};
-    for (size_t i = 1; i < block.vtx.size(); i++) {
+    shorttxids.reserve(block.vtx.size() - 1);
+    prefilledtxn.reserve(1);
+    // The coinbase is always prefilled. Receivers only take prefilled
+    // transactions among the first 2^16 of a block.
+    int32_t lastprefilledindex = -1;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
+        if (i == 0 || (i < vPrefill.size() && vPrefill[i] && i <= std::numeric_limits<uint16_t>::max())) {
+            prefilledtxn.push_back({(uint16_t)(i - lastprefilledindex - 1), block.vtx[i]});
+            lastprefilledindex = i;
+        } else {
+            shorttxids.push_back(GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash()));
+        }
     }
 }
 
@@ -148,7 +148,8 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    /** Transactions i with vPrefill[i] set are sent in full, as well as the coinbase. */
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const std::vector<bool>& vPrefill = std::vector<bool>());
 
     uint64_t GetShortID(const uint256& txhash) const;
 
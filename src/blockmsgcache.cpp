@@ -0,0 +1,141 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockmsgcache.h>
+
+#include <blockencodings.h>
+#include <core_memusage.h>
+#include <memusage.h>
+#include <netmessagemaker.h>
+#include <version.h>
+
+CBlockMsgCache g_block_msg_cache;
+
+CBlockMsgCache::CBlockMsgCache() : nMaxBytes(DEFAULT_MAX_BLOCK_MSG_CACHE_SIZE * ((size_t) 1 << 20)), nBytes(0), nHits(0), nMisses(0) {}
+
+void CBlockMsgCache::SetMaxSize(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+CBlockMsgCache::EntryList::iterator CBlockMsgCache::Find(const uint256& hash)
+{
+    auto it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return entries.end();
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second;
+}
+
+void CBlockMsgCache::Trim()
+{
+    while (nBytes > nMaxBytes && entries.size() > 1) {
+        nBytes -= entries.back().nBytes;
+        mapEntries.erase(entries.back().hash);
+        entries.pop_back();
+    }
+}
+
+void CBlockMsgCache::Add(const std::shared_ptr<const CBlock>& pblock)
+{
+    const uint256 hash = pblock->GetHash();
+    LOCK(cs);
+    if (Find(hash) != entries.end())
+        return;
+
+    Entry entry;
+    entry.hash = hash;
+    entry.pblock = pblock;
+    entry.fHasWitness = false;
+    for (const CTransactionRef& tx : pblock->vtx) {
+        if (tx->HasWitness()) {
+            entry.fHasWitness = true;
+            break;
+        }
+    }
+    entry.nBytes = RecursiveDynamicUsage(pblock);
+    nBytes += entry.nBytes;
+    entries.push_front(std::move(entry));
+    mapEntries.emplace(hash, entries.begin());
+    Trim();
+}
+
+std::shared_ptr<const CBlock> CBlockMsgCache::GetBlock(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = Find(hash);
+    if (it == entries.end()) {
+        nMisses++;
+        return nullptr;
+    }
+    nHits++;
+    return it->pblock;
+}
+
+CSharedNetMsg CBlockMsgCache::GetMessage(const uint256& hash, BlockEncoding encoding)
+{
+    LOCK(cs);
+    auto it = Find(hash);
+    if (it == entries.end()) {
+        nMisses++;
+        return CSharedNetMsg();
+    }
+    nHits++;
+
+    // Without witnesses both flavours of each message are the same bytes
+    if (!it->fHasWitness) {
+        if (encoding == BlockEncoding::WITNESS_BLOCK)
+            encoding = BlockEncoding::BLOCK;
+        else if (encoding == BlockEncoding::WITNESS_CMPCTBLOCK)
+            encoding = BlockEncoding::CMPCTBLOCK;
+    }
+
+    CSharedNetMsg& msg = it->msgs[static_cast<size_t>(encoding)];
+    if (!msg.header) {
+        const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+        const CBlock& block = *it->pblock;
+        switch (encoding) {
+        case BlockEncoding::BLOCK:
+            msg = CConnman::ShareMessage(msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block));
+            break;
+        case BlockEncoding::WITNESS_BLOCK:
+            msg = CConnman::ShareMessage(msgMaker.Make(NetMsgType::BLOCK, block));
+            break;
+        case BlockEncoding::CMPCTBLOCK:
+            msg = CConnman::ShareMessage(msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block, false)));
+            break;
+        case BlockEncoding::WITNESS_CMPCTBLOCK:
+            msg = CConnman::ShareMessage(msgMaker.Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block, true)));
+            break;
+        }
+        size_t nMsgBytes = memusage::DynamicUsage(*msg.header) + (msg.payload ? memusage::DynamicUsage(*msg.payload) : 0);
+        it->nBytes += nMsgBytes;
+        nBytes += nMsgBytes;
+        CSharedNetMsg ret = msg;
+        Trim();
+        return ret;
+    }
+    return msg;
+}
+
+CBlockMsgCache::Stats CBlockMsgCache::GetStats() const
+{
+    LOCK(cs);
+    Stats stats;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nEntries = entries.size();
+    stats.nBytes = nBytes;
+    return stats;
+}
+
+void CBlockMsgCache::Clear()
+{
+    LOCK(cs);
+    entries.clear();
+    mapEntries.clear();
+    nBytes = 0;
+}
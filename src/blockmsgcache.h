@@ -0,0 +1,95 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKMSGCACHE_H
+#define BITCOIN_BLOCKMSGCACHE_H
+
+#include <net.h>
+#include <primitives/block.h>
+#include <sync.h>
+#include <uint256.h>
+#include <validation.h>
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+
+/** Default for -maxblockmsgcachesize, in MiB */
+static const unsigned int DEFAULT_MAX_BLOCK_MSG_CACHE_SIZE = 64;
+
+/** The ways a block is sent to peers */
+enum class BlockEncoding {
+    BLOCK,              //!< block message without witnesses
+    WITNESS_BLOCK,      //!< block message with witnesses
+    CMPCTBLOCK,         //!< compact block with short ids of txids
+    WITNESS_CMPCTBLOCK, //!< compact block with short ids of wtxids
+};
+
+/**
+ * The most recently connected or announced blocks, together with the network
+ * messages encoding them, serialized the first time a peer asks for them and
+ * then shared by every peer that asks again. Blocks stay deserialized as well,
+ * so getblocktxn is answered without touching the disk.
+ *
+ * Entries are dropped least recently used first once the blocks and their
+ * encodings take more than the configured size. The most recently used block
+ * is kept whatever its size, as it is normally the one being relayed.
+ */
+class CBlockMsgCache
+{
+public:
+    struct Stats {
+        uint64_t nHits;
+        uint64_t nMisses;
+        size_t nEntries;
+        size_t nBytes;
+    };
+
+    CBlockMsgCache();
+
+    void SetMaxSize(size_t nMaxBytesIn);
+
+    /** Remember a block peers are likely to ask for. */
+    void Add(const std::shared_ptr<const CBlock>& pblock);
+
+    /** The block with the given hash, or null if it is not cached. */
+    std::shared_ptr<const CBlock> GetBlock(const uint256& hash);
+
+    /** The given encoding of a cached block, serialized on first use. The
+     *  header of the returned message is null if the block is not cached. */
+    CSharedNetMsg GetMessage(const uint256& hash, BlockEncoding encoding);
+
+    Stats GetStats() const;
+
+    void Clear();
+
+private:
+    static const size_t NUM_ENCODINGS = 4;
+
+    struct Entry {
+        uint256 hash;
+        std::shared_ptr<const CBlock> pblock;
+        bool fHasWitness;
+        CSharedNetMsg msgs[NUM_ENCODINGS];
+        size_t nBytes;
+    };
+    typedef std::list<Entry> EntryList;
+
+    mutable CCriticalSection cs;
+    EntryList entries; //!< most recently used first
+    std::unordered_map<uint256, EntryList::iterator, BlockHasher> mapEntries;
+    size_t nMaxBytes;
+    size_t nBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    EntryList::iterator Find(const uint256& hash);
+    void Trim();
+};
+
+/** The cache behind block and compact block relay and getblock. */
+extern CBlockMsgCache g_block_msg_cache;
+
+#endif // BITCOIN_BLOCKMSGCACHE_H
@@ -4,6 +4,18 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chain.h>
+#include <txdb.h>
+#include <validation.h>
+
+std::vector<unsigned char> CBlockIndex::GetSolution() const
+{
+    if (HasSolution())
+        return nSolution;
+    CDiskBlockIndex diskindex;
+    if (!pblocktree || !pblocktree->ReadDiskBlockIndex(GetBlockHash(), diskindex))
+        throw std::runtime_error(strprintf("%s: failed to read block index entry %s", __func__, GetBlockHash().ToString()));
+    return diskindex.nSolution;
+}
 
 /**
  * CChain implementation
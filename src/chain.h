@@ -212,6 +212,8 @@ public:
     uint32_t nTime;
     uint32_t nBits;
     uint256 nNonce;
+    //! Equihash solution. With -compactblockindex this is emptied once the
+    //! entry is in the block tree database; use GetSolution() to read it.
     std::vector<unsigned char> nSolution;
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
@@ -279,6 +281,7 @@ public:
         return ret;
     }
 
+    //! Requires cs_main, see GetSolution().
     CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
@@ -289,10 +292,28 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nNonce         = nNonce;
-        block.nSolution      = nSolution;
+        block.nSolution      = GetSolution();
         return block;
     }
 
+    //! Whether the Equihash solution is held in memory
+    bool HasSolution() const
+    {
+        return !nSolution.empty();
+    }
+
+    //! The Equihash solution, read back from the block tree database if it
+    //! has been trimmed. Requires cs_main, which the flush trimming it holds.
+    //! Throws std::runtime_error if the entry cannot be read back.
+    std::vector<unsigned char> GetSolution() const;
+
+    //! Release the in-memory copy of the solution. Only call this once the
+    //! entry has been written to the block tree database.
+    void TrimSolution()
+    {
+        std::vector<unsigned char>().swap(nSolution);
+    }
+
     uint256 GetBlockHash() const
     {
         return *phashBlock;
@@ -382,6 +403,8 @@ public:
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        if (!pindex->HasSolution())
+            nSolution = pindex->GetSolution();
     }
 
     ADD_SERIALIZE_METHODS;
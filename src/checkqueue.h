@@ -16,6 +16,28 @@
 template <typename T>
 class CCheckQueueControl;
 
+namespace checkqueue_detail {
+/**
+ * Run one worker's chunk of checks. Check types that can share work across a
+ * chunk (such as batched signature verification) provide a static
+ * bool RunBatch(std::vector<T>&), which is preferred when present.
+ */
+template <typename T>
+auto RunChecks(std::vector<T>& vChecks, int) -> decltype(T::RunBatch(vChecks))
+{
+    return T::RunBatch(vChecks);
+}
+
+template <typename T>
+bool RunChecks(std::vector<T>& vChecks, long)
+{
+    for (T& check : vChecks)
+        if (!check())
+            return false;
+    return true;
+}
+} // namespace checkqueue_detail
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -116,9 +138,8 @@ private:
                 fOk = fAllOk;
             }
             // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
+            if (fOk)
+                fOk = checkqueue_detail::RunChecks(vChecks, 0);
             vChecks.clear();
         } while (true);
     }
@@ -9,6 +9,7 @@
 #include <primitives/transaction.h>
 #include <compressor.h>
 #include <core_memusage.h>
+#include <flathashmap.h>
 #include <hash.h>
 #include <memusage.h>
 #include <serialize.h>
@@ -84,8 +85,8 @@ public:
 class SaltedOutpointHasher
 {
 private:
-    /** Salt */
-    const uint64_t k0, k1;
+    /** Salt (not const, so that maps using it can be swapped) */
+    uint64_t k0, k1;
 
 public:
     SaltedOutpointHasher();
@@ -119,7 +120,9 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/** Entries are pooled and looked up through a flat slot array, which takes
+ *  less memory per cached coin than std::unordered_map. See flathashmap.h. */
+typedef flathashmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -236,6 +239,12 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Check if this cache has an entry for the given outpoint, spent or not.
+     * No calls to the backing CCoinsView are made.
+     */
+    bool HaveCacheEntry(const COutPoint &outpoint) const;
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -254,6 +263,14 @@ public:
      */
     void AddCoin(const COutPoint& outpoint, Coin&& coin, bool potential_overwrite);
 
+    /**
+     * Add a coin that was read from the backing view by someone else, as if
+     * it had been fetched through this cache. Nothing happens if the outpoint
+     * is already cached. The caller must make sure the backing view has not
+     * changed since the coin was read.
+     */
+    void PrefetchCoin(const COutPoint &outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
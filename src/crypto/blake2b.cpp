@@ -0,0 +1,291 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/blake2b.h>
+#include <crypto/common.h>
+
+#include <sodium.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+#if defined(ENABLE_AVX2) && (defined(__x86_64__) || defined(__amd64__))
+#include <cpuid.h>
+namespace blake2b_avx2
+{
+void Compress_4way(uint64_t* h, const unsigned char* const* blocks, uint64_t t0, uint64_t t1, uint64_t f0, uint64_t f1);
+}
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Internal BLAKE2b implementation.
+namespace blake2b
+{
+const size_t BLOCKBYTES = 128;
+
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+};
+
+const uint8_t SIGMA[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+uint64_t inline Rotr(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+void inline G(uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d, uint64_t x, uint64_t y)
+{
+    a = a + b + x;
+    d = Rotr(d ^ a, 32);
+    c = c + d;
+    b = Rotr(b ^ c, 24);
+    a = a + b + y;
+    d = Rotr(d ^ a, 16);
+    c = c + d;
+    b = Rotr(b ^ c, 63);
+}
+
+/** The BLAKE2b compression function F, for a counter already including this block. */
+void Compress(uint64_t* h, const unsigned char* block, uint64_t t0, uint64_t t1, uint64_t f0, uint64_t f1)
+{
+    uint64_t m[16];
+    uint64_t v[16];
+    for (int i = 0; i < 16; i++) m[i] = ReadLE64(block + 8 * i);
+    for (int i = 0; i < 8; i++) v[i] = h[i];
+    v[8] = IV[0];
+    v[9] = IV[1];
+    v[10] = IV[2];
+    v[11] = IV[3];
+    v[12] = IV[4] ^ t0;
+    v[13] = IV[5] ^ t1;
+    v[14] = IV[6] ^ f0;
+    v[15] = IV[7] ^ f1;
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = SIGMA[r];
+        G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++) h[i] ^= v[i] ^ v[i + 8];
+}
+
+void inline IncrementCounter(uint64_t& t0, uint64_t& t1, uint64_t inc)
+{
+    t0 += inc;
+    t1 += (t0 < inc);
+}
+
+} // namespace blake2b
+
+typedef void (*Compress4Type)(uint64_t*, const unsigned char* const*, uint64_t, uint64_t, uint64_t, uint64_t);
+
+Compress4Type Compress_4way = nullptr;
+
+/** Check CBLAKE2b and BLAKE2bFinalizeWords against libsodium, for every way the word can fall across a block boundary. */
+bool SelfTest()
+{
+    static const size_t prefixes[] = {0, 1, 108, 124, 125, 127, 128, 129, 140, 252, 253, 256, 300};
+    static const size_t outlens[] = {64, 50, 30};
+    static const unsigned char personal[CBLAKE2b::PERSONAL_SIZE] = {'Z', 'c', 'a', 's', 'h', 'P', 'o', 'W', 1, 2, 3, 4, 5, 6, 7, 8};
+    unsigned char data[300];
+    uint32_t words[9];
+    unsigned char out[9 * 64];
+    unsigned char expected[64];
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = i * 7;
+    for (size_t i = 0; i < 9; i++) words[i] = 0x01020304u * (i + 1);
+
+    for (size_t outlen : outlens) {
+        for (size_t prefix : prefixes) {
+            crypto_generichash_blake2b_state ref;
+            crypto_generichash_blake2b_init_salt_personal(&ref, nullptr, 0, outlen, nullptr, personal);
+            crypto_generichash_blake2b_update(&ref, data, prefix);
+            CBLAKE2b base(outlen, personal);
+            base.Write(data, prefix);
+
+            crypto_generichash_blake2b_state state = ref;
+            crypto_generichash_blake2b_final(&state, expected, outlen);
+            CBLAKE2b(base).Finalize(out);
+            if (memcmp(out, expected, outlen)) return false;
+
+            // Exercise the vector path, a partial group and the scalar tail.
+            BLAKE2bFinalizeWords(base, words, 9, out);
+            for (size_t i = 0; i < 9; i++) {
+                state = ref;
+                unsigned char le[4];
+                WriteLE32(le, words[i]);
+                crypto_generichash_blake2b_update(&state, le, sizeof(le));
+                crypto_generichash_blake2b_final(&state, expected, outlen);
+                if (memcmp(out + i * outlen, expected, outlen)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+#if defined(ENABLE_AVX2) && (defined(__x86_64__) || defined(__amd64__))
+// Check that the OS has enabled AVX (saves the YMM registers on context switch).
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+std::string BLAKE2bAutoDetect()
+{
+    std::string ret = "standard";
+#if defined(ENABLE_AVX2) && (defined(__x86_64__) || defined(__amd64__))
+    uint32_t eax, ebx, ecx, edx;
+    bool have_avx = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    if (have_avx && __get_cpuid_max(0, nullptr) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if ((ebx >> 5) & 1) {
+            Compress_4way = blake2b_avx2::Compress_4way;
+            ret += ",avx2(4way)";
+        }
+    }
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
+CBLAKE2b::CBLAKE2b(size_t outlenIn, const unsigned char* personal) : buflen(0), outlen(outlenIn)
+{
+    using namespace blake2b;
+    assert(outlen > 0 && outlen <= MAX_OUTPUT_SIZE);
+    memcpy(h, IV, sizeof(h));
+    // Parameter block: digest length, no key, fanout 1, depth 1, no salt
+    h[0] ^= 0x01010000 ^ (uint64_t)outlen;
+    if (personal) {
+        h[6] ^= ReadLE64(personal);
+        h[7] ^= ReadLE64(personal + 8);
+    }
+    t[0] = t[1] = 0;
+}
+
+CBLAKE2b& CBLAKE2b::Write(const unsigned char* data, size_t len)
+{
+    using namespace blake2b;
+    // The last block is only compressed once more input follows it, as the
+    // final one is compressed differently.
+    while (len > 0) {
+        if (buflen == BLOCKBYTES) {
+            IncrementCounter(t[0], t[1], BLOCKBYTES);
+            Compress(h, buf, t[0], t[1], 0, 0);
+            buflen = 0;
+        }
+        size_t n = std::min(BLOCKBYTES - buflen, len);
+        memcpy(buf + buflen, data, n);
+        buflen += n;
+        data += n;
+        len -= n;
+    }
+    return *this;
+}
+
+void CBLAKE2b::Finalize(unsigned char* hash)
+{
+    using namespace blake2b;
+    IncrementCounter(t[0], t[1], buflen);
+    memset(buf + buflen, 0, BLOCKBYTES - buflen);
+    Compress(h, buf, t[0], t[1], ~(uint64_t)0, 0);
+    unsigned char digest[MAX_OUTPUT_SIZE];
+    for (int j = 0; j < 8; j++) WriteLE64(digest + 8 * j, h[j]);
+    memcpy(hash, digest, outlen);
+}
+
+void BLAKE2bFinalizeWords(const CBLAKE2b& base, const uint32_t* words, size_t count, unsigned char* out)
+{
+    using namespace blake2b;
+    const size_t outlen = base.outlen;
+    assert(base.buflen <= BLOCKBYTES);
+
+    // Of the buffered bytes plus the word, all but the last 1..128 bytes go
+    // through non-final blocks. A full buffer is the same for every word.
+    uint64_t h[8];
+    memcpy(h, base.h, sizeof(h));
+    uint64_t t0 = base.t[0];
+    uint64_t t1 = base.t[1];
+    const unsigned char* buf = base.buf;
+    size_t buflen = base.buflen;
+    if (buflen == BLOCKBYTES) {
+        IncrementCounter(t0, t1, BLOCKBYTES);
+        Compress(h, buf, t0, t1, 0, 0);
+        buflen = 0;
+    }
+
+    // What is left is at most one block that the word spills out of, and
+    // the final block.
+    const size_t taillen = buflen + 4;
+    const bool fSplit = taillen > BLOCKBYTES;
+    uint64_t tSplit0 = t0, tSplit1 = t1;
+    IncrementCounter(tSplit0, tSplit1, BLOCKBYTES);
+    uint64_t tFinal0 = t0, tFinal1 = t1;
+    IncrementCounter(tFinal0, tFinal1, taillen);
+    const uint64_t fFinal0 = ~(uint64_t)0;
+
+    unsigned char msg[4][2 * BLOCKBYTES];
+    for (int lane = 0; lane < 4; lane++) {
+        memcpy(msg[lane], buf, buflen);
+        memset(msg[lane] + buflen, 0, sizeof(msg[lane]) - buflen);
+    }
+    const size_t finalOffset = fSplit ? BLOCKBYTES : 0;
+    unsigned char digest[64];
+
+    size_t i = 0;
+    if (Compress_4way) {
+        const unsigned char* blocks[4] = {msg[0], msg[1], msg[2], msg[3]};
+        const unsigned char* finals[4] = {msg[0] + finalOffset, msg[1] + finalOffset, msg[2] + finalOffset, msg[3] + finalOffset};
+        uint64_t h4[32];
+        for (; i + 4 <= count; i += 4) {
+            for (int lane = 0; lane < 4; lane++) {
+                WriteLE32(msg[lane] + buflen, words[i + lane]);
+            }
+            for (int j = 0; j < 8; j++) {
+                h4[4 * j] = h4[4 * j + 1] = h4[4 * j + 2] = h4[4 * j + 3] = h[j];
+            }
+            if (fSplit) Compress_4way(h4, blocks, tSplit0, tSplit1, 0, 0);
+            Compress_4way(h4, finals, tFinal0, tFinal1, fFinal0, 0);
+            for (int lane = 0; lane < 4; lane++) {
+                for (int j = 0; j < 8; j++) WriteLE64(digest + 8 * j, h4[4 * j + lane]);
+                memcpy(out + (i + lane) * outlen, digest, outlen);
+            }
+        }
+    }
+    for (; i < count; i++) {
+        uint64_t hl[8];
+        memcpy(hl, h, sizeof(hl));
+        WriteLE32(msg[0] + buflen, words[i]);
+        if (fSplit) Compress(hl, msg[0], tSplit0, tSplit1, 0, 0);
+        Compress(hl, msg[0] + finalOffset, tFinal0, tFinal1, fFinal0, 0);
+        for (int j = 0; j < 8; j++) WriteLE64(digest + 8 * j, hl[j]);
+        memcpy(out + i * outlen, digest, outlen);
+    }
+}
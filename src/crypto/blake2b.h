@@ -0,0 +1,51 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_BLAKE2B_H
+#define BITCOIN_CRYPTO_BLAKE2B_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** A hasher class for BLAKE2b, unkeyed and unsalted, with an optional personalization. */
+class CBLAKE2b
+{
+private:
+    uint64_t h[8];
+    uint64_t t[2];
+    unsigned char buf[128];
+    size_t buflen;
+    size_t outlen;
+
+    friend void BLAKE2bFinalizeWords(const CBLAKE2b& base, const uint32_t* words, size_t count, unsigned char* out);
+
+public:
+    static const size_t MAX_OUTPUT_SIZE = 64;
+    static const size_t PERSONAL_SIZE = 16;
+
+    /** personal, if not null, points to PERSONAL_SIZE bytes. */
+    explicit CBLAKE2b(size_t outlenIn, const unsigned char* personal = nullptr);
+    CBLAKE2b& Write(const unsigned char* data, size_t len);
+    /** Writes OutputSize() bytes. */
+    void Finalize(unsigned char* hash);
+    size_t OutputSize() const { return outlen; }
+};
+
+/** Autodetect the best available batched BLAKE2b implementation.
+ *  Returns the name of the implementation.
+ */
+std::string BLAKE2bAutoDetect();
+
+/** Finish many copies of one BLAKE2b state, each after absorbing a different
+ *  little-endian 32-bit word, as Equihash does for every leaf hash.
+ *  base:    the state the words are appended to
+ *  words:   count words to append, one per output
+ *  out:     pointer to a count*base.OutputSize() byte output buffer
+ *  Blocks shared by all copies are compressed once; the rest run four at a
+ *  time when a vector implementation is available. Does not allocate.
+ */
+void BLAKE2bFinalizeWords(const CBLAKE2b& base, const uint32_t* words, size_t count, unsigned char* out);
+
+#endif // BITCOIN_CRYPTO_BLAKE2B_H
@@ -0,0 +1,117 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is a 4-way BLAKE2b compression function using AVX2.
+// Each 256-bit register holds the same state word of four independent hashes.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace blake2b_avx2 {
+namespace {
+
+static const uint8_t SIGMA[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+
+/** Rotations by whole bytes are shuffles; 63 is a shift and an add. */
+__m256i inline Rotr32(__m256i x) { return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)); }
+__m256i inline Rotr24(__m256i x)
+{
+    return _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+                                                    3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10));
+}
+__m256i inline Rotr16(__m256i x)
+{
+    return _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                                                    2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9));
+}
+__m256i inline Rotr63(__m256i x) { return _mm256_or_si256(_mm256_srli_epi64(x, 63), Add(x, x)); }
+
+void inline G(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i x, __m256i y)
+{
+    a = Add(a, b, x);
+    d = Rotr32(Xor(d, a));
+    c = Add(c, d);
+    b = Rotr24(Xor(b, c));
+    a = Add(a, b, y);
+    d = Rotr16(Xor(d, a));
+    c = Add(c, d);
+    b = Rotr63(Xor(b, c));
+}
+
+/** Transpose message words 4*i..4*i+3 of four blocks into one register per word. */
+void inline Load4(__m256i* m, const unsigned char* const* blocks, int i)
+{
+    __m256i r0 = _mm256_loadu_si256((const __m256i*)(blocks[0] + 32 * i));
+    __m256i r1 = _mm256_loadu_si256((const __m256i*)(blocks[1] + 32 * i));
+    __m256i r2 = _mm256_loadu_si256((const __m256i*)(blocks[2] + 32 * i));
+    __m256i r3 = _mm256_loadu_si256((const __m256i*)(blocks[3] + 32 * i));
+    __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+    __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+    __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+    __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+    m[4 * i + 0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+    m[4 * i + 1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+    m[4 * i + 2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+    m[4 * i + 3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+}
+
+}
+
+/** h holds the eight state words of four hashes interleaved, h[4*i+lane]. */
+void Compress_4way(uint64_t* h, const unsigned char* const* blocks, uint64_t t0, uint64_t t1, uint64_t f0, uint64_t f1)
+{
+    __m256i m[16];
+    __m256i v[16];
+    for (int i = 0; i < 4; i++) Load4(m, blocks, i);
+    for (int i = 0; i < 8; i++) v[i] = _mm256_loadu_si256((const __m256i*)(h + 4 * i));
+    v[8] = K(0x6a09e667f3bcc908ull);
+    v[9] = K(0xbb67ae8584caa73bull);
+    v[10] = K(0x3c6ef372fe94f82bull);
+    v[11] = K(0xa54ff53a5f1d36f1ull);
+    v[12] = K(0x510e527fade682d1ull ^ t0);
+    v[13] = K(0x9b05688c2b3e6c1full ^ t1);
+    v[14] = K(0x1f83d9abfb41bd6bull ^ f0);
+    v[15] = K(0x5be0cd19137e2179ull ^ f1);
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = SIGMA[r];
+        G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(h + 4 * i));
+        _mm256_storeu_si256((__m256i*)(h + 4 * i), Xor(hi, Xor(v[i], v[i + 8])));
+    }
+}
+
+}
+
+#endif
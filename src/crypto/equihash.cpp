@@ -17,10 +17,13 @@
 #endif
 
 #include "crypto/equihash.h"
+#include "crypto/blake2b.h"
 
 #include <algorithm>
+#include <exception>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 
 #include <boost/optional.hpp>
 
@@ -42,6 +45,18 @@ int Equihash<N,K>::InitialiseState(eh_HashState& base_state)
                                                          personalization);
 }
 
+template<unsigned int N, unsigned int K>
+void Equihash<N,K>::InitialiseState(CBLAKE2b& base_state)
+{
+    uint32_t le_N = htole32(N);
+    uint32_t le_K = htole32(K);
+    unsigned char personalization[CBLAKE2b::PERSONAL_SIZE] = {};
+    memcpy(personalization, "ZcashPoW", 8);
+    memcpy(personalization+8,  &le_N, 4);
+    memcpy(personalization+12, &le_K, 4);
+    base_state = CBLAKE2b((512/N)*N/8, personalization);
+}
+
 void GenerateHash(const eh_HashState& base_state, eh_index g,
                   unsigned char* hash, size_t hLen)
 {
@@ -322,78 +337,208 @@ std::shared_ptr<eh_trunc> TruncatedStepRow<WIDTH>::GetTruncatedIndices(size_t le
     return p;
 }
 
+/** Lists shorter than this are not worth splitting across threads. */
+static const size_t EH_MIN_PARALLEL_ROWS = 1 << 14;
+
+static unsigned int ThreadsForRows(unsigned int nThreads, size_t nRows)
+{
+    return nRows < EH_MIN_PARALLEL_ROWS ? 1 : nThreads;
+}
+
+/**
+ * Run fn(id) for id in [0, nThreads), with id 0 on the calling thread.
+ * Waits for all of them and then rethrows the first exception, so a
+ * cancellation thrown by id 0 never leaves other threads running.
+ */
+static void EhParallel(unsigned int nThreads, const std::function<void(unsigned int)>& fn)
+{
+    if (nThreads <= 1) {
+        fn(0);
+        return;
+    }
+    std::vector<std::exception_ptr> errors(nThreads);
+    std::vector<std::thread> threads;
+    threads.reserve(nThreads - 1);
+    for (unsigned int id = 1; id < nThreads; id++) {
+        threads.emplace_back([&fn, &errors, id] {
+            try {
+                fn(id);
+            } catch (...) {
+                errors[id] = std::current_exception();
+            }
+        });
+    }
+    try {
+        fn(0);
+    } catch (...) {
+        errors[0] = std::current_exception();
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (const std::exception_ptr& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+/** Sort nThreads slices in parallel, then merge neighbouring runs pairwise. */
+template<typename Row>
+static void EhParallelSort(EhRowList<Row>& X, size_t len, unsigned int nThreads)
+{
+    nThreads = ThreadsForRows(nThreads, X.size());
+    std::vector<size_t> bounds(nThreads + 1);
+    for (unsigned int t = 0; t <= nThreads; t++) {
+        bounds[t] = X.size() * t / nThreads;
+    }
+    EhParallel(nThreads, [&](unsigned int id) {
+        std::sort(X.begin() + bounds[id], X.begin() + bounds[id + 1], CompareSR(len));
+    });
+    for (unsigned int width = 1; width < nThreads; width *= 2) {
+        unsigned int nMerges = (nThreads - width + 2 * width - 1) / (2 * width);
+        EhParallel(nMerges, [&](unsigned int id) {
+            unsigned int lo = id * 2 * width;
+            unsigned int mid = lo + width;
+            unsigned int hi = std::min(lo + 2 * width, nThreads);
+            std::inplace_merge(X.begin() + bounds[lo], X.begin() + bounds[mid], X.begin() + bounds[hi], CompareSR(len));
+        });
+    }
+}
+
+/**
+ * Split a sorted list into nThreads ranges that each start a new group of
+ * rows colliding on the first len bytes, so no pair spans two ranges.
+ */
+template<typename Row>
+static std::vector<size_t> EhGroupBounds(EhRowList<Row>& X, size_t len, unsigned int nThreads)
+{
+    std::vector<size_t> bounds(nThreads + 1);
+    bounds[0] = 0;
+    for (unsigned int t = 1; t < nThreads; t++) {
+        size_t i = std::max(bounds[t - 1], X.size() * t / nThreads);
+        while (i > 0 && i < X.size() && HasCollision(X[i - 1], X[i], len)) {
+            i++;
+        }
+        bounds[t] = i;
+    }
+    bounds[nThreads] = X.size();
+    return bounds;
+}
+
+/** Call f(i, j) for each group X[i..i+j) of two or more rows colliding on the first len bytes. */
+template<typename Row, typename F>
+static void EhForEachGroup(EhRowList<Row>& X, size_t begin, size_t end, size_t len, F f)
+{
+    size_t i = begin;
+    while (i + 1 < end) {
+        // 2b) Find next set of unordered pairs with collisions on the next n/(k+1) bits
+        size_t j = 1;
+        while (i+j < end && HasCollision(X[i], X[i+j], len)) {
+            j++;
+        }
+        if (j > 1) f(i, j);
+        i += j;
+    }
+}
+
+/**
+ * Steps 2b-2g of a round: merge every colliding pair of the sorted list X
+ * into Xc. collide(a, b, out) builds the merged row directly in its final
+ * slot and returns false if it should be dropped.
+ *
+ * Threads take ranges of whole collision groups. Each range's output region
+ * is sized from its pair count up front, so threads write without
+ * coordinating; slots of dropped pairs are closed up afterwards.
+ */
+template<typename Row, typename Collide>
+static void EhCollideRound(EhRowList<Row>& X, EhRowList<Row>& Xc, size_t len, unsigned int nThreads,
+                           Collide collide, const std::function<bool(EhSolverCancelCheck)>& cancelled)
+{
+    nThreads = ThreadsForRows(nThreads, X.size());
+    std::vector<size_t> bounds = EhGroupBounds(X, len, nThreads);
+    std::vector<size_t> offsets(nThreads + 1, 0);
+    std::vector<size_t> used(nThreads, 0);
+    EhParallel(nThreads, [&](unsigned int id) {
+        size_t nPairs = 0;
+        EhForEachGroup(X, bounds[id], bounds[id + 1], len, [&nPairs](size_t i, size_t j) {
+            nPairs += j * (j - 1) / 2;
+        });
+        offsets[id + 1] = nPairs;
+    });
+    for (unsigned int t = 0; t < nThreads; t++) {
+        offsets[t + 1] += offsets[t];
+    }
+    Xc.resize(offsets[nThreads]);
+
+    EhParallel(nThreads, [&](unsigned int id) {
+        size_t pos = offsets[id];
+        EhForEachGroup(X, bounds[id], bounds[id + 1], len, [&](size_t i, size_t j) {
+            // 2c) Calculate tuples (X_i ^ X_j, (i, j))
+            for (size_t l = 0; l < j - 1; l++) {
+                for (size_t m = l + 1; m < j; m++) {
+                    if (collide(X[i+l], X[i+m], Xc[pos])) {
+                        pos++;
+                    }
+                }
+            }
+            if (id == 0 && cancelled(ListColliding)) throw solver_cancelled;
+        });
+        used[id] = pos - offsets[id];
+    });
+
+    size_t dst = used[0];
+    for (unsigned int t = 1; t < nThreads; t++) {
+        if (dst != offsets[t]) {
+            std::copy(Xc.begin() + offsets[t], Xc.begin() + offsets[t] + used[t], Xc.begin() + dst);
+        }
+        dst += used[t];
+    }
+    Xc.resize(dst);
+}
+
 template<unsigned int N, unsigned int K>
 bool Equihash<N,K>::BasicSolve(const eh_HashState& base_state,
                                const std::function<bool(std::vector<unsigned char>)> validBlock,
-                               const std::function<bool(EhSolverCancelCheck)> cancelled)
+                               const std::function<bool(EhSolverCancelCheck)> cancelled,
+                               SolverArena* arena)
 {
     eh_index init_size { 1 << (CollisionBitLength + 1) };
+    std::unique_ptr<SolverArena> localArena;
+    if (!arena) {
+        localArena.reset(new SolverArena());
+        arena = localArena.get();
+    }
 
     // 1) Generate first list
     size_t hashLen = HashLength;
     size_t lenIndices = sizeof(eh_index);
-    std::vector<FullStepRow<FullWidth>> X;
-    X.reserve(init_size);
+    EhRowList<FullStepRow<FullWidth>>* X = &arena->full[0];
+    EhRowList<FullStepRow<FullWidth>>* Xc = &arena->full[1];
+    X->clear();
+    X->reserve(init_size);
     unsigned char tmpHash[HashOutput];
-    for (eh_index g = 0; X.size() < init_size; g++) {
+    for (eh_index g = 0; X->size() < init_size; g++) {
         GenerateHash(base_state, g, tmpHash, HashOutput);
-        for (eh_index i = 0; i < IndicesPerHashOutput && X.size() < init_size; i++) {
-            X.emplace_back(tmpHash+(i*N/8), N/8, HashLength,
-                           CollisionBitLength, (g*IndicesPerHashOutput)+i);
+        for (eh_index i = 0; i < IndicesPerHashOutput && X->size() < init_size; i++) {
+            X->emplace_back(tmpHash+(i*N/8), N/8, HashLength,
+                            CollisionBitLength, (g*IndicesPerHashOutput)+i);
         }
         if (cancelled(ListGeneration)) throw solver_cancelled;
     }
 
     // 3) Repeat step 2 until 2n/(k+1) bits remain
-    for (unsigned int r = 1; r < K && X.size() > 0; r++) {
+    for (unsigned int r = 1; r < K && X->size() > 0; r++) {
         // 2a) Sort the list
-        std::sort(X.begin(), X.end(), CompareSR(CollisionByteLength));
+        std::sort(X->begin(), X->end(), CompareSR(CollisionByteLength));
         if (cancelled(ListSorting)) throw solver_cancelled;
 
-        size_t i = 0;
-        size_t posFree = 0;
-        std::vector<FullStepRow<FullWidth>> Xc;
-        while (i < X.size() - 1) {
-            // 2b) Find next set of unordered pairs with collisions on the next n/(k+1) bits
-            size_t j = 1;
-            while (i+j < X.size() &&
-                    HasCollision(X[i], X[i+j], CollisionByteLength)) {
-                j++;
-            }
-
-            // 2c) Calculate tuples (X_i ^ X_j, (i, j))
-            for (size_t l = 0; l < j - 1; l++) {
-                for (size_t m = l + 1; m < j; m++) {
-                    if (DistinctIndices(X[i+l], X[i+m], hashLen, lenIndices)) {
-                        Xc.emplace_back(X[i+l], X[i+m], hashLen, lenIndices, CollisionByteLength);
-                    }
-                }
-            }
-
-            // 2d) Store tuples on the table in-place if possible
-            while (posFree < i+j && Xc.size() > 0) {
-                X[posFree++] = Xc.back();
-                Xc.pop_back();
-            }
-
-            i += j;
-            if (cancelled(ListColliding)) throw solver_cancelled;
-        }
-
-        // 2e) Handle edge case where final table entry has no collision
-        while (posFree < X.size() && Xc.size() > 0) {
-            X[posFree++] = Xc.back();
-            Xc.pop_back();
-        }
-
-        if (Xc.size() > 0) {
-            // 2f) Add overflow to end of table
-            X.insert(X.end(), Xc.begin(), Xc.end());
-        } else if (posFree < X.size()) {
-            // 2g) Remove empty space at the end
-            X.erase(X.begin()+posFree, X.end());
-            X.shrink_to_fit();
-        }
+        // 2b-2g) Merge the colliding pairs into the other list
+        EhCollideRound(*X, *Xc, CollisionByteLength, 1,
+            [hashLen, lenIndices](FullStepRow<FullWidth>& a, FullStepRow<FullWidth>& b, FullStepRow<FullWidth>& out) {
+                if (!DistinctIndices(a, b, hashLen, lenIndices)) return false;
+                new (&out) FullStepRow<FullWidth>(a, b, hashLen, lenIndices, CollisionByteLength);
+                return true;
+            }, cancelled);
+        std::swap(X, Xc);
 
         hashLen -= CollisionByteLength;
         lenIndices *= 2;
@@ -401,21 +546,21 @@ bool Equihash<N,K>::BasicSolve(const eh_HashState& base_state,
     }
 
     // k+1) Find a collision on last 2n(k+1) bits
-    if (X.size() > 1) {
-        std::sort(X.begin(), X.end(), CompareSR(hashLen));
+    if (X->size() > 1) {
+        std::sort(X->begin(), X->end(), CompareSR(hashLen));
         if (cancelled(FinalSorting)) throw solver_cancelled;
         size_t i = 0;
-        while (i < X.size() - 1) {
+        while (i < X->size() - 1) {
             size_t j = 1;
-            while (i+j < X.size() &&
-                    HasCollision(X[i], X[i+j], hashLen)) {
+            while (i+j < X->size() &&
+                    HasCollision((*X)[i], (*X)[i+j], hashLen)) {
                 j++;
             }
 
             for (size_t l = 0; l < j - 1; l++) {
                 for (size_t m = l + 1; m < j; m++) {
-                    FullStepRow<FinalFullWidth> res(X[i+l], X[i+m], hashLen, lenIndices, 0);
-                    if (DistinctIndices(X[i+l], X[i+m], hashLen, lenIndices)) {
+                    FullStepRow<FinalFullWidth> res((*X)[i+l], (*X)[i+m], hashLen, lenIndices, 0);
+                    if (DistinctIndices((*X)[i+l], (*X)[i+m], hashLen, lenIndices)) {
                         auto soln = res.GetIndices(hashLen, 2*lenIndices, CollisionBitLength);
                         assert(soln.size() == equihash_solution_size(N, K));
                         if (validBlock(soln)) {
@@ -433,20 +578,12 @@ bool Equihash<N,K>::BasicSolve(const eh_HashState& base_state,
     return false;
 }
 
+/** Merge the pairs of X whose truncated indices match the branches lt and rt into Xc, then swap the lists. */
 template<size_t WIDTH>
-void CollideBranches(std::vector<FullStepRow<WIDTH>>& X, const size_t hlen, const size_t lenIndices, const unsigned int clen, const unsigned int ilen, const eh_trunc lt, const eh_trunc rt)
+void CollideBranches(EhRowList<FullStepRow<WIDTH>>& X, EhRowList<FullStepRow<WIDTH>>& Xc, const size_t hlen, const size_t lenIndices, const unsigned int clen, const unsigned int ilen, const eh_trunc lt, const eh_trunc rt)
 {
-    size_t i = 0;
-    size_t posFree = 0;
-    std::vector<FullStepRow<WIDTH>> Xc;
-    while (i < X.size() - 1) {
-        // 2b) Find next set of unordered pairs with collisions on the next n/(k+1) bits
-        size_t j = 1;
-        while (i+j < X.size() &&
-                HasCollision(X[i], X[i+j], clen)) {
-            j++;
-        }
-
+    Xc.clear();
+    EhForEachGroup(X, 0, X.size(), clen, [&](size_t i, size_t j) {
         // 2c) Calculate tuples (X_i ^ X_j, (i, j))
         for (size_t l = 0; l < j - 1; l++) {
             for (size_t m = l + 1; m < j; m++) {
@@ -459,119 +596,73 @@ void CollideBranches(std::vector<FullStepRow<WIDTH>>& X, const size_t hlen, cons
                 }
             }
         }
-
-        // 2d) Store tuples on the table in-place if possible
-        while (posFree < i+j && Xc.size() > 0) {
-            X[posFree++] = Xc.back();
-            Xc.pop_back();
-        }
-
-        i += j;
-    }
-
-    // 2e) Handle edge case where final table entry has no collision
-    while (posFree < X.size() && Xc.size() > 0) {
-        X[posFree++] = Xc.back();
-        Xc.pop_back();
-    }
-
-    if (Xc.size() > 0) {
-        // 2f) Add overflow to end of table
-        X.insert(X.end(), Xc.begin(), Xc.end());
-    } else if (posFree < X.size()) {
-        // 2g) Remove empty space at the end
-        X.erase(X.begin()+posFree, X.end());
-        X.shrink_to_fit();
-    }
+    });
+    X.swap(Xc);
 }
 
 template<unsigned int N, unsigned int K>
 bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
                                    const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                   const std::function<bool(EhSolverCancelCheck)> cancelled)
+                                   const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                   unsigned int nThreads,
+                                   SolverArena* arena)
 {
     eh_index init_size { 1 << (CollisionBitLength + 1) };
     eh_index recreate_size { UntruncateIndex(1, 0, CollisionBitLength + 1) };
+    nThreads = std::max(nThreads, 1u);
+    std::unique_ptr<SolverArena> localArena;
+    if (!arena) {
+        localArena.reset(new SolverArena());
+        arena = localArena.get();
+    }
 
     // First run the algorithm with truncated indices
 
     const eh_index soln_size { 1 << K };
-    std::vector<std::shared_ptr<eh_trunc>> partialSolns;
+    std::vector<eh_trunc>& partialSolns = arena->partialSolns;
+    partialSolns.clear();
     size_t invalidCount = 0;
     {
 
         // 1) Generate first list
         size_t hashLen = HashLength;
         size_t lenIndices = sizeof(eh_trunc);
-        std::vector<TruncatedStepRow<TruncatedWidth>> Xt;
-        Xt.reserve(init_size);
-        unsigned char tmpHash[HashOutput];
-        for (eh_index g = 0; Xt.size() < init_size; g++) {
-            GenerateHash(base_state, g, tmpHash, HashOutput);
-            for (eh_index i = 0; i < IndicesPerHashOutput && Xt.size() < init_size; i++) {
-                Xt.emplace_back(tmpHash+(i*N/8), N/8, HashLength, CollisionBitLength,
+        EhRowList<TruncatedStepRow<TruncatedWidth>>* Xt = &arena->truncated[0];
+        EhRowList<TruncatedStepRow<TruncatedWidth>>* Xc = &arena->truncated[1];
+        Xt->resize(init_size);
+        {
+            const unsigned int nGenThreads = ThreadsForRows(nThreads, init_size);
+            const eh_index nHashes = (init_size + IndicesPerHashOutput - 1) / IndicesPerHashOutput;
+            EhParallel(nGenThreads, [&](unsigned int id) {
+                unsigned char tmpHash[HashOutput];
+                for (eh_index g = nHashes * id / nGenThreads; g < nHashes * (id + 1) / nGenThreads; g++) {
+                    GenerateHash(base_state, g, tmpHash, HashOutput);
+                    for (eh_index i = 0; i < IndicesPerHashOutput && g*IndicesPerHashOutput+i < init_size; i++) {
+                        new (&(*Xt)[g*IndicesPerHashOutput+i]) TruncatedStepRow<TruncatedWidth>(
+                                tmpHash+(i*N/8), N/8, HashLength, CollisionBitLength,
                                 (g*IndicesPerHashOutput)+i, CollisionBitLength + 1);
-            }
-            if (cancelled(ListGeneration)) throw solver_cancelled;
+                    }
+                    if (id == 0 && cancelled(ListGeneration)) throw solver_cancelled;
+                }
+            });
         }
 
         // 3) Repeat step 2 until 2n/(k+1) bits remain
-        for (size_t r = 1; r < K && Xt.size() > 0; r++) {
+        for (size_t r = 1; r < K && Xt->size() > 0; r++) {
             // 2a) Sort the list
-            std::sort(Xt.begin(), Xt.end(), CompareSR(CollisionByteLength));
+            EhParallelSort(*Xt, CollisionByteLength, nThreads);
             if (cancelled(ListSorting)) throw solver_cancelled;
 
-            size_t i = 0;
-            size_t posFree = 0;
-            std::vector<TruncatedStepRow<TruncatedWidth>> Xc;
-            while (i < Xt.size() - 1) {
-                // 2b) Find next set of unordered pairs with collisions on the next n/(k+1) bits
-                size_t j = 1;
-                while (i+j < Xt.size() &&
-                        HasCollision(Xt[i], Xt[i+j], CollisionByteLength)) {
-                    j++;
-                }
-
-                // 2c) Calculate tuples (X_i ^ X_j, (i, j))
-                //bool checking_for_zero = (i == 0 && Xt[0].IsZero(hashLen));
-                for (size_t l = 0; l < j - 1; l++) {
-                    for (size_t m = l + 1; m < j; m++) {
-                        // We truncated, so don't check for distinct indices here
-                        TruncatedStepRow<TruncatedWidth> Xi {Xt[i+l], Xt[i+m],
-                                                             hashLen, lenIndices,
-                                                             CollisionByteLength};
-                        if (!(Xi.IsZero(hashLen-CollisionByteLength) &&
-                              IsProbablyDuplicate<soln_size>(Xi.GetTruncatedIndices(hashLen-CollisionByteLength, 2*lenIndices),
-                                                             2*lenIndices))) {
-                            Xc.emplace_back(Xi);
-                        }
-                    }
-                }
-
-                // 2d) Store tuples on the table in-place if possible
-                while (posFree < i+j && Xc.size() > 0) {
-                    Xt[posFree++] = Xc.back();
-                    Xc.pop_back();
-                }
-
-                i += j;
-                if (cancelled(ListColliding)) throw solver_cancelled;
-            }
-
-            // 2e) Handle edge case where final table entry has no collision
-            while (posFree < Xt.size() && Xc.size() > 0) {
-                Xt[posFree++] = Xc.back();
-                Xc.pop_back();
-            }
-
-            if (Xc.size() > 0) {
-                // 2f) Add overflow to end of table
-                Xt.insert(Xt.end(), Xc.begin(), Xc.end());
-            } else if (posFree < Xt.size()) {
-                // 2g) Remove empty space at the end
-                Xt.erase(Xt.begin()+posFree, Xt.end());
-                Xt.shrink_to_fit();
-            }
+            // 2b-2g) Merge the colliding pairs into the other list
+            EhCollideRound(*Xt, *Xc, CollisionByteLength, nThreads,
+                [hashLen, lenIndices](TruncatedStepRow<TruncatedWidth>& a, TruncatedStepRow<TruncatedWidth>& b, TruncatedStepRow<TruncatedWidth>& out) {
+                    // We truncated, so don't check for distinct indices here
+                    new (&out) TruncatedStepRow<TruncatedWidth>(a, b, hashLen, lenIndices, CollisionByteLength);
+                    return !(out.IsZero(hashLen-CollisionByteLength) &&
+                             IsProbablyDuplicate<soln_size>(out.TruncatedIndices(hashLen-CollisionByteLength),
+                                                            2*lenIndices));
+                }, cancelled);
+            std::swap(Xt, Xc);
 
             hashLen -= CollisionByteLength;
             lenIndices *= 2;
@@ -579,61 +670,65 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
         }
 
         // k+1) Find a collision on last 2n(k+1) bits
-        if (Xt.size() > 1) {
-            std::sort(Xt.begin(), Xt.end(), CompareSR(hashLen));
+        if (Xt->size() > 1) {
+            EhParallelSort(*Xt, hashLen, nThreads);
             if (cancelled(FinalSorting)) throw solver_cancelled;
-            size_t i = 0;
-            while (i < Xt.size() - 1) {
-                size_t j = 1;
-                while (i+j < Xt.size() &&
-                        HasCollision(Xt[i], Xt[i+j], hashLen)) {
-                    j++;
-                }
-
-                for (size_t l = 0; l < j - 1; l++) {
-                    for (size_t m = l + 1; m < j; m++) {
-                        TruncatedStepRow<FinalTruncatedWidth> res(Xt[i+l], Xt[i+m],
-                                                                  hashLen, lenIndices, 0);
-                        auto soln = res.GetTruncatedIndices(hashLen, 2*lenIndices);
-                        if (!IsProbablyDuplicate<soln_size>(soln, 2*lenIndices)) {
-                            partialSolns.push_back(soln);
+            const unsigned int nFinalThreads = ThreadsForRows(nThreads, Xt->size());
+            std::vector<size_t> bounds = EhGroupBounds(*Xt, hashLen, nFinalThreads);
+            arena->threadPartialSolns.resize(std::max<size_t>(arena->threadPartialSolns.size(), nFinalThreads));
+            EhParallel(nFinalThreads, [&](unsigned int id) {
+                std::vector<eh_trunc>& solns = arena->threadPartialSolns[id];
+                solns.clear();
+                EhForEachGroup(*Xt, bounds[id], bounds[id + 1], hashLen, [&](size_t i, size_t j) {
+                    for (size_t l = 0; l < j - 1; l++) {
+                        for (size_t m = l + 1; m < j; m++) {
+                            TruncatedStepRow<FinalTruncatedWidth> res((*Xt)[i+l], (*Xt)[i+m],
+                                                                      hashLen, lenIndices, 0);
+                            const eh_trunc* soln = res.TruncatedIndices(hashLen);
+                            if (!IsProbablyDuplicate<soln_size>(soln, 2*lenIndices)) {
+                                solns.insert(solns.end(), soln, soln + soln_size);
+                            }
                         }
                     }
-                }
-
-                i += j;
-                if (cancelled(FinalColliding)) throw solver_cancelled;
+                    if (id == 0 && cancelled(FinalColliding)) throw solver_cancelled;
+                });
+            });
+            for (unsigned int t = 0; t < nFinalThreads; t++) {
+                partialSolns.insert(partialSolns.end(), arena->threadPartialSolns[t].begin(), arena->threadPartialSolns[t].end());
             }
         }
 
-    } // Ensure Xt goes out of scope and is destroyed
+    }
 
 
-    // Now for each solution run the algorithm again to recreate the indices
-    for (std::shared_ptr<eh_trunc> partialSoln : partialSolns) {
-        std::set<std::vector<unsigned char>> solns;
+    // Now for each solution run the algorithm again to recreate the indices.
+    // Partial solutions are independent, so up to nThreads are recreated at
+    // once; the results are then handed to validBlock in order.
+    auto recreate = [&](const eh_trunc* partialSoln,
+                        typename SolverArena::Recreation& lists,
+                        std::set<std::vector<unsigned char>>& solns,
+                        const std::function<bool(EhSolverCancelCheck)>& cancelled) -> bool {
         size_t hashLen;
         size_t lenIndices;
         unsigned char tmpHash[HashOutput];
-        std::vector<boost::optional<std::vector<FullStepRow<FinalFullWidth>>>> X;
-        X.reserve(K+1);
+        EhRowList<FullStepRow<FinalFullWidth>>& ic = lists.ic;
+        size_t nLevels = 0;
 
         // 3) Repeat steps 1 and 2 for each partial index
         for (eh_index i = 0; i < soln_size; i++) {
             // 1) Generate first list of possibilities
-            std::vector<FullStepRow<FinalFullWidth>> icv;
-            icv.reserve(recreate_size);
+            ic.clear();
+            ic.reserve(recreate_size);
             for (eh_index j = 0; j < recreate_size; j++) {
-                eh_index newIndex { UntruncateIndex(partialSoln.get()[i], j, CollisionBitLength + 1) };
+                eh_index newIndex { UntruncateIndex(partialSoln[i], j, CollisionBitLength + 1) };
                 if (j == 0 || newIndex % IndicesPerHashOutput == 0) {
                     GenerateHash(base_state, newIndex/IndicesPerHashOutput,
                                  tmpHash, HashOutput);
                 }
-                icv.emplace_back(tmpHash+((newIndex % IndicesPerHashOutput) * N/8),
-                                 N/8, HashLength, CollisionBitLength, newIndex);
+                ic.emplace_back(tmpHash+((newIndex % IndicesPerHashOutput) * N/8),
+                                N/8, HashLength, CollisionBitLength, newIndex);
                 if (cancelled(PartialGeneration)) throw solver_cancelled;
             }
-            boost::optional<std::vector<FullStepRow<FinalFullWidth>>> ic = icv;
 
             // 2a) For each pair of lists:
             hashLen = HashLength;
@@ -641,33 +736,32 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
             size_t rti = i;
             for (size_t r = 0; r <= K; r++) {
                 // 2b) Until we are at the top of a subtree:
-                if (r < X.size()) {
-                    if (X[r]) {
-                        // 2c) Merge the lists
-                        ic->reserve(ic->size() + X[r]->size());
-                        ic->insert(ic->end(), X[r]->begin(), X[r]->end());
-                        std::sort(ic->begin(), ic->end(), CompareSR(hashLen));
-                        if (cancelled(PartialSorting)) throw solver_cancelled;
-                        size_t lti = rti-(1<<r);
-                        CollideBranches(*ic, hashLen, lenIndices,
-                                        CollisionByteLength,
-                                        CollisionBitLength + 1,
-                                        partialSoln.get()[lti], partialSoln.get()[rti]);
-
-                        // 2d) Check if this has become an invalid solution
-                        if (ic->size() == 0)
-                            goto invalidsolution;
-
-                        X[r] = boost::none;
-                        hashLen -= CollisionByteLength;
-                        lenIndices *= 2;
-                        rti = lti;
-                    } else {
-                        X[r] = *ic;
-                        break;
-                    }
+                if (r < nLevels && lists.present[r]) {
+                    // 2c) Merge the lists
+                    EhRowList<FullStepRow<FinalFullWidth>>& level = lists.levels[r];
+                    size_t nRows = ic.size();
+                    ic.resize(nRows + level.size());
+                    std::copy(level.begin(), level.end(), ic.begin() + nRows);
+                    std::sort(ic.begin(), ic.end(), CompareSR(hashLen));
+                    if (cancelled(PartialSorting)) throw solver_cancelled;
+                    size_t lti = rti-(1<<r);
+                    CollideBranches(ic, lists.scratch, hashLen, lenIndices,
+                                    CollisionByteLength,
+                                    CollisionBitLength + 1,
+                                    partialSoln[lti], partialSoln[rti]);
+
+                    // 2d) Check if this has become an invalid solution
+                    if (ic.size() == 0)
+                        return false;
+
+                    lists.present[r] = false;
+                    hashLen -= CollisionByteLength;
+                    lenIndices *= 2;
+                    rti = lti;
                 } else {
-                    X.push_back(ic);
+                    lists.levels[r].swap(ic);
+                    lists.present[r] = true;
+                    nLevels = std::max(nLevels, r + 1);
                     break;
                 }
                 if (cancelled(PartialSubtreeEnd)) throw solver_cancelled;
@@ -676,103 +770,193 @@ bool Equihash<N,K>::OptimisedSolve(const eh_HashState& base_state,
         }
 
         // We are at the top of the tree
-        assert(X.size() == K+1);
-        for (FullStepRow<FinalFullWidth> row : *X[K]) {
+        assert(nLevels == K+1 && lists.present[K]);
+        for (const FullStepRow<FinalFullWidth>& row : lists.levels[K]) {
             auto soln = row.GetIndices(hashLen, lenIndices, CollisionBitLength);
             assert(soln.size() == equihash_solution_size(N, K));
             solns.insert(soln);
         }
-        for (auto soln : solns) {
-            if (validBlock(soln))
-                return true;
+        return true;
+    };
+
+    const std::function<bool(EhSolverCancelCheck)> notCancelled = [](EhSolverCancelCheck pos) { return false; };
+    const size_t nPartialSolns = partialSolns.size() / soln_size;
+    arena->recreation.resize(std::max<size_t>(arena->recreation.size(), std::min<size_t>(nThreads, nPartialSolns)));
+    for (size_t start = 0; start < nPartialSolns; start += nThreads) {
+        const unsigned int nBatch = std::min<size_t>(nThreads, nPartialSolns - start);
+        std::vector<std::set<std::vector<unsigned char>>> solns(nBatch);
+        std::vector<char> valid(nBatch);
+        EhParallel(nBatch, [&](unsigned int id) {
+            valid[id] = recreate(partialSolns.data() + (start + id) * soln_size, arena->recreation[id],
+                                 solns[id], id == 0 ? cancelled : notCancelled);
+        });
+        for (unsigned int id = 0; id < nBatch; id++) {
+            if (!valid[id]) {
+                invalidCount++;
+                continue;
+            }
+            for (auto soln : solns[id]) {
+                if (validBlock(soln))
+                    return true;
+            }
+            if (cancelled(PartialEnd)) throw solver_cancelled;
         }
-        if (cancelled(PartialEnd)) throw solver_cancelled;
-        continue;
-
-invalidsolution:
-        invalidCount++;
     }
 
     return false;
 }
 
 template<unsigned int N, unsigned int K>
-bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln)
+bool Equihash<N,K>::IsValidSolution(const CBLAKE2b& base_state, const unsigned char* soln, size_t solnLen)
 {
-    if (soln.size() != SolutionWidth) {
+    return CheckSolution([&base_state](const uint32_t* words, size_t n, unsigned char* out) {
+        BLAKE2bFinalizeWords(base_state, words, n, out);
+    }, soln, solnLen);
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, const unsigned char* soln, size_t solnLen)
+{
+    return CheckSolution([&base_state](const uint32_t* words, size_t n, unsigned char* out) {
+        for (size_t i = 0; i < n; i++) {
+            GenerateHash(base_state, words[i], out + i * HashOutput, HashOutput);
+        }
+    }, soln, solnLen);
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::CheckSolution(const LeafHasher& hashLeaves, const unsigned char* soln, size_t solnLen)
+{
+    if (solnLen != SolutionWidth) {
         return false;
     }
 
-    std::vector<FullStepRow<FinalFullWidth>> X;
-    X.reserve(1 << K);
-    unsigned char tmpHash[HashOutput];
-    for (eh_index i : GetIndicesFromMinimal(soln, CollisionBitLength)) {
-        GenerateHash(base_state, i/IndicesPerHashOutput, tmpHash, HashOutput);
-        X.emplace_back(tmpHash+((i % IndicesPerHashOutput) * N/8),
-                       N/8, HashLength, CollisionBitLength, i);
+    // Same as GetIndicesFromMinimal()
+    eh_index indices[1 << K];
+    {
+        unsigned char array[sizeof(indices)];
+        ExpandArray(soln, solnLen, array, sizeof(array), CollisionBitLength+1,
+                    sizeof(eh_index) - ((CollisionBitLength+1)+7)/8);
+        for (size_t i = 0; i < (1 << K); i++) {
+            indices[i] = ArrayToEhIndex(array+(i*sizeof(eh_index)));
+        }
     }
 
-    size_t hashLen = HashLength;
-    size_t lenIndices = sizeof(eh_index);
-    while (X.size() > 1) {
-        std::vector<FullStepRow<FinalFullWidth>> Xc;
-        for (size_t i = 0; i < X.size(); i += 2) {
-            if (!HasCollision(X[i], X[i+1], CollisionByteLength)) {
-                return false;
+    // Every merge in the tree requires its two halves to have disjoint
+    // indices, which together amounts to all indices being distinct.
+    {
+        eh_index sorted[1 << K];
+        std::copy(indices, indices + (1 << K), sorted);
+        std::sort(sorted, sorted + (1 << K));
+        if (std::adjacent_find(sorted, sorted + (1 << K)) != sorted + (1 << K)) {
+            return false;
+        }
+    }
+
+    // Expanded leaf hashes, one row per index. Rows are XORed pairwise in
+    // place, so after each round row j holds the j-th subtree.
+    unsigned char rows[1 << K][HashLength];
+    {
+        const size_t BATCH = 16;
+        uint32_t words[BATCH];
+        unsigned char hashes[BATCH][HashOutput];
+        for (size_t i = 0; i < (1 << K); i += BATCH) {
+            const size_t n = std::min<size_t>(BATCH, (1 << K) - i);
+            for (size_t j = 0; j < n; j++) {
+                words[j] = indices[i+j] / IndicesPerHashOutput;
             }
-            if (X[i+1].IndicesBefore(X[i], hashLen, lenIndices)) {
+            hashLeaves(words, n, hashes[0]);
+            for (size_t j = 0; j < n; j++) {
+                ExpandArray(hashes[j]+((indices[i+j] % IndicesPerHashOutput) * N/8), N/8,
+                            rows[i+j], HashLength, CollisionBitLength);
+            }
+        }
+    }
+
+    size_t hashPos = 0;
+    for (size_t r = 0; r < K; r++) {
+        for (size_t j = 0; j < ((size_t)1 << (K - r - 1)); j++) {
+            const unsigned char* a = rows[2*j] + hashPos;
+            const unsigned char* b = rows[2*j+1] + hashPos;
+            if (memcmp(a, b, CollisionByteLength) != 0) {
                 return false;
             }
-            if (!DistinctIndices(X[i], X[i+1], hashLen, lenIndices)) {
+            // The subtree with the smaller first index must come first
+            if (indices[(2*j) << r] > indices[(2*j+1) << r]) {
                 return false;
             }
-            Xc.emplace_back(X[i], X[i+1], hashLen, lenIndices, CollisionByteLength);
+            unsigned char* out = rows[j] + hashPos;
+            for (size_t l = CollisionByteLength; l < HashLength - hashPos; l++) {
+                out[l] = a[l] ^ b[l];
+            }
         }
-        X = Xc;
-        hashLen -= CollisionByteLength;
-        lenIndices *= 2;
+        hashPos += CollisionByteLength;
     }
 
-    assert(X.size() == 1);
-    return X[0].IsZero(hashLen);
+    for (size_t l = hashPos; l < HashLength; l++) {
+        if (rows[0][l] != 0) {
+            return false;
+        }
+    }
+    return true;
 }
 
 // Explicit instantiations for Equihash<96,3>
 template int Equihash<96,3>::InitialiseState(eh_HashState& base_state);
+template void Equihash<96,3>::InitialiseState(CBLAKE2b& base_state);
 template bool Equihash<96,3>::BasicSolve(const eh_HashState& base_state,
                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                         const std::function<bool(EhSolverCancelCheck)> cancelled);
+                                         const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                         Equihash<96,3>::SolverArena* arena);
 template bool Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                             const std::function<bool(EhSolverCancelCheck)> cancelled);
-template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+                                             const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                             unsigned int nThreads,
+                                             Equihash<96,3>::SolverArena* arena);
+template bool Equihash<96,3>::IsValidSolution(const CBLAKE2b& base_state, const unsigned char* soln, size_t solnLen);
+template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, const unsigned char* soln, size_t solnLen);
 
 // Explicit instantiations for Equihash<200,9>
 template int Equihash<200,9>::InitialiseState(eh_HashState& base_state);
+template void Equihash<200,9>::InitialiseState(CBLAKE2b& base_state);
 template bool Equihash<200,9>::BasicSolve(const eh_HashState& base_state,
                                           const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                          const std::function<bool(EhSolverCancelCheck)> cancelled);
+                                          const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                          Equihash<200,9>::SolverArena* arena);
 template bool Equihash<200,9>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
-template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+                                              const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                              unsigned int nThreads,
+                                              Equihash<200,9>::SolverArena* arena);
+template bool Equihash<200,9>::IsValidSolution(const CBLAKE2b& base_state, const unsigned char* soln, size_t solnLen);
+template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, const unsigned char* soln, size_t solnLen);
 
 // Explicit instantiations for Equihash<96,5>
 template int Equihash<96,5>::InitialiseState(eh_HashState& base_state);
+template void Equihash<96,5>::InitialiseState(CBLAKE2b& base_state);
 template bool Equihash<96,5>::BasicSolve(const eh_HashState& base_state,
                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                         const std::function<bool(EhSolverCancelCheck)> cancelled);
+                                         const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                         Equihash<96,5>::SolverArena* arena);
 template bool Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                             const std::function<bool(EhSolverCancelCheck)> cancelled);
-template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+                                             const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                             unsigned int nThreads,
+                                             Equihash<96,5>::SolverArena* arena);
+template bool Equihash<96,5>::IsValidSolution(const CBLAKE2b& base_state, const unsigned char* soln, size_t solnLen);
+template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, const unsigned char* soln, size_t solnLen);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<48,5>::InitialiseState(eh_HashState& base_state);
+template void Equihash<48,5>::InitialiseState(CBLAKE2b& base_state);
 template bool Equihash<48,5>::BasicSolve(const eh_HashState& base_state,
                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                         const std::function<bool(EhSolverCancelCheck)> cancelled);
+                                         const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                         Equihash<48,5>::SolverArena* arena);
 template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
-                                             const std::function<bool(EhSolverCancelCheck)> cancelled);
-template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+                                             const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                             unsigned int nThreads,
+                                             Equihash<48,5>::SolverArena* arena);
+template bool Equihash<48,5>::IsValidSolution(const CBLAKE2b& base_state, const unsigned char* soln, size_t solnLen);
+template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, const unsigned char* soln, size_t solnLen);
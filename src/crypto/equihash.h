@@ -7,15 +7,20 @@
 #define BITCOIN_EQUIHASH_H
 
 #include <compat/endian.h>
+#include <crypto/blake2b.h>
 #include <utilstrencodings.h>
 
 #include <sodium.h>
 
+#include <algorithm>
 #include <cstring>
 #include <exception>
 #include <functional>
 #include <memory>
+#include <new>
 #include <set>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 #include <boost/static_assert.hpp>
@@ -31,6 +36,9 @@ void CompressArray(const unsigned char* in, size_t in_len,
                    unsigned char* out, size_t out_len,
                    size_t bit_len, size_t byte_pad=0);
 
+void GenerateHash(const eh_HashState& base_state, eh_index g,
+                  unsigned char* hash, size_t hLen);
+
 eh_index ArrayToEhIndex(const unsigned char* array);
 eh_trunc TruncateIndex(const eh_index i, const unsigned int ilen);
 
@@ -49,6 +57,9 @@ class StepRow
 protected:
     unsigned char hash[WIDTH];
 
+    /** Uninitialised row, to be assigned before use. */
+    StepRow() { }
+
 public:
     StepRow(const unsigned char* hashIn, size_t hInLen,
             size_t hLen, size_t cBitLen);
@@ -90,6 +101,7 @@ class FullStepRow : public StepRow<WIDTH>
 public:
     FullStepRow(const unsigned char* hashIn, size_t hInLen,
                 size_t hLen, size_t cBitLen, eh_index i);
+    FullStepRow() { }
     ~FullStepRow() { }
 
     FullStepRow(const FullStepRow<WIDTH>& a) : StepRow<WIDTH> {a} { }
@@ -120,6 +132,7 @@ public:
     TruncatedStepRow(const unsigned char* hashIn, size_t hInLen,
                      size_t hLen, size_t cBitLen,
                      eh_index i, unsigned int ilen);
+    TruncatedStepRow() { }
     ~TruncatedStepRow() { }
 
     TruncatedStepRow(const TruncatedStepRow<WIDTH>& a) : StepRow<WIDTH> {a} { }
@@ -129,6 +142,47 @@ public:
 
     inline bool IndicesBefore(const TruncatedStepRow<WIDTH>& a, size_t len, size_t lenIndices) const { return memcmp(hash+len, a.hash+len, lenIndices) < 0; }
     std::shared_ptr<eh_trunc> GetTruncatedIndices(size_t len, size_t lenIndices) const;
+    /** Same indices as GetTruncatedIndices(), without copying them out of the row. */
+    const eh_trunc* TruncatedIndices(size_t len) const { return hash+len; }
+};
+
+/**
+ * A flat list of rows whose storage only ever grows. Clearing and refilling
+ * it reuses the same memory, so a solver that keeps its lists across solves
+ * stops allocating once they have reached their working size.
+ */
+template<typename Row>
+class EhRowList
+{
+private:
+    std::vector<Row> rows;
+    size_t count;
+
+public:
+    EhRowList() : count(0) { }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    Row* begin() { return rows.data(); }
+    Row* end() { return rows.data() + count; }
+    Row& operator[](size_t i) { return rows[i]; }
+    const Row& operator[](size_t i) const { return rows[i]; }
+
+    void clear() { count = 0; }
+    /** Ensure room for n rows without changing size(); grows with some slack. */
+    void reserve(size_t n) { if (rows.size() < n) rows.resize(n + n / 8); }
+    /** Change size(); new rows are uninitialised and must be assigned. */
+    void resize(size_t n) { reserve(n); count = n; }
+    void swap(EhRowList& other) { rows.swap(other.rows); std::swap(count, other.count); }
+
+    /** Construct a row in place at the end of the list. */
+    template<typename... Args>
+    Row& emplace_back(Args&&... args)
+    {
+        if (count == rows.size()) reserve(std::max<size_t>(64, 2 * count));
+        return *new (&rows[count++]) Row(std::forward<Args>(args)...);
+    }
+    void pop_back() { count--; }
 };
 
 enum EhSolverCancelCheck
@@ -179,16 +233,71 @@ public:
     enum : size_t { FinalTruncatedWidth=max(HashLength+sizeof(eh_trunc), 2*CollisionByteLength+sizeof(eh_trunc)*(1 << (K))) };
     enum : size_t { SolutionWidth=(1 << K)*(CollisionBitLength+1)/8 };
 
+    /**
+     * Working memory for BasicSolve() and OptimisedSolve(). Each round reads
+     * one row list and merges into the other, and the lists never shrink,
+     * so a caller that keeps an arena across solves allocates nothing once
+     * it has warmed up. An arena must only be used by one solve at a time.
+     */
+    struct SolverArena
+    {
+        EhRowList<FullStepRow<FullWidth>> full[2];
+        EhRowList<TruncatedStepRow<TruncatedWidth>> truncated[2];
+        /** Partial solutions, soln_size truncated indices each. */
+        std::vector<eh_trunc> partialSolns;
+        std::vector<std::vector<eh_trunc>> threadPartialSolns;
+
+        /** Per-thread lists for recreating full indices from a partial solution. */
+        struct Recreation
+        {
+            EhRowList<FullStepRow<FinalFullWidth>> ic;
+            EhRowList<FullStepRow<FinalFullWidth>> scratch;
+            EhRowList<FullStepRow<FinalFullWidth>> levels[K+1];
+            bool present[K+1];
+        };
+        std::vector<Recreation> recreation;
+    };
+
     Equihash() { }
 
     int InitialiseState(eh_HashState& base_state);
+    void InitialiseState(CBLAKE2b& base_state);
     bool BasicSolve(const eh_HashState& base_state,
                     const std::function<bool(std::vector<unsigned char>)> validBlock,
-                    const std::function<bool(EhSolverCancelCheck)> cancelled);
+                    const std::function<bool(EhSolverCancelCheck)> cancelled,
+                    SolverArena* arena = nullptr);
+    /**
+     * nThreads threads share one working set: hash generation, sorting and
+     * colliding of each round are split across them, as is the recreation
+     * of full indices from partial solutions. validBlock and cancelled are
+     * only ever called from the calling thread. Without an arena, working
+     * memory is allocated for this solve only.
+     */
     bool OptimisedSolve(const eh_HashState& base_state,
                         const std::function<bool(std::vector<unsigned char>)> validBlock,
-                        const std::function<bool(EhSolverCancelCheck)> cancelled);
-    bool IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+                        const std::function<bool(EhSolverCancelCheck)> cancelled,
+                        unsigned int nThreads = 1,
+                        SolverArena* arena = nullptr);
+    /**
+     * Check soln against base_state. Works on fixed-size stack buffers and
+     * never touches the heap. From a CBLAKE2b state the leaf hashes are
+     * computed in batches, which is what block validation uses.
+     */
+    bool IsValidSolution(const CBLAKE2b& base_state, const unsigned char* soln, size_t solnLen);
+    bool IsValidSolution(const CBLAKE2b& base_state, const std::vector<unsigned char>& soln)
+    {
+        return IsValidSolution(base_state, soln.data(), soln.size());
+    }
+    bool IsValidSolution(const eh_HashState& base_state, const unsigned char* soln, size_t solnLen);
+    bool IsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln)
+    {
+        return IsValidSolution(base_state, soln.data(), soln.size());
+    }
+
+private:
+    /** Writes the leaf hashes for n words to out, HashOutput bytes each. */
+    typedef std::function<void(const uint32_t* words, size_t n, unsigned char* out)> LeafHasher;
+    bool CheckSolution(const LeafHasher& hashLeaves, const unsigned char* soln, size_t solnLen);
 };
 
 #include "equihash.tcc"
@@ -237,16 +346,17 @@ inline bool EhBasicSolveUncancellable(unsigned int n, unsigned int k, const eh_H
 
 inline bool EhOptimisedSolve(unsigned int n, unsigned int k, const eh_HashState& base_state,
                     const std::function<bool(std::vector<unsigned char>)> validBlock,
-                    const std::function<bool(EhSolverCancelCheck)> cancelled)
+                    const std::function<bool(EhSolverCancelCheck)> cancelled,
+                    unsigned int nThreads = 1)
 {
     if (n == 96 && k == 3) {
-        return Eh96_3.OptimisedSolve(base_state, validBlock, cancelled);
+        return Eh96_3.OptimisedSolve(base_state, validBlock, cancelled, nThreads);
     } else if (n == 200 && k == 9) {
-        return Eh200_9.OptimisedSolve(base_state, validBlock, cancelled);
+        return Eh200_9.OptimisedSolve(base_state, validBlock, cancelled, nThreads);
     } else if (n == 96 && k == 5) {
-        return Eh96_5.OptimisedSolve(base_state, validBlock, cancelled);
+        return Eh96_5.OptimisedSolve(base_state, validBlock, cancelled, nThreads);
     } else if (n == 48 && k == 5) {
-        return Eh48_5.OptimisedSolve(base_state, validBlock, cancelled);
+        return Eh48_5.OptimisedSolve(base_state, validBlock, cancelled, nThreads);
     } else {
         throw std::invalid_argument("Unsupported Equihash parameters");
     }
@@ -0,0 +1,148 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/equihash_solver.h>
+
+#include <crypto/equihash_tromp.h>
+
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+std::mutex g_stats_mutex;
+EquihashSolverStats g_stats = {0, 0, 0};
+unsigned int g_active_solves = 0;
+std::chrono::steady_clock::time_point g_busy_since;
+
+/** Accounts the lifetime of one Solve() call, including early exits. */
+class SolveTimer
+{
+public:
+    SolveTimer()
+    {
+        std::lock_guard<std::mutex> lock(g_stats_mutex);
+        if (g_active_solves++ == 0) g_busy_since = std::chrono::steady_clock::now();
+        g_stats.nSolves++;
+    }
+
+    ~SolveTimer()
+    {
+        std::lock_guard<std::mutex> lock(g_stats_mutex);
+        if (--g_active_solves == 0) {
+            g_stats.nBusyMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_busy_since).count();
+        }
+    }
+};
+
+/** OptimisedSolve() with an arena kept for the lifetime of the solver. */
+template<unsigned int N, unsigned int K>
+class DefaultSolver : public CEquihashSolver
+{
+private:
+    Equihash<N,K> eh;
+    typename Equihash<N,K>::SolverArena arena;
+    const unsigned int nThreads;
+
+public:
+    explicit DefaultSolver(unsigned int nThreadsIn) : nThreads(nThreadsIn) { }
+
+    std::string GetName() const override { return "default"; }
+
+protected:
+    bool SolveInternal(const eh_HashState& base_state,
+                       const std::function<bool(std::vector<unsigned char>)> validBlock,
+                       const std::function<bool(EhSolverCancelCheck)> cancelled) override
+    {
+        return eh.OptimisedSolve(base_state, validBlock, cancelled, nThreads, &arena);
+    }
+};
+
+template<unsigned int N, unsigned int K>
+class TrompSolverAdapter : public CEquihashSolver
+{
+private:
+    TrompSolver<N,K> solver;
+
+public:
+    explicit TrompSolverAdapter(unsigned int nThreads) : solver(nThreads) { }
+
+    std::string GetName() const override { return "tromp"; }
+
+protected:
+    bool SolveInternal(const eh_HashState& base_state,
+                       const std::function<bool(std::vector<unsigned char>)> validBlock,
+                       const std::function<bool(EhSolverCancelCheck)> cancelled) override
+    {
+        return solver.Solve(base_state, validBlock, cancelled);
+    }
+};
+
+} // namespace
+
+bool CEquihashSolver::Solve(const eh_HashState& base_state,
+                            const std::function<bool(std::vector<unsigned char>)> validBlock,
+                            const std::function<bool(EhSolverCancelCheck)> cancelled)
+{
+    SolveTimer timer;
+    std::function<bool(std::vector<unsigned char>)> countingValidBlock =
+            [&validBlock](std::vector<unsigned char> soln) {
+                {
+                    std::lock_guard<std::mutex> lock(g_stats_mutex);
+                    g_stats.nSolutions++;
+                }
+                return validBlock(std::move(soln));
+            };
+    return SolveInternal(base_state, countingValidBlock, cancelled);
+}
+
+std::vector<std::string> GetEquihashSolverNames()
+{
+    return {"default", "tromp"};
+}
+
+std::unique_ptr<CEquihashSolver> CreateEquihashSolver(const std::string& name, unsigned int n, unsigned int k, unsigned int nThreads)
+{
+    if (name == "default") {
+        if (n == 200 && k == 9) {
+            return std::unique_ptr<CEquihashSolver>(new DefaultSolver<200,9>(nThreads));
+        } else if (n == 96 && k == 3) {
+            return std::unique_ptr<CEquihashSolver>(new DefaultSolver<96,3>(nThreads));
+        } else if (n == 96 && k == 5) {
+            return std::unique_ptr<CEquihashSolver>(new DefaultSolver<96,5>(nThreads));
+        } else if (n == 48 && k == 5) {
+            return std::unique_ptr<CEquihashSolver>(new DefaultSolver<48,5>(nThreads));
+        }
+        throw std::invalid_argument("Unsupported Equihash parameters for the default solver");
+    }
+    if (name == "tromp") {
+        if (n == 200 && k == 9) {
+            return std::unique_ptr<CEquihashSolver>(new TrompSolverAdapter<200,9>(nThreads));
+        } else if (n == 96 && k == 5) {
+            return std::unique_ptr<CEquihashSolver>(new TrompSolverAdapter<96,5>(nThreads));
+        } else if (n == 48 && k == 5) {
+            return std::unique_ptr<CEquihashSolver>(new TrompSolverAdapter<48,5>(nThreads));
+        }
+        throw std::invalid_argument("Unsupported Equihash parameters for the tromp solver");
+    }
+    throw std::invalid_argument("Unknown Equihash solver: " + name);
+}
+
+EquihashSolverStats GetEquihashSolverStats()
+{
+    std::lock_guard<std::mutex> lock(g_stats_mutex);
+    EquihashSolverStats stats = g_stats;
+    if (g_active_solves > 0) {
+        stats.nBusyMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_busy_since).count();
+    }
+    return stats;
+}
+
+double GetLocalSolPS()
+{
+    EquihashSolverStats stats = GetEquihashSolverStats();
+    if (stats.nBusyMicros == 0) return 0;
+    return stats.nSolutions * 1000000.0 / stats.nBusyMicros;
+}
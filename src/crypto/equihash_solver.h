@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_EQUIHASH_SOLVER_H
+#define BITCOIN_CRYPTO_EQUIHASH_SOLVER_H
+
+#include <crypto/equihash.h>
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * An Equihash solver for one fixed (n, k) parameter set, selected at runtime
+ * with -equihashsolver. Implementations may keep large buffers between calls,
+ * so a miner thread should create one instance and reuse it for every nonce.
+ */
+class CEquihashSolver
+{
+public:
+    virtual ~CEquihashSolver() { }
+
+    virtual std::string GetName() const = 0;
+
+    /**
+     * Search the solution space for base_state. Every candidate solution is
+     * passed to validBlock; the search stops early once it returns true.
+     * Throws EhSolverCancelledException if cancelled() returns true.
+     *
+     * Solve time and candidate counts are added to the global solver stats.
+     */
+    bool Solve(const eh_HashState& base_state,
+               const std::function<bool(std::vector<unsigned char>)> validBlock,
+               const std::function<bool(EhSolverCancelCheck)> cancelled);
+
+protected:
+    virtual bool SolveInternal(const eh_HashState& base_state,
+                               const std::function<bool(std::vector<unsigned char>)> validBlock,
+                               const std::function<bool(EhSolverCancelCheck)> cancelled) = 0;
+};
+
+/** Names accepted by CreateEquihashSolver(), default first. */
+std::vector<std::string> GetEquihashSolverNames();
+
+/**
+ * Construct the named solver for (n, k), using up to nThreads threads per
+ * solve where the implementation supports it. Throws std::invalid_argument
+ * for an unknown name or parameters the solver does not support.
+ */
+std::unique_ptr<CEquihashSolver> CreateEquihashSolver(const std::string& name, unsigned int n, unsigned int k, unsigned int nThreads = 1);
+
+struct EquihashSolverStats
+{
+    uint64_t nSolves;
+    uint64_t nSolutions;
+    /** Wall-clock time during which at least one solve was running. */
+    int64_t nBusyMicros;
+};
+
+EquihashSolverStats GetEquihashSolverStats();
+
+/** Candidate solutions checked per second of solver wall-clock time. */
+double GetLocalSolPS();
+
+#endif // BITCOIN_CRYPTO_EQUIHASH_SOLVER_H
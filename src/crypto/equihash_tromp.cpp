@@ -0,0 +1,270 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "crypto/equihash_tromp.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/** Reusable barrier for the solver threads; one generation per round. */
+class EhBarrier
+{
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    const unsigned int nThreads;
+    unsigned int nWaiting;
+    unsigned int nGeneration;
+
+public:
+    explicit EhBarrier(unsigned int n) : nThreads(n), nWaiting(0), nGeneration(0) { }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        unsigned int generation = nGeneration;
+        if (++nWaiting == nThreads) {
+            nWaiting = 0;
+            nGeneration++;
+            cond.notify_all();
+        } else {
+            cond.wait(lock, [this, generation] { return generation != nGeneration; });
+        }
+    }
+};
+
+namespace {
+
+static const uint16_t NO_SLOT = 0xFFFF;
+
+template<size_t BYTES>
+inline uint32_t ReadDigit(const unsigned char* p)
+{
+    uint32_t v = 0;
+    for (size_t i = 0; i < BYTES; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+} // namespace
+
+template<unsigned int N, unsigned int K>
+TrompSolver<N,K>::TrompSolver(unsigned int nThreadsIn) :
+    nThreads(std::max(nThreadsIn, 1u)), threads(nThreads), fCancelled(false)
+{
+    rows[0].resize(NumSlots * RowBytes(0));
+    rows[1].resize(NumSlots * RowBytes(1));
+    for (unsigned int r = 0; r < K; r++) {
+        trees[r].resize(NumSlots);
+        counts[r].reset(new std::atomic<uint32_t>[NumBuckets]);
+    }
+    for (ThreadState& ts : threads) {
+        ts.head.resize(NumRests);
+        ts.next.resize(SlotsPerBucket);
+        ts.candidates.reserve(MaxCandidates);
+    }
+}
+
+template<unsigned int N, unsigned int K>
+void TrompSolver<N,K>::StoreRow(unsigned int r, const unsigned char* hash, uint32_t node)
+{
+    uint32_t bucket = ReadDigit<DigitBytes>(hash) >> RestBits;
+    uint32_t slot = counts[r][bucket].fetch_add(1, std::memory_order_relaxed);
+    if (slot >= SlotsPerBucket) {
+        // Bucket overflow; the row is lost.
+        return;
+    }
+    size_t pos = (size_t)bucket * SlotsPerBucket + slot;
+    memcpy(rows[r & 1].data() + pos * RowBytes(r), hash, RowBytes(r));
+    trees[r][pos] = node;
+}
+
+template<unsigned int N, unsigned int K>
+void TrompSolver<N,K>::GenerateLeaves(unsigned int id, const eh_HashState& base_state)
+{
+    const size_t nIndicesPerHash = Equihash<N,K>::IndicesPerHashOutput;
+    const size_t nHashes = (NumLeaves + nIndicesPerHash - 1) / nIndicesPerHash;
+    unsigned char tmpHash[Equihash<N,K>::HashOutput];
+    unsigned char row[Equihash<N,K>::HashLength];
+    for (size_t g = id * nHashes / nThreads; g < (id + 1) * nHashes / nThreads; g++) {
+        GenerateHash(base_state, g, tmpHash, sizeof(tmpHash));
+        for (size_t j = 0; j < nIndicesPerHash; j++) {
+            size_t leaf = g * nIndicesPerHash + j;
+            if (leaf >= NumLeaves) break;
+            ExpandArray(tmpHash + j * N / 8, N / 8, row, sizeof(row), DigitBits);
+            StoreRow(0, row, leaf);
+        }
+    }
+}
+
+template<unsigned int N, unsigned int K>
+void TrompSolver<N,K>::CollideRound(unsigned int id, unsigned int r)
+{
+    ThreadState& ts = threads[id];
+    const size_t nIn = RowBytes(r);
+    const size_t nOut = RowBytes(r + 1);
+    const unsigned char* in = rows[r & 1].data();
+    unsigned char merged[Equihash<N,K>::HashLength];
+
+    for (size_t b = id * NumBuckets / nThreads; b < (id + 1) * NumBuckets / nThreads; b++) {
+        const uint32_t nRows = std::min<uint32_t>(counts[r][b].load(std::memory_order_relaxed), SlotsPerBucket);
+        const unsigned char* bucket = in + b * SlotsPerBucket * nIn;
+        std::fill(ts.head.begin(), ts.head.end(), NO_SLOT);
+        for (uint32_t s = 0; s < nRows; s++) {
+            const unsigned char* a = bucket + s * nIn;
+            uint32_t rest = ReadDigit<DigitBytes>(a) & (NumRests - 1);
+            for (uint16_t t = ts.head[rest]; t != NO_SLOT; t = ts.next[t]) {
+                const unsigned char* c = bucket + t * nIn;
+                unsigned char acc = 0;
+                for (size_t i = 0; i < nOut; i++) {
+                    merged[i] = a[DigitBytes + i] ^ c[DigitBytes + i];
+                    acc |= merged[i];
+                }
+                // Identical subtrees XOR to zero and can never be part of a
+                // solution with distinct indices.
+                if (acc == 0) continue;
+                StoreRow(r + 1, merged, (b << (2 * SlotBits)) | (s << SlotBits) | t);
+            }
+            ts.next[s] = ts.head[rest];
+            ts.head[rest] = s;
+        }
+    }
+}
+
+template<unsigned int N, unsigned int K>
+void TrompSolver<N,K>::CollideFinal(unsigned int id)
+{
+    ThreadState& ts = threads[id];
+    const unsigned int r = K - 1;
+    const size_t nIn = RowBytes(r);
+    const unsigned char* in = rows[r & 1].data();
+
+    for (size_t b = id * NumBuckets / nThreads; b < (id + 1) * NumBuckets / nThreads; b++) {
+        const uint32_t nRows = std::min<uint32_t>(counts[r][b].load(std::memory_order_relaxed), SlotsPerBucket);
+        const unsigned char* bucket = in + b * SlotsPerBucket * nIn;
+        std::fill(ts.head.begin(), ts.head.end(), NO_SLOT);
+        for (uint32_t s = 0; s < nRows; s++) {
+            const unsigned char* a = bucket + s * nIn;
+            uint32_t rest = ReadDigit<DigitBytes>(a) & (NumRests - 1);
+            for (uint16_t t = ts.head[rest]; t != NO_SLOT; t = ts.next[t]) {
+                const unsigned char* c = bucket + t * nIn;
+                if (memcmp(a + DigitBytes, c + DigitBytes, DigitBytes) == 0 &&
+                    ts.candidates.size() < MaxCandidates) {
+                    ts.candidates.push_back(Candidate{(uint32_t)b, s, t});
+                }
+            }
+            ts.next[s] = ts.head[rest];
+            ts.head[rest] = s;
+        }
+    }
+}
+
+template<unsigned int N, unsigned int K>
+void TrompSolver<N,K>::RecoverIndices(unsigned int r, uint32_t bucket, uint32_t slot, eh_index* out) const
+{
+    uint32_t node = trees[r][(size_t)bucket * SlotsPerBucket + slot];
+    if (r == 0) {
+        out[0] = node;
+        return;
+    }
+    const uint32_t mask = ((uint32_t)1 << SlotBits) - 1;
+    const size_t half = (size_t)1 << (r - 1);
+    uint32_t parent = node >> (2 * SlotBits);
+    RecoverIndices(r - 1, parent, (node >> SlotBits) & mask, out);
+    RecoverIndices(r - 1, parent, node & mask, out + half);
+    // Canonical ordering: the subtree with the smaller first index goes left.
+    if (out[half] < out[0]) {
+        std::swap_ranges(out, out + half, out + half);
+    }
+}
+
+template<unsigned int N, unsigned int K>
+void TrompSolver<N,K>::Worker(unsigned int id, const eh_HashState& base_state,
+                              const std::function<bool(EhSolverCancelCheck)>& cancelled,
+                              EhBarrier& barrier)
+{
+    GenerateLeaves(id, base_state);
+    for (unsigned int r = 0; r < K; r++) {
+        if (id == 0) {
+            try {
+                if (cancelled(r + 1 < K ? ListColliding : FinalColliding)) fCancelled = true;
+            } catch (...) {
+                workerError = std::current_exception();
+                fCancelled = true;
+            }
+        }
+        barrier.Wait();
+        if (fCancelled) return;
+        if (r + 1 < K) {
+            CollideRound(id, r);
+        } else {
+            CollideFinal(id);
+        }
+    }
+}
+
+template<unsigned int N, unsigned int K>
+bool TrompSolver<N,K>::Solve(const eh_HashState& base_state,
+                             const std::function<bool(std::vector<unsigned char>)> validBlock,
+                             const std::function<bool(EhSolverCancelCheck)> cancelled)
+{
+    for (unsigned int r = 0; r < K; r++) {
+        for (size_t b = 0; b < NumBuckets; b++) {
+            counts[r][b].store(0, std::memory_order_relaxed);
+        }
+    }
+    for (ThreadState& ts : threads) {
+        ts.candidates.clear();
+    }
+    fCancelled = false;
+    workerError = nullptr;
+
+    EhBarrier barrier(nThreads);
+    std::vector<std::thread> workers;
+    workers.reserve(nThreads - 1);
+    for (unsigned int id = 1; id < nThreads; id++) {
+        workers.emplace_back(&TrompSolver<N,K>::Worker, this, id, std::cref(base_state), std::cref(cancelled), std::ref(barrier));
+    }
+    Worker(0, base_state, cancelled, barrier);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (workerError) std::rethrow_exception(workerError);
+    if (fCancelled) throw EhSolverCancelledException();
+
+    Equihash<N,K> eh;
+    std::vector<eh_index> indices(1 << K);
+    std::vector<eh_index> sorted(1 << K);
+    const size_t half = (size_t)1 << (K - 1);
+    for (const ThreadState& ts : threads) {
+        for (const Candidate& cand : ts.candidates) {
+            RecoverIndices(K - 1, cand.bucket, cand.s, indices.data());
+            RecoverIndices(K - 1, cand.bucket, cand.t, indices.data() + half);
+            if (indices[half] < indices[0]) {
+                std::swap_ranges(indices.begin(), indices.begin() + half, indices.begin() + half);
+            }
+            sorted = indices;
+            std::sort(sorted.begin(), sorted.end());
+            if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) continue;
+
+            std::vector<unsigned char> soln = GetMinimalFromIndices(indices, DigitBits);
+            // Dropped rows can never produce a false positive, but a cheap
+            // full check keeps a solver bug from reaching the caller.
+            if (!eh.IsValidSolution(base_state, soln)) continue;
+            if (validBlock(soln)) return true;
+        }
+    }
+    return false;
+}
+
+template class TrompSolver<200,9>;
+template class TrompSolver<96,5>;
+template class TrompSolver<48,5>;
@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_EQUIHASH_TROMP_H
+#define BITCOIN_CRYPTO_EQUIHASH_TROMP_H
+
+#include <crypto/equihash.h>
+
+#include <atomic>
+#include <exception>
+#include <stdint.h>
+#include <vector>
+
+class EhBarrier;
+
+/**
+ * Bucket-sort Equihash solver in the style of John Tromp's CPU miner.
+ *
+ * Instead of sorting one big list of rows per round, every row is placed into
+ * a fixed-size bucket keyed on the high bits of the digit being collided, and
+ * only the "rest" bits are matched within each bucket. Rows are stored in two
+ * flat, ping-ponged hash buffers and each round keeps a compact 32-bit tree
+ * node (parent bucket, left slot, right slot) per row, so indices are only
+ * recovered for the handful of rows that survive the last round.
+ *
+ * Buckets have a fixed capacity, so a row that lands in a full bucket is
+ * dropped; the solver therefore finds almost every solution the reference
+ * solvers find, but not strictly all of them. Every solution it does report
+ * has been checked with Equihash<N,K>::IsValidSolution().
+ *
+ * All memory is allocated once in the constructor and reused across solves.
+ * An instance must not be used by more than one Solve() call at a time.
+ */
+template<unsigned int N, unsigned int K>
+class TrompSolver
+{
+public:
+    enum : size_t { DigitBits=N/(K+1) };
+    enum : size_t { DigitBytes=(DigitBits+7)/8 };
+    enum : size_t { RestBits=DigitBits >= 16 ? 8 : DigitBits/2 };
+    enum : size_t { BucketBits=DigitBits-RestBits };
+    enum : size_t { NumBuckets=(size_t)1 << BucketBits };
+    enum : size_t { NumRests=(size_t)1 << RestBits };
+    /**
+     * Expected rows per bucket is 2^(RestBits+1). Leave 50% headroom for the
+     * large parameter sets; the small regtest-sized buckets see much more
+     * relative variance and are cheap to make four times as large.
+     */
+    enum : size_t { SlotsPerBucket=RestBits >= 8 ? 3 << RestBits : 8 << RestBits };
+    enum : size_t { SlotBits=RestBits >= 8 ? RestBits+2 : RestBits+3 };
+    enum : size_t { NumLeaves=(size_t)1 << (DigitBits+1) };
+    enum : size_t { NumSlots=NumBuckets*SlotsPerBucket };
+    enum : size_t { MaxCandidates=4096 };
+
+    static_assert(DigitBits >= 8 && DigitBits <= 24, "digit must fit the byte-padded row layout");
+    static_assert(BucketBits + 2*SlotBits <= 32, "tree node must fit in 32 bits");
+    static_assert(SlotsPerBucket <= ((size_t)1 << SlotBits), "slot index must fit in SlotBits");
+
+    explicit TrompSolver(unsigned int nThreads = 1);
+
+    /** Same contract as Equihash<N,K>::OptimisedSolve(). */
+    bool Solve(const eh_HashState& base_state,
+               const std::function<bool(std::vector<unsigned char>)> validBlock,
+               const std::function<bool(EhSolverCancelCheck)> cancelled);
+
+    unsigned int GetThreads() const { return nThreads; }
+
+private:
+    struct Candidate {
+        uint32_t bucket;
+        uint32_t s;
+        uint32_t t;
+    };
+
+    struct ThreadState {
+        std::vector<uint16_t> head;
+        std::vector<uint16_t> next;
+        std::vector<Candidate> candidates;
+    };
+
+    const unsigned int nThreads;
+    /** Row hashes for even and odd rounds. */
+    std::vector<unsigned char> rows[2];
+    /** Tree node per slot, per round. Round 0 holds leaf indices. */
+    std::vector<uint32_t> trees[K];
+    /** Fill level per bucket, per round. */
+    std::unique_ptr<std::atomic<uint32_t>[]> counts[K];
+    std::vector<ThreadState> threads;
+    std::atomic<bool> fCancelled;
+    std::exception_ptr workerError;
+
+    static size_t RowBytes(unsigned int r) { return (K+1-r)*DigitBytes; }
+
+    void Worker(unsigned int id, const eh_HashState& base_state,
+                const std::function<bool(EhSolverCancelCheck)>& cancelled,
+                EhBarrier& barrier);
+    void GenerateLeaves(unsigned int id, const eh_HashState& base_state);
+    void CollideRound(unsigned int id, unsigned int r);
+    void CollideFinal(unsigned int id);
+    void StoreRow(unsigned int r, const unsigned char* hash, uint32_t node);
+    void RecoverIndices(unsigned int r, uint32_t bucket, uint32_t slot, eh_index* out) const;
+};
+
+#endif // BITCOIN_CRYPTO_EQUIHASH_TROMP_H
@@ -0,0 +1,64 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/lthash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <string.h>
+
+namespace
+{
+/** Expand an element into one value per lane. */
+void Expand(uint16_t* out, const unsigned char* data, size_t len)
+{
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+    unsigned char stream[LtHash16::LANES * 2];
+    ChaCha20(key, sizeof(key)).Output(stream, sizeof(stream));
+    for (size_t i = 0; i < LtHash16::LANES; i++) out[i] = ReadLE16(stream + 2 * i);
+}
+} // namespace
+
+LtHash16::LtHash16()
+{
+    memset(lanes, 0, sizeof(lanes));
+}
+
+LtHash16& LtHash16::Insert(const unsigned char* data, size_t len)
+{
+    uint16_t element[LANES];
+    Expand(element, data, len);
+    for (size_t i = 0; i < LANES; i++) lanes[i] += element[i];
+    return *this;
+}
+
+LtHash16& LtHash16::Remove(const unsigned char* data, size_t len)
+{
+    uint16_t element[LANES];
+    Expand(element, data, len);
+    for (size_t i = 0; i < LANES; i++) lanes[i] -= element[i];
+    return *this;
+}
+
+LtHash16& LtHash16::operator+=(const LtHash16& other)
+{
+    for (size_t i = 0; i < LANES; i++) lanes[i] += other.lanes[i];
+    return *this;
+}
+
+LtHash16& LtHash16::operator-=(const LtHash16& other)
+{
+    for (size_t i = 0; i < LANES; i++) lanes[i] -= other.lanes[i];
+    return *this;
+}
+
+void LtHash16::Finalize(unsigned char hash[OUTPUT_SIZE]) const
+{
+    unsigned char data[LANES * 2];
+    for (size_t i = 0; i < LANES; i++) WriteLE16(data + 2 * i, lanes[i]);
+    CSHA256().Write(data, sizeof(data)).Finalize(hash);
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_LTHASH_H
+#define BITCOIN_CRYPTO_LTHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A homomorphic hash of a multiset (LtHash with 1024 16-bit lanes).
+ *  Each element is expanded with ChaCha20, keyed by its SHA-256, and added
+ *  lane-wise modulo 2^16. The result does not depend on the order elements
+ *  are inserted in, so disjoint parts of a set can be hashed separately and
+ *  combined, and elements can be removed again.
+ */
+class LtHash16
+{
+public:
+    static const size_t LANES = 1024;
+    static const size_t OUTPUT_SIZE = 32;
+
+private:
+    uint16_t lanes[LANES];
+
+public:
+    LtHash16();
+    LtHash16& Insert(const unsigned char* data, size_t len);
+    LtHash16& Remove(const unsigned char* data, size_t len);
+    LtHash16& operator+=(const LtHash16& other);
+    LtHash16& operator-=(const LtHash16& other);
+    /** The SHA-256 of the lanes, as little-endian 16-bit words. */
+    void Finalize(unsigned char hash[OUTPUT_SIZE]) const;
+};
+
+#endif // BITCOIN_CRYPTO_LTHASH_H
@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <array>
+#include <string>
 
 /** A hasher class for SHA3-256. */
 class CSHA3_256
@@ -28,4 +29,17 @@ public:
     CSHA3_256& Reset();
 };
 
+/** Autodetect the best available SHA3-256 implementation.
+ *  Returns the name of the implementation.
+ */
+std::string SHA3_256AutoDetect();
+
+/** Compute multiple double-SHA3-256's of 64-byte blobs.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ *  output may alias input, as is done when reducing a merkle tree level in place.
+ */
+void SHA3_256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA3_256_H
@@ -0,0 +1,155 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is a 4-way SHA3-256 (Keccak-f[1600]) implementation using AVX2.
+// Each 256-bit register holds the same state lane of four independent hashes.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <crypto/common.h>
+
+namespace sha3_256_d64_avx2 {
+namespace {
+
+static const uint64_t RC[24] = {
+    0x0000000000000001ull, 0x0000000000008082ull, 0x800000000000808Aull, 0x8000000080008000ull,
+    0x000000000000808Bull, 0x0000000080000001ull, 0x8000000080008081ull, 0x8000000000008009ull,
+    0x000000000000008Aull, 0x0000000000000088ull, 0x0000000080008009ull, 0x000000008000000Aull,
+    0x000000008000808Bull, 0x800000000000008Bull, 0x8000000000008089ull, 0x8000000000008003ull,
+    0x8000000000008002ull, 0x8000000000000080ull, 0x000000000000800Aull, 0x800000008000000Aull,
+    0x8000000080008081ull, 0x8000000000008080ull, 0x0000000080000001ull, 0x8000000080008008ull
+};
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z, __m256i w, __m256i v) { return Xor(Xor(Xor(x, y), Xor(z, w)), v); }
+/** x ^ (~y & z), the Keccak chi step. */
+__m256i inline Chi(__m256i x, __m256i y, __m256i z) { return Xor(x, _mm256_andnot_si256(y, z)); }
+template<int n> __m256i inline Rotl(__m256i x) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+
+/** Keccak-f[1600] on four interleaved states. Same lane layout as sha3_256::transform. */
+void inline Transform(__m256i* A)
+{
+    for (int round = 0; round < 24; round++) {
+        __m256i C0 = Xor(A[0], A[5], A[10], A[15], A[20]);
+        __m256i C1 = Xor(A[1], A[6], A[11], A[16], A[21]);
+        __m256i C2 = Xor(A[2], A[7], A[12], A[17], A[22]);
+        __m256i C3 = Xor(A[3], A[8], A[13], A[18], A[23]);
+        __m256i C4 = Xor(A[4], A[9], A[14], A[19], A[24]);
+
+        __m256i D0 = Xor(C4, Rotl<1>(C1));
+        __m256i D1 = Xor(C0, Rotl<1>(C2));
+        __m256i D2 = Xor(C1, Rotl<1>(C3));
+        __m256i D3 = Xor(C2, Rotl<1>(C4));
+        __m256i D4 = Xor(C3, Rotl<1>(C0));
+
+        __m256i B0 = Xor(A[0], D0);
+        __m256i B10 = Rotl<1>(Xor(A[1], D1));
+        __m256i B20 = Rotl<62>(Xor(A[2], D2));
+        __m256i B5 = Rotl<28>(Xor(A[3], D3));
+        __m256i B15 = Rotl<27>(Xor(A[4], D4));
+
+        __m256i B16 = Rotl<36>(Xor(A[5], D0));
+        __m256i B1 = Rotl<44>(Xor(A[6], D1));
+        __m256i B11 = Rotl<6>(Xor(A[7], D2));
+        __m256i B21 = Rotl<55>(Xor(A[8], D3));
+        __m256i B6 = Rotl<20>(Xor(A[9], D4));
+
+        __m256i B7 = Rotl<3>(Xor(A[10], D0));
+        __m256i B17 = Rotl<10>(Xor(A[11], D1));
+        __m256i B2 = Rotl<43>(Xor(A[12], D2));
+        __m256i B12 = Rotl<25>(Xor(A[13], D3));
+        __m256i B22 = Rotl<39>(Xor(A[14], D4));
+
+        __m256i B23 = Rotl<41>(Xor(A[15], D0));
+        __m256i B8 = Rotl<45>(Xor(A[16], D1));
+        __m256i B18 = Rotl<15>(Xor(A[17], D2));
+        __m256i B3 = Rotl<21>(Xor(A[18], D3));
+        __m256i B13 = Rotl<8>(Xor(A[19], D4));
+
+        __m256i B14 = Rotl<18>(Xor(A[20], D0));
+        __m256i B24 = Rotl<2>(Xor(A[21], D1));
+        __m256i B9 = Rotl<61>(Xor(A[22], D2));
+        __m256i B19 = Rotl<56>(Xor(A[23], D3));
+        __m256i B4 = Rotl<14>(Xor(A[24], D4));
+
+        A[0] = Chi(B0, B1, B2);
+        A[1] = Chi(B1, B2, B3);
+        A[2] = Chi(B2, B3, B4);
+        A[3] = Chi(B3, B4, B0);
+        A[4] = Chi(B4, B0, B1);
+
+        A[5] = Chi(B5, B6, B7);
+        A[6] = Chi(B6, B7, B8);
+        A[7] = Chi(B7, B8, B9);
+        A[8] = Chi(B8, B9, B5);
+        A[9] = Chi(B9, B5, B6);
+
+        A[10] = Chi(B10, B11, B12);
+        A[11] = Chi(B11, B12, B13);
+        A[12] = Chi(B12, B13, B14);
+        A[13] = Chi(B13, B14, B10);
+        A[14] = Chi(B14, B10, B11);
+
+        A[15] = Chi(B15, B16, B17);
+        A[16] = Chi(B16, B17, B18);
+        A[17] = Chi(B17, B18, B19);
+        A[18] = Chi(B18, B19, B15);
+        A[19] = Chi(B19, B15, B16);
+
+        A[20] = Chi(B20, B21, B22);
+        A[21] = Chi(B21, B22, B23);
+        A[22] = Chi(B22, B23, B24);
+        A[23] = Chi(B23, B24, B20);
+        A[24] = Chi(B24, B20, B21);
+
+        A[0] = Xor(A[0], K(RC[round]));
+    }
+}
+
+/** Load lane i of four 64-byte inputs that are 64 bytes apart. */
+__m256i inline Read4(const unsigned char* in, int i)
+{
+    return _mm256_set_epi64x(ReadLE64(in + 192 + 8 * i), ReadLE64(in + 128 + 8 * i), ReadLE64(in + 64 + 8 * i), ReadLE64(in + 8 * i));
+}
+
+/** Store lane i of four 32-byte outputs that are 32 bytes apart. */
+void inline Write4(unsigned char* out, int i, __m256i v)
+{
+    alignas(32) uint64_t tmp[4];
+    _mm256_store_si256((__m256i*)tmp, v);
+    WriteLE64(out + 8 * i, tmp[0]);
+    WriteLE64(out + 32 + 8 * i, tmp[1]);
+    WriteLE64(out + 64 + 8 * i, tmp[2]);
+    WriteLE64(out + 96 + 8 * i, tmp[3]);
+}
+
+}
+
+void Transform_4way(unsigned char* out, const unsigned char* in)
+{
+    __m256i A[25];
+
+    // First pass: 64 bytes of message, SHA3 domain padding at byte 64, final bit at byte 135.
+    for (int i = 0; i < 8; i++) A[i] = Read4(in, i);
+    for (int i = 8; i < 25; i++) A[i] = _mm256_setzero_si256();
+    A[8] = K(0x06);
+    A[16] = K(0x8000000000000000ull);
+    Transform(A);
+
+    // Second pass over the 32-byte digest of the first.
+    A[4] = K(0x06);
+    for (int i = 5; i < 25; i++) A[i] = _mm256_setzero_si256();
+    A[16] = K(0x8000000000000000ull);
+    Transform(A);
+
+    for (int i = 0; i < 4; i++) Write4(out, i, A[i]);
+}
+
+}
+
+#endif
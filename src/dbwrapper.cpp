@@ -5,6 +5,7 @@
 #include <dbwrapper.h>
 
 #include <random.h>
+#include <utilstrencodings.h>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -71,14 +72,140 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+namespace {
+
+struct DBProfile
+{
+    const char* name;
+    CDBOptions options;
+};
+
+// Fields: profile, cache_mb, write_buffer_percent, max_open_files, block_size,
+// max_file_size, bloom_bits, compression, reuse_logs.
+const DBProfile DB_PROFILES[] = {
+    // What LevelDB has always been opened with.
+    {"default", {"default", 0, 25, DEFAULT_DB_MAX_OPEN_FILES, 4096, 2 << 20, 10, false, false}},
+    // Bigger write buffers and table files mean fewer, larger compactions;
+    // more open files keep the table index blocks cached.
+    {"ssd-throughput", {"ssd-throughput", 64, 40, 256, 4096, 32 << 20, 10, false, true}},
+    // Larger blocks and tables for fewer seeks per lookup and per compaction.
+    {"hdd", {"hdd", 0, 25, 128, 16384, 8 << 20, 10, false, false}},
+    // Each open table holds its index and filter in memory.
+    {"low-memory", {"low-memory", 0, 10, 32, 4096, 2 << 20, 10, false, false}},
+};
+
+/** Parse one "key=value" of -dboption into options. */
+void ParseDBOption(const std::string& option, CDBOptions& options)
+{
+    size_t pos = option.find('=');
+    if (pos == std::string::npos) {
+        throw std::runtime_error(strprintf("Invalid -dboption '%s': expected <key>=<value>", option));
+    }
+    const std::string key = option.substr(0, pos);
+    int64_t value;
+    if (!ParseInt64(option.substr(pos + 1), &value)) {
+        throw std::runtime_error(strprintf("Invalid -dboption '%s': value is not a number", option));
+    }
+    struct Field {
+        const char* key;
+        int64_t* field;
+        int64_t min;
+        int64_t max;
+    };
+    const Field fields[] = {
+        {"cache_mb", &options.cache_mb, 0, 16384},
+        {"write_buffer_percent", &options.write_buffer_percent, 5, 40},
+        {"max_open_files", &options.max_open_files, 16, 4096},
+        {"block_size", &options.block_size, 1024, 4 << 20},
+        {"max_file_size", &options.max_file_size, 1 << 20, 1 << 30},
+        {"bloom_bits", &options.bloom_bits, 0, 32},
+    };
+    for (const Field& field : fields) {
+        if (key == field.key) {
+            if (value < field.min || value > field.max) {
+                throw std::runtime_error(strprintf("Invalid -dboption '%s': %s must be between %d and %d", option, key, field.min, field.max));
+            }
+            *field.field = value;
+            return;
+        }
+    }
+    if (key == "compression" || key == "reuse_logs") {
+        if (value != 0 && value != 1) {
+            throw std::runtime_error(strprintf("Invalid -dboption '%s': %s must be 0 or 1", option, key));
+        }
+        (key == "compression" ? options.compression : options.reuse_logs) = value;
+        return;
+    }
+    throw std::runtime_error(strprintf("Invalid -dboption '%s': unknown key", option));
+}
+
+/** The values of arg meant for database name: unprefixed ones first, then those prefixed with "name:". */
+std::vector<std::string> GetDBArgs(const std::string& arg, const std::string& name)
+{
+    std::vector<std::string> global, specific;
+    for (const std::string& value : gArgs.GetArgs(arg)) {
+        size_t colon = value.find(':');
+        size_t equals = value.find('=');
+        if (colon == std::string::npos || (equals != std::string::npos && equals < colon)) {
+            global.push_back(value);
+        } else if (value.substr(0, colon) == name) {
+            specific.push_back(value.substr(colon + 1));
+        }
+    }
+    global.insert(global.end(), specific.begin(), specific.end());
+    return global;
+}
+
+} // namespace
+
+bool GetDBProfile(const std::string& name, CDBOptions& options)
+{
+    for (const DBProfile& profile : DB_PROFILES) {
+        if (name == profile.name) {
+            options = profile.options;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string DBProfileNames()
+{
+    std::string names;
+    for (const DBProfile& profile : DB_PROFILES) {
+        if (!names.empty()) names += ", ";
+        names += profile.name;
+    }
+    return names;
+}
+
+CDBOptions ReadDBOptions(const std::string& name)
+{
+    CDBOptions options;
+    GetDBProfile(DEFAULT_DB_PROFILE, options);
+    for (const std::string& profile : GetDBArgs("-dbprofile", name)) {
+        if (!GetDBProfile(profile, options)) {
+            throw std::runtime_error(strprintf("Unknown -dbprofile '%s' (available: %s)", profile, DBProfileNames()));
+        }
+    }
+    for (const std::string& option : GetDBArgs("-dboption", name)) {
+        ParseDBOption(option, options);
+    }
+    return options;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBOptions& dboptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    // up to two write buffers may be held in memory simultaneously
+    options.write_buffer_size = nCacheSize * dboptions.write_buffer_percent / 100;
+    options.block_cache = leveldb::NewLRUCache(nCacheSize - 2 * options.write_buffer_size);
+    options.filter_policy = dboptions.bloom_bits ? leveldb::NewBloomFilterPolicy(dboptions.bloom_bits) : nullptr;
+    options.compression = dboptions.compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dboptions.max_open_files;
+    options.block_size = dboptions.block_size;
+    options.max_file_size = dboptions.max_file_size;
+    options.reuse_logs = dboptions.reuse_logs;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -96,7 +223,9 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    m_dboptions = ReadDBOptions(m_name);
+    options = GetOptions(nCacheSize, m_dboptions);
+    m_block_cache_size = nCacheSize - 2 * options.write_buffer_size;
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -113,6 +242,8 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    LogPrintf("Using LevelDB profile %s for %s (%.1fMiB block cache, %.1fMiB write buffer, %d open files)\n", m_dboptions.profile, m_name,
+              m_block_cache_size * (1.0 / 1024 / 1024), options.write_buffer_size * (1.0 / 1024 / 1024), options.max_open_files);
 
     if (gArgs.GetBoolArg("-forcecompactdb", false)) {
         LogPrintf("Starting database compaction of %s\n", path.string());
@@ -16,6 +16,8 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <memory>
+
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
@@ -25,6 +27,46 @@ public:
     explicit dbwrapper_error(const std::string& msg) : std::runtime_error(msg) {}
 };
 
+/** LevelDB tuning of one database. */
+struct CDBOptions
+{
+    //! Name of the profile the settings started from
+    std::string profile;
+    //! Cache size in MiB, replacing this database's share of -dbcache (0 to keep the share; applied by init)
+    int64_t cache_mb;
+    //! Percentage of the cache used for each of the (up to two) write buffers; the rest caches blocks
+    int64_t write_buffer_percent;
+    int64_t max_open_files;
+    int64_t block_size;
+    //! Size at which table files are closed and a new one is started
+    int64_t max_file_size;
+    //! Bits per key of the Bloom filter (0 for none)
+    int64_t bloom_bits;
+    //! Only takes effect when LevelDB was built with Snappy
+    bool compression;
+    //! Append to the existing MANIFEST and log when opening
+    bool reuse_logs;
+};
+
+//! -dbprofile default
+static const char* const DEFAULT_DB_PROFILE = "default";
+//! Open files of the default profile
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+
+/** Settings of a named profile. Returns false if there is none by that name. */
+bool GetDBProfile(const std::string& name, CDBOptions& options);
+
+//! Names of the profiles, comma separated
+std::string DBProfileNames();
+
+/**
+ * Options for the database called name (the last component of its path),
+ * from -dbprofile and -dboption, either of which can be given for all
+ * databases or for one by prefixing it with "<name>:".
+ * Throws std::runtime_error for unknown profiles and invalid options.
+ */
+CDBOptions ReadDBOptions(const std::string& name);
+
 class CDBWrapper;
 
 /** These should be considered an implementation detail of the specific database.
@@ -201,6 +243,10 @@ private:
     //! the name of this database
     std::string m_name;
 
+    //! the tuning this database was opened with
+    CDBOptions m_dboptions;
+    size_t m_block_cache_size;
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
@@ -290,6 +336,11 @@ public:
     // Get an estimate of LevelDB memory usage (in bytes).
     size_t DynamicMemoryUsage() const;
 
+    const std::string& GetName() const { return m_name; }
+    const CDBOptions& GetDBOptions() const { return m_dboptions; }
+    size_t GetBlockCacheSize() const { return m_block_cache_size; }
+    size_t GetWriteBufferSize() const { return options.write_buffer_size; }
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush()
     {
@@ -307,6 +358,23 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    /**
+     * Pin the current state of the database. Iterators created from the
+     * same snapshot agree with each other whatever is written meanwhile.
+     */
+    std::shared_ptr<const leveldb::Snapshot> GetSnapshot() const
+    {
+        leveldb::DB* db = pdb;
+        return std::shared_ptr<const leveldb::Snapshot>(pdb->GetSnapshot(), [db](const leveldb::Snapshot* snapshot) { db->ReleaseSnapshot(snapshot); });
+    }
+
+    CDBIterator *NewIterator(const leveldb::Snapshot* snapshot) const
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
@@ -0,0 +1,84 @@
+#ifndef ED25519_BACKEND_H
+#define ED25519_BACKEND_H
+
+/*
+    The curve code (ge.c, sign.c, verify.c, keypair.c, add_scalar.c and
+    key_exchange.c) is compiled once per field arithmetic backend:
+
+      ref10  - the portable radix-2^25.5 code in fe.c
+      fe51   - radix-2^51 with 64x64->128 bit multiplies (fe51.c), only
+               where the compiler has unsigned __int128
+
+    Every build gets its own symbol names so both can be linked together.
+    The public ed25519_* functions in dispatch.c forward to whichever backend
+    ed25519_autodetect() selected.
+*/
+
+#if defined(__SIZEOF_INT128__)
+#define ED25519_HAVE_FE51 1
+#endif
+
+#if !defined(ED25519_DISPATCH)
+
+#if defined(ED25519_FE51)
+#define ED25519_BACKEND(name) ed25519_fe51_##name
+#define ED25519_BACKEND_ID 2
+
+#define fe_0 fe51_0
+#define fe_1 fe51_1
+#define fe_frombytes fe51_frombytes
+#define fe_tobytes fe51_tobytes
+#define fe_copy fe51_copy
+#define fe_isnegative fe51_isnegative
+#define fe_isnonzero fe51_isnonzero
+#define fe_cmov fe51_cmov
+#define fe_cswap fe51_cswap
+#define fe_neg fe51_neg
+#define fe_add fe51_add
+#define fe_invert fe51_invert
+#define fe_sq fe51_sq
+#define fe_sq2 fe51_sq2
+#define fe_mul fe51_mul
+#define fe_mul121666 fe51_mul121666
+#define fe_pow22523 fe51_pow22523
+#define fe_sub fe51_sub
+
+#define ge_p3_tobytes ge51_p3_tobytes
+#define ge_tobytes ge51_tobytes
+#define ge_frombytes_negate_vartime ge51_frombytes_negate_vartime
+#define ge_add ge51_add
+#define ge_sub ge51_sub
+#define ge_double_scalarmult_vartime ge51_double_scalarmult_vartime
+#define ge_double_scalarmult_precomp_vartime ge51_double_scalarmult_precomp_vartime
+#define ge_madd ge51_madd
+#define ge_msub ge51_msub
+#define ge_scalarmult_base ge51_scalarmult_base
+#define ge_p1p1_to_p2 ge51_p1p1_to_p2
+#define ge_p1p1_to_p3 ge51_p1p1_to_p3
+#define ge_p2_0 ge51_p2_0
+#define ge_p2_dbl ge51_p2_dbl
+#define ge_p3_0 ge51_p3_0
+#define ge_p3_dbl ge51_p3_dbl
+#define ge_p3_to_cached ge51_p3_to_cached
+#define ge_p3_to_p2 ge51_p3_to_p2
+#define ge_p3_precompute_odd_multiples ge51_p3_precompute_odd_multiples
+#else
+#define ED25519_BACKEND(name) ed25519_ref10_##name
+#define ED25519_BACKEND_ID 1
+#endif
+
+#define ed25519_create_keypair ED25519_BACKEND(create_keypair)
+#define ed25519_create_privkey ED25519_BACKEND(create_privkey)
+#define ed25519_privkey_to_pubkey ED25519_BACKEND(privkey_to_pubkey)
+#define ed25519_sign ED25519_BACKEND(sign)
+#define ed25519_verify_pubkey ED25519_BACKEND(verify_pubkey)
+#define ed25519_verify ED25519_BACKEND(verify)
+#define ed25519_verify_batch ED25519_BACKEND(verify_batch)
+#define ed25519_expand_public_key ED25519_BACKEND(expand_public_key)
+#define ed25519_verify_expanded ED25519_BACKEND(verify_expanded)
+#define ed25519_add_scalar ED25519_BACKEND(add_scalar)
+#define ed25519_key_exchange ED25519_BACKEND(key_exchange)
+
+#endif
+
+#endif
@@ -0,0 +1,15 @@
+/*
+    The curve code built a second time on the radix-2^51 field arithmetic of
+    fe51.c. Symbols are renamed by backend.h, see there.
+*/
+#define ED25519_FE51
+#include "fe.h"
+
+#if defined(ED25519_HAVE_FE51)
+#include "ge.c"
+#include "sign.c"
+#include "verify.c"
+#include "keypair.c"
+#include "add_scalar.c"
+#include "key_exchange.c"
+#endif
@@ -0,0 +1,254 @@
+#define ED25519_DISPATCH
+#include "ed25519.h"
+#include "backend.h"
+
+#include <string.h>
+
+
+/*
+    Each field arithmetic backend (see backend.h) provides the complete
+    signature API under its own prefix. The public functions forward to the
+    selected backend; ref10 is used until ed25519_autodetect() is called.
+*/
+
+#define ED25519_DECLARE_BACKEND(prefix) \
+    void prefix##_create_keypair(unsigned char *public_key, unsigned char *private_key, const unsigned char *seed); \
+    void prefix##_create_privkey(unsigned char *private_key, const unsigned char *seed); \
+    void prefix##_privkey_to_pubkey(unsigned char *public_key, const unsigned char *private_key); \
+    void prefix##_sign(unsigned char *signature, const unsigned char *message, size_t message_len, const unsigned char *public_key, const unsigned char *private_key); \
+    int prefix##_verify_pubkey(const unsigned char *public_key); \
+    int prefix##_verify(const unsigned char *signature, const unsigned char *message, size_t message_len, const unsigned char *public_key); \
+    int prefix##_verify_batch(const unsigned char *const *signatures, const unsigned char *const *messages, const size_t *message_lens, const unsigned char *const *public_keys, const unsigned char *const *expanded_keys, size_t num, int *valid); \
+    int prefix##_expand_public_key(unsigned char *expanded, const unsigned char *public_key); \
+    int prefix##_verify_expanded(const unsigned char *signature, const unsigned char *message, size_t message_len, const unsigned char *public_key, const unsigned char *expanded); \
+    void prefix##_add_scalar(unsigned char *public_key, unsigned char *private_key, const unsigned char *scalar); \
+    void prefix##_key_exchange(unsigned char *shared_secret, const unsigned char *public_key, const unsigned char *private_key);
+
+#define ED25519_BACKEND_ENTRY(name, prefix) { \
+    name, \
+    prefix##_create_keypair, \
+    prefix##_create_privkey, \
+    prefix##_privkey_to_pubkey, \
+    prefix##_sign, \
+    prefix##_verify_pubkey, \
+    prefix##_verify, \
+    prefix##_verify_batch, \
+    prefix##_expand_public_key, \
+    prefix##_verify_expanded, \
+    prefix##_add_scalar, \
+    prefix##_key_exchange \
+}
+
+ED25519_DECLARE_BACKEND(ed25519_ref10)
+#if defined(ED25519_HAVE_FE51)
+ED25519_DECLARE_BACKEND(ed25519_fe51)
+#endif
+
+typedef struct {
+    const char *name;
+    void (*create_keypair)(unsigned char *, unsigned char *, const unsigned char *);
+    void (*create_privkey)(unsigned char *, const unsigned char *);
+    void (*privkey_to_pubkey)(unsigned char *, const unsigned char *);
+    void (*sign)(unsigned char *, const unsigned char *, size_t, const unsigned char *, const unsigned char *);
+    int (*verify_pubkey)(const unsigned char *);
+    int (*verify)(const unsigned char *, const unsigned char *, size_t, const unsigned char *);
+    int (*verify_batch)(const unsigned char *const *, const unsigned char *const *, const size_t *, const unsigned char *const *, const unsigned char *const *, size_t, int *);
+    int (*expand_public_key)(unsigned char *, const unsigned char *);
+    int (*verify_expanded)(const unsigned char *, const unsigned char *, size_t, const unsigned char *, const unsigned char *);
+    void (*add_scalar)(unsigned char *, unsigned char *, const unsigned char *);
+    void (*key_exchange)(unsigned char *, const unsigned char *, const unsigned char *);
+} ed25519_backend;
+
+/* In order of preference; the first one is the reference for the self-test. */
+static const ed25519_backend backends[] = {
+    ED25519_BACKEND_ENTRY("ref10", ed25519_ref10),
+#if defined(ED25519_HAVE_FE51)
+    ED25519_BACKEND_ENTRY("fe51", ed25519_fe51),
+#endif
+};
+
+static const ed25519_backend *selected = &backends[0];
+
+
+/*
+    RFC 8032 section 7.1, test 2, plus a cross-check of every operation
+    against ref10 on a second key.
+*/
+static const unsigned char selftest_seed[32] = {
+    0x4c, 0xcd, 0x08, 0x9b, 0x28, 0xff, 0x96, 0xda, 0x9d, 0xb6, 0xc3, 0x46, 0xec, 0x11, 0x4e, 0x0f,
+    0x5b, 0x8a, 0x31, 0x9f, 0x35, 0xab, 0xa6, 0x24, 0xda, 0x8c, 0xf6, 0xed, 0x4f, 0xb8, 0xa6, 0xfb
+};
+
+static const unsigned char selftest_public_key[32] = {
+    0x3d, 0x40, 0x17, 0xc3, 0xe8, 0x43, 0x89, 0x5a, 0x92, 0xb7, 0x0a, 0xa7, 0x4d, 0x1b, 0x7e, 0xbc,
+    0x9c, 0x98, 0x2c, 0xcf, 0x2e, 0xc4, 0x96, 0x8c, 0xc0, 0xcd, 0x55, 0xf1, 0x2a, 0xf4, 0x66, 0x0c
+};
+
+static const unsigned char selftest_message[1] = { 0x72 };
+
+static const unsigned char selftest_signature[64] = {
+    0x92, 0xa0, 0x09, 0xa9, 0xf0, 0xd4, 0xca, 0xb8, 0x72, 0x0e, 0x82, 0x0b, 0x5f, 0x64, 0x25, 0x40,
+    0xa2, 0xb2, 0x7b, 0x54, 0x16, 0x50, 0x3f, 0x8f, 0xb3, 0x76, 0x22, 0x23, 0xeb, 0xdb, 0x69, 0xda,
+    0x08, 0x5a, 0xc1, 0xe4, 0x3e, 0x15, 0x99, 0x6e, 0x45, 0x8f, 0x36, 0x13, 0xd0, 0xf1, 0x1d, 0x8c,
+    0x38, 0x7b, 0x2e, 0xae, 0xb4, 0x30, 0x2a, 0xee, 0xb0, 0x0d, 0x29, 0x16, 0x12, 0xbb, 0x0c, 0x00
+};
+
+static int selftest(const ed25519_backend *b, const ed25519_backend *ref) {
+    unsigned char public_key[32], private_key[64], signature[64];
+    unsigned char ref_public_key[32], ref_private_key[64], ref_signature[64];
+    unsigned char scalar[32], shared[32], ref_shared[32];
+    const unsigned char *sigs[2], *msgs[2], *keys[2];
+    size_t lens[2];
+    int valid[2];
+    unsigned char expanded[ED25519_EXPANDED_PUBLIC_KEY_SIZE];
+    int i;
+
+    b->create_keypair(public_key, private_key, selftest_seed);
+    if (memcmp(public_key, selftest_public_key, 32) != 0) {
+        return 0;
+    }
+
+    b->sign(signature, selftest_message, sizeof(selftest_message), public_key, private_key);
+    if (memcmp(signature, selftest_signature, 64) != 0) {
+        return 0;
+    }
+
+    if (!b->verify(signature, selftest_message, sizeof(selftest_message), public_key) || !b->verify_pubkey(public_key)) {
+        return 0;
+    }
+
+    signature[0] ^= 1;
+    if (b->verify(signature, selftest_message, sizeof(selftest_message), public_key)) {
+        return 0;
+    }
+    signature[0] ^= 1;
+
+    /* A second key derived from the first with ed25519_add_scalar, both from the private and the public side. */
+    for (i = 0; i < 32; ++i) {
+        scalar[i] = (unsigned char) (0xa5 ^ (i * 29));
+    }
+    memcpy(ref_public_key, public_key, 32);
+    memcpy(ref_private_key, private_key, 64);
+    b->add_scalar(public_key, private_key, scalar);
+    ref->add_scalar(ref_public_key, ref_private_key, scalar);
+    if (memcmp(public_key, ref_public_key, 32) != 0 || memcmp(private_key, ref_private_key, 64) != 0) {
+        return 0;
+    }
+    memcpy(ref_public_key, selftest_public_key, 32);
+    b->add_scalar(ref_public_key, NULL, scalar);
+    if (memcmp(public_key, ref_public_key, 32) != 0) {
+        return 0;
+    }
+
+    b->sign(signature, selftest_seed, sizeof(selftest_seed), public_key, private_key);
+    ref->sign(ref_signature, selftest_seed, sizeof(selftest_seed), public_key, private_key);
+    if (memcmp(signature, ref_signature, 64) != 0) {
+        return 0;
+    }
+
+    sigs[0] = signature;
+    msgs[0] = selftest_seed;
+    lens[0] = sizeof(selftest_seed);
+    keys[0] = public_key;
+    sigs[1] = selftest_signature;
+    msgs[1] = selftest_message;
+    lens[1] = sizeof(selftest_message);
+    keys[1] = public_key;
+    if (b->verify_batch(sigs, msgs, lens, keys, NULL, 2, valid) || valid[0] != 1 || valid[1] != 0) {
+        return 0;
+    }
+
+    if (!b->expand_public_key(expanded, public_key) || !b->verify_expanded(signature, selftest_seed, sizeof(selftest_seed), public_key, expanded)) {
+        return 0;
+    }
+    signature[0] ^= 1;
+    if (b->verify_expanded(signature, selftest_seed, sizeof(selftest_seed), public_key, expanded)) {
+        return 0;
+    }
+    signature[0] ^= 1;
+
+    b->key_exchange(shared, selftest_public_key, private_key);
+    ref->key_exchange(ref_shared, selftest_public_key, private_key);
+    if (memcmp(shared, ref_shared, 32) != 0) {
+        return 0;
+    }
+
+    return 1;
+}
+
+const char *ed25519_autodetect(void) {
+    size_t i;
+
+    selected = &backends[0];
+    for (i = sizeof(backends) / sizeof(backends[0]); i-- > 1;) {
+        if (selftest(&backends[i], &backends[0])) {
+            selected = &backends[i];
+            break;
+        }
+    }
+
+    return selected->name;
+}
+
+int ed25519_select_backend(const char *name) {
+    size_t i;
+
+    for (i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+        if (strcmp(backends[i].name, name) == 0) {
+            selected = &backends[i];
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+const char *ed25519_backend_name(void) {
+    return selected->name;
+}
+
+
+void ed25519_create_keypair(unsigned char *public_key, unsigned char *private_key, const unsigned char *seed) {
+    selected->create_keypair(public_key, private_key, seed);
+}
+
+void ed25519_create_privkey(unsigned char *private_key, const unsigned char *seed) {
+    selected->create_privkey(private_key, seed);
+}
+
+void ed25519_privkey_to_pubkey(unsigned char *public_key, const unsigned char *private_key) {
+    selected->privkey_to_pubkey(public_key, private_key);
+}
+
+void ed25519_sign(unsigned char *signature, const unsigned char *message, size_t message_len, const unsigned char *public_key, const unsigned char *private_key) {
+    selected->sign(signature, message, message_len, public_key, private_key);
+}
+
+int ed25519_verify_pubkey(const unsigned char *public_key) {
+    return selected->verify_pubkey(public_key);
+}
+
+int ed25519_verify(const unsigned char *signature, const unsigned char *message, size_t message_len, const unsigned char *public_key) {
+    return selected->verify(signature, message, message_len, public_key);
+}
+
+int ed25519_verify_batch(const unsigned char *const *signatures, const unsigned char *const *messages, const size_t *message_lens,
+                         const unsigned char *const *public_keys, const unsigned char *const *expanded_keys, size_t num, int *valid) {
+    return selected->verify_batch(signatures, messages, message_lens, public_keys, expanded_keys, num, valid);
+}
+
+int ed25519_expand_public_key(unsigned char *expanded, const unsigned char *public_key) {
+    return selected->expand_public_key(expanded, public_key);
+}
+
+int ed25519_verify_expanded(const unsigned char *signature, const unsigned char *message, size_t message_len, const unsigned char *public_key, const unsigned char *expanded) {
+    return selected->verify_expanded(signature, message, message_len, public_key, expanded);
+}
+
+void ed25519_add_scalar(unsigned char *public_key, unsigned char *private_key, const unsigned char *scalar) {
+    selected->add_scalar(public_key, private_key, scalar);
+}
+
+void ed25519_key_exchange(unsigned char *shared_secret, const unsigned char *public_key, const unsigned char *private_key) {
+    selected->key_exchange(shared_secret, public_key, private_key);
+}
@@ -34,9 +34,21 @@ void ED25519_DECLSPEC ed25519_privkey_to_pubkey(unsigned char *public_key, const
 void ED25519_DECLSPEC ed25519_sign(unsigned char *signature, const unsigned char *message, size_t message_len, const unsigned char *public_key, const unsigned char *private_key);
 int ED25519_DECLSPEC ed25519_verify_pubkey(const unsigned char *public_key);
 int ED25519_DECLSPEC ed25519_verify(const unsigned char *signature, const unsigned char *message, size_t message_len, const unsigned char *public_key);
+int ED25519_DECLSPEC ed25519_verify_batch(const unsigned char *const *signatures, const unsigned char *const *messages, const size_t *message_lens, const unsigned char *const *public_keys, const unsigned char *const *expanded_keys, size_t num, int *valid);
+
+/* A public key decompressed and prepared for repeated verification. Only valid with the backend that was selected when it was made; other backends ignore it. */
+#define ED25519_EXPANDED_PUBLIC_KEY_SIZE 1288
+int ED25519_DECLSPEC ed25519_expand_public_key(unsigned char *expanded, const unsigned char *public_key);
+int ED25519_DECLSPEC ed25519_verify_expanded(const unsigned char *signature, const unsigned char *message, size_t message_len, const unsigned char *public_key, const unsigned char *expanded);
 void ED25519_DECLSPEC ed25519_add_scalar(unsigned char *public_key, unsigned char *private_key, const unsigned char *scalar);
 void ED25519_DECLSPEC ed25519_key_exchange(unsigned char *shared_secret, const unsigned char *public_key, const unsigned char *private_key);
 
+/* Selects the fastest field arithmetic backend that passes its self-test and returns its name. Not thread safe. */
+const char ED25519_DECLSPEC *ed25519_autodetect(void);
+/* Forces a backend by name ("ref10", "fe51"), returns 0 if it is not compiled in. For tests and benchmarks. */
+int ED25519_DECLSPEC ed25519_select_backend(const char *name);
+const char ED25519_DECLSPEC *ed25519_backend_name(void);
+
 
 #ifdef __cplusplus
 }
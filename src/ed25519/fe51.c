@@ -0,0 +1,565 @@
+#define ED25519_FE51
+#include "fixedint.h"
+#include "fe.h"
+
+#if defined(ED25519_HAVE_FE51)
+
+/*
+    Field arithmetic in radix 2^51, see fe.h. Limbs are kept below 2^52 between
+    operations: every function returning an fe leaves it carried, so add and
+    sub results can be fed to mul, sq or another add/sub without any further
+    bookkeeping by the caller (ref10 needs none either, so ge.c is shared).
+*/
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+static const uint64_t mask51 = 0x7ffffffffffffULL;
+
+
+/*
+    helper functions
+*/
+static uint64_t load_8(const unsigned char *in) {
+    uint64_t result;
+
+    result = (uint64_t) in[0];
+    result |= ((uint64_t) in[1]) << 8;
+    result |= ((uint64_t) in[2]) << 16;
+    result |= ((uint64_t) in[3]) << 24;
+    result |= ((uint64_t) in[4]) << 32;
+    result |= ((uint64_t) in[5]) << 40;
+    result |= ((uint64_t) in[6]) << 48;
+    result |= ((uint64_t) in[7]) << 56;
+
+    return result;
+}
+
+static void store_8(unsigned char *out, uint64_t in) {
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+        out[i] = (unsigned char) (in >> (8 * i));
+    }
+}
+
+static void fe_carry(fe h, uint64_t h0, uint64_t h1, uint64_t h2, uint64_t h3, uint64_t h4) {
+    h1 += h0 >> 51;
+    h0 &= mask51;
+    h2 += h1 >> 51;
+    h1 &= mask51;
+    h3 += h2 >> 51;
+    h2 &= mask51;
+    h4 += h3 >> 51;
+    h3 &= mask51;
+    h0 += (h4 >> 51) * 19;
+    h4 &= mask51;
+
+    h[0] = h0;
+    h[1] = h1;
+    h[2] = h2;
+    h[3] = h3;
+    h[4] = h4;
+}
+
+/* Reduces 128-bit column sums of a product to a carried fe. */
+static void fe_carry_wide(fe h, uint128_t t0, uint128_t t1, uint128_t t2, uint128_t t3, uint128_t t4) {
+    uint64_t h0, h1, h2, h3, h4;
+
+    h0 = (uint64_t) t0 & mask51;
+    t1 += (uint64_t) (t0 >> 51);
+    h1 = (uint64_t) t1 & mask51;
+    t2 += (uint64_t) (t1 >> 51);
+    h2 = (uint64_t) t2 & mask51;
+    t3 += (uint64_t) (t2 >> 51);
+    h3 = (uint64_t) t3 & mask51;
+    t4 += (uint64_t) (t3 >> 51);
+    h4 = (uint64_t) t4 & mask51;
+    h0 += (uint64_t) (t4 >> 51) * 19;
+    h1 += h0 >> 51;
+    h0 &= mask51;
+
+    h[0] = h0;
+    h[1] = h1;
+    h[2] = h2;
+    h[3] = h3;
+    h[4] = h4;
+}
+
+
+
+/*
+    h = 0
+*/
+void fe_0(fe h) {
+    h[0] = 0;
+    h[1] = 0;
+    h[2] = 0;
+    h[3] = 0;
+    h[4] = 0;
+}
+
+
+
+/*
+    h = 1
+*/
+void fe_1(fe h) {
+    h[0] = 1;
+    h[1] = 0;
+    h[2] = 0;
+    h[3] = 0;
+    h[4] = 0;
+}
+
+
+
+/*
+    h = f + g
+    Can overlap h with f or g.
+*/
+void fe_add(fe h, const fe f, const fe g) {
+    fe_carry(h, f[0] + g[0], f[1] + g[1], f[2] + g[2], f[3] + g[3], f[4] + g[4]);
+}
+
+
+
+/*
+    Replace (f,g) with (g,g) if b == 1;
+    replace (f,g) with (f,g) if b == 0.
+
+    Preconditions: b in {0,1}.
+*/
+void fe_cmov(fe f, const fe g, unsigned int b) {
+    uint64_t mask = (uint64_t) 0 - (uint64_t) b;
+
+    f[0] ^= mask & (f[0] ^ g[0]);
+    f[1] ^= mask & (f[1] ^ g[1]);
+    f[2] ^= mask & (f[2] ^ g[2]);
+    f[3] ^= mask & (f[3] ^ g[3]);
+    f[4] ^= mask & (f[4] ^ g[4]);
+}
+
+
+
+/*
+    Replace (f,g) with (g,f) if b == 1;
+    replace (f,g) with (f,g) if b == 0.
+
+    Preconditions: b in {0,1}.
+*/
+void fe_cswap(fe f, fe g, unsigned int b) {
+    uint64_t mask = (uint64_t) 0 - (uint64_t) b;
+    uint64_t x;
+    int i;
+
+    for (i = 0; i < 5; ++i) {
+        x = mask & (f[i] ^ g[i]);
+        f[i] ^= x;
+        g[i] ^= x;
+    }
+}
+
+
+
+/*
+    h = f
+*/
+void fe_copy(fe h, const fe f) {
+    h[0] = f[0];
+    h[1] = f[1];
+    h[2] = f[2];
+    h[3] = f[3];
+    h[4] = f[4];
+}
+
+
+
+/*
+    Ignores top bit of s.
+*/
+void fe_frombytes(fe h, const unsigned char *s) {
+    h[0] = load_8(s) & mask51;
+    h[1] = (load_8(s + 6) >> 3) & mask51;
+    h[2] = (load_8(s + 12) >> 6) & mask51;
+    h[3] = (load_8(s + 19) >> 1) & mask51;
+    h[4] = (load_8(s + 24) >> 12) & mask51;
+}
+
+
+
+/*
+    Writes the unique representative of h in [0, p) as 32 little-endian bytes.
+*/
+void fe_tobytes(unsigned char *s, const fe h) {
+    uint64_t t[5];
+
+    /* now below 2^255 + 19*small, twice is enough to be below 2^255 */
+    fe_carry(t, h[0], h[1], h[2], h[3], h[4]);
+    fe_carry(t, t[0], t[1], t[2], t[3], t[4]);
+
+    /*
+        t is now in [0, 2^255). Adding 19 carries out of bit 255 exactly when
+        t >= p; that carry is folded back in, then the 19 is taken off again by
+        adding 2^255 - 19 and dropping bit 255.
+    */
+    fe_carry(t, t[0] + 19, t[1], t[2], t[3], t[4]);
+
+    t[0] += 0x8000000000000ULL - 19;
+    t[1] += 0x8000000000000ULL - 1;
+    t[2] += 0x8000000000000ULL - 1;
+    t[3] += 0x8000000000000ULL - 1;
+    t[4] += 0x8000000000000ULL - 1;
+
+    t[1] += t[0] >> 51;
+    t[0] &= mask51;
+    t[2] += t[1] >> 51;
+    t[1] &= mask51;
+    t[3] += t[2] >> 51;
+    t[2] &= mask51;
+    t[4] += t[3] >> 51;
+    t[3] &= mask51;
+    t[4] &= mask51;
+
+    store_8(s, t[0] | (t[1] << 51));
+    store_8(s + 8, (t[1] >> 13) | (t[2] << 38));
+    store_8(s + 16, (t[2] >> 26) | (t[3] << 25));
+    store_8(s + 24, (t[3] >> 39) | (t[4] << 12));
+}
+
+
+
+/*
+    return 1 if f is in {1,3,5,...,q-2}
+    return 0 if f is in {0,2,4,...,q-1}
+*/
+int fe_isnegative(const fe f) {
+    unsigned char s[32];
+
+    fe_tobytes(s, f);
+
+    return s[0] & 1;
+}
+
+
+
+/*
+    return 1 if f == 0
+    return 0 if f != 0
+*/
+int fe_isnonzero(const fe f) {
+    unsigned char s[32];
+    unsigned char r;
+    int i;
+
+    fe_tobytes(s, f);
+
+    r = 0;
+    for (i = 0; i < 32; ++i) {
+        r |= s[i];
+    }
+
+    return r != 0;
+}
+
+
+
+/*
+    h = f * g
+    Can overlap h with f or g.
+*/
+void fe_mul(fe h, const fe f, const fe g) {
+    uint64_t f0 = f[0];
+    uint64_t f1 = f[1];
+    uint64_t f2 = f[2];
+    uint64_t f3 = f[3];
+    uint64_t f4 = f[4];
+    uint64_t g0 = g[0];
+    uint64_t g1 = g[1];
+    uint64_t g2 = g[2];
+    uint64_t g3 = g[3];
+    uint64_t g4 = g[4];
+    uint64_t g1_19 = 19 * g1;
+    uint64_t g2_19 = 19 * g2;
+    uint64_t g3_19 = 19 * g3;
+    uint64_t g4_19 = 19 * g4;
+    uint128_t t0, t1, t2, t3, t4;
+
+    t0 = (uint128_t) f0 * g0 + (uint128_t) f1 * g4_19 + (uint128_t) f2 * g3_19 + (uint128_t) f3 * g2_19 + (uint128_t) f4 * g1_19;
+    t1 = (uint128_t) f0 * g1 + (uint128_t) f1 * g0 + (uint128_t) f2 * g4_19 + (uint128_t) f3 * g3_19 + (uint128_t) f4 * g2_19;
+    t2 = (uint128_t) f0 * g2 + (uint128_t) f1 * g1 + (uint128_t) f2 * g0 + (uint128_t) f3 * g4_19 + (uint128_t) f4 * g3_19;
+    t3 = (uint128_t) f0 * g3 + (uint128_t) f1 * g2 + (uint128_t) f2 * g1 + (uint128_t) f3 * g0 + (uint128_t) f4 * g4_19;
+    t4 = (uint128_t) f0 * g4 + (uint128_t) f1 * g3 + (uint128_t) f2 * g2 + (uint128_t) f3 * g1 + (uint128_t) f4 * g0;
+
+    fe_carry_wide(h, t0, t1, t2, t3, t4);
+}
+
+
+
+/*
+    h = f * 121666
+    Can overlap h with f.
+*/
+void fe_mul121666(fe h, fe f) {
+    fe_carry_wide(h,
+                  (uint128_t) f[0] * 121666,
+                  (uint128_t) f[1] * 121666,
+                  (uint128_t) f[2] * 121666,
+                  (uint128_t) f[3] * 121666,
+                  (uint128_t) f[4] * 121666);
+}
+
+
+
+/*
+    h = -f
+*/
+void fe_neg(fe h, const fe f) {
+    fe zero;
+
+    fe_0(zero);
+    fe_sub(h, zero, f);
+}
+
+
+
+/*
+    h = f - g
+    Can overlap h with f or g.
+
+    4p is added first so no limb goes negative for g below 2^52.
+*/
+void fe_sub(fe h, const fe f, const fe g) {
+    fe_carry(h,
+             (f[0] + 0x1fffffffffffb4ULL) - g[0],
+             (f[1] + 0x1ffffffffffffcULL) - g[1],
+             (f[2] + 0x1ffffffffffffcULL) - g[2],
+             (f[3] + 0x1ffffffffffffcULL) - g[3],
+             (f[4] + 0x1ffffffffffffcULL) - g[4]);
+}
+
+
+
+/* Column sums of f * f, before reduction. */
+static void fe_sq_wide(uint128_t t[5], const fe f) {
+    uint64_t f0 = f[0];
+    uint64_t f1 = f[1];
+    uint64_t f2 = f[2];
+    uint64_t f3 = f[3];
+    uint64_t f4 = f[4];
+    uint64_t f0_2 = 2 * f0;
+    uint64_t f1_2 = 2 * f1;
+    uint64_t f3_19 = 19 * f3;
+    uint64_t f4_19 = 19 * f4;
+
+    t[0] = (uint128_t) f0 * f0 + (uint128_t) f1_2 * f4_19 + (uint128_t) (2 * f2) * f3_19;
+    t[1] = (uint128_t) f0_2 * f1 + (uint128_t) (2 * f2) * f4_19 + (uint128_t) f3 * f3_19;
+    t[2] = (uint128_t) f0_2 * f2 + (uint128_t) f1 * f1 + (uint128_t) (2 * f3) * f4_19;
+    t[3] = (uint128_t) f0_2 * f3 + (uint128_t) f1_2 * f2 + (uint128_t) f4 * f4_19;
+    t[4] = (uint128_t) f0_2 * f4 + (uint128_t) f1_2 * f3 + (uint128_t) f2 * f2;
+}
+
+
+
+/*
+    h = f * f
+    Can overlap h with f.
+*/
+void fe_sq(fe h, const fe f) {
+    uint128_t t[5];
+
+    fe_sq_wide(t, f);
+    fe_carry_wide(h, t[0], t[1], t[2], t[3], t[4]);
+}
+
+
+
+/*
+    h = 2 * f * f
+    Can overlap h with f.
+*/
+void fe_sq2(fe h, const fe f) {
+    uint128_t t[5];
+
+    fe_sq_wide(t, f);
+    fe_carry_wide(h, t[0] << 1, t[1] << 1, t[2] << 1, t[3] << 1, t[4] << 1);
+}
+
+
+
+/*
+    Same addition chains as fe.c.
+*/
+void fe_invert(fe out, const fe z) {
+    fe t0;
+    fe t1;
+    fe t2;
+    fe t3;
+    int i;
+
+    fe_sq(t0, z);
+
+    for (i = 1; i < 1; ++i) {
+        fe_sq(t0, t0);
+    }
+
+    fe_sq(t1, t0);
+
+    for (i = 1; i < 2; ++i) {
+        fe_sq(t1, t1);
+    }
+
+    fe_mul(t1, z, t1);
+    fe_mul(t0, t0, t1);
+    fe_sq(t2, t0);
+
+    for (i = 1; i < 1; ++i) {
+        fe_sq(t2, t2);
+    }
+
+    fe_mul(t1, t1, t2);
+    fe_sq(t2, t1);
+
+    for (i = 1; i < 5; ++i) {
+        fe_sq(t2, t2);
+    }
+
+    fe_mul(t1, t2, t1);
+    fe_sq(t2, t1);
+
+    for (i = 1; i < 10; ++i) {
+        fe_sq(t2, t2);
+    }
+
+    fe_mul(t2, t2, t1);
+    fe_sq(t3, t2);
+
+    for (i = 1; i < 20; ++i) {
+        fe_sq(t3, t3);
+    }
+
+    fe_mul(t2, t3, t2);
+    fe_sq(t2, t2);
+
+    for (i = 1; i < 10; ++i) {
+        fe_sq(t2, t2);
+    }
+
+    fe_mul(t1, t2, t1);
+    fe_sq(t2, t1);
+
+    for (i = 1; i < 50; ++i) {
+        fe_sq(t2, t2);
+    }
+
+    fe_mul(t2, t2, t1);
+    fe_sq(t3, t2);
+
+    for (i = 1; i < 100; ++i) {
+        fe_sq(t3, t3);
+    }
+
+    fe_mul(t2, t3, t2);
+    fe_sq(t2, t2);
+
+    for (i = 1; i < 50; ++i) {
+        fe_sq(t2, t2);
+    }
+
+    fe_mul(t1, t2, t1);
+    fe_sq(t1, t1);
+
+    for (i = 1; i < 5; ++i) {
+        fe_sq(t1, t1);
+    }
+
+    fe_mul(out, t1, t0);
+}
+
+
+
+void fe_pow22523(fe out, const fe z) {
+    fe t0;
+    fe t1;
+    fe t2;
+    int i;
+    fe_sq(t0, z);
+
+    for (i = 1; i < 1; ++i) {
+        fe_sq(t0, t0);
+    }
+
+    fe_sq(t1, t0);
+
+    for (i = 1; i < 2; ++i) {
+        fe_sq(t1, t1);
+    }
+
+    fe_mul(t1, z, t1);
+    fe_mul(t0, t0, t1);
+    fe_sq(t0, t0);
+
+    for (i = 1; i < 1; ++i) {
+        fe_sq(t0, t0);
+    }
+
+    fe_mul(t0, t1, t0);
+    fe_sq(t1, t0);
+
+    for (i = 1; i < 5; ++i) {
+        fe_sq(t1, t1);
+    }
+
+    fe_mul(t0, t1, t0);
+    fe_sq(t1, t0);
+
+    for (i = 1; i < 10; ++i) {
+        fe_sq(t1, t1);
+    }
+
+    fe_mul(t1, t1, t0);
+    fe_sq(t2, t1);
+
+    for (i = 1; i < 20; ++i) {
+        fe_sq(t2, t2);
+    }
+
+    fe_mul(t1, t2, t1);
+    fe_sq(t1, t1);
+
+    for (i = 1; i < 10; ++i) {
+        fe_sq(t1, t1);
+    }
+
+    fe_mul(t0, t1, t0);
+    fe_sq(t1, t0);
+
+    for (i = 1; i < 50; ++i) {
+        fe_sq(t1, t1);
+    }
+
+    fe_mul(t1, t1, t0);
+    fe_sq(t2, t1);
+
+    for (i = 1; i < 100; ++i) {
+        fe_sq(t2, t2);
+    }
+
+    fe_mul(t1, t2, t1);
+    fe_sq(t1, t1);
+
+    for (i = 1; i < 50; ++i) {
+        fe_sq(t1, t1);
+    }
+
+    fe_mul(t0, t1, t0);
+    fe_sq(t0, t0);
+
+    for (i = 1; i < 2; ++i) {
+        fe_sq(t0, t0);
+    }
+
+    fe_mul(out, t0, z);
+    return;
+}
+
+#endif
@@ -1,5 +1,9 @@
 #include "ge.h"
+#if defined(ED25519_FE51)
+#include "precomp_data_51.h"
+#else
 #include "precomp_data.h"
+#endif
 
 
 /*
@@ -65,15 +69,19 @@ B is the Ed25519 base point (x,4/5) with x positive.
 */
 
 void ge_double_scalarmult_vartime(ge_p2 *r, const unsigned char *a, const ge_p3 *A, const unsigned char *b) {
-    signed char aslide[256];
-    signed char bslide[256];
-    ge_cached Ai[8]; /* A,3A,5A,7A,9A,11A,13A,15A */
+    ge_cached Ai[8];
+    ge_p3_precompute_odd_multiples(Ai, A);
+    ge_double_scalarmult_precomp_vartime(r, a, Ai, b);
+}
+
+/*
+Ai = A,3A,5A,7A,9A,11A,13A,15A
+*/
+
+void ge_p3_precompute_odd_multiples(ge_cached *Ai, const ge_p3 *A) {
     ge_p1p1 t;
     ge_p3 u;
     ge_p3 A2;
-    int i;
-    slide(aslide, a);
-    slide(bslide, b);
     ge_p3_to_cached(&Ai[0], A);
     ge_p3_dbl(&t, A);
     ge_p1p1_to_p3(&A2, &t);
@@ -98,6 +106,20 @@ void ge_double_scalarmult_vartime(ge_p2 *r, const unsigned char *a, const ge_p3
     ge_add(&t, &A2, &Ai[6]);
     ge_p1p1_to_p3(&u, &t);
     ge_p3_to_cached(&Ai[7], &u);
+}
+
+/*
+r = a * A + b * B as above, with Ai from ge_p3_precompute_odd_multiples(Ai, A)
+*/
+
+void ge_double_scalarmult_precomp_vartime(ge_p2 *r, const unsigned char *a, const ge_cached *Ai, const unsigned char *b) {
+    signed char aslide[256];
+    signed char bslide[256];
+    ge_p1p1 t;
+    ge_p3 u;
+    int i;
+    slide(aslide, a);
+    slide(bslide, b);
     ge_p2_0(r);
 
     for (i = 255; i >= 0; --i) {
@@ -130,13 +152,25 @@ void ge_double_scalarmult_vartime(ge_p2 *r, const unsigned char *a, const ge_p3
 }
 
 
+#if defined(ED25519_FE51)
+static const fe d = {
+    0x34dca135978a3ULL, 0x1a8283b156ebdULL, 0x5e7a26001c029ULL, 0x739c663a03cbbULL, 0x52036cee2b6ffULL
+};
+#else
 static const fe d = {
     -10913610, 13857413, -15372611, 6949391, 114729, -8787816, -6275908, -3247719, -18696448, -12055116
 };
+#endif
 
+#if defined(ED25519_FE51)
+static const fe sqrtm1 = {
+    0x61b274a0ea0b0ULL, 0x0d5a5fc8f189dULL, 0x7ef5e9cbd0c60ULL, 0x78595a6804c9eULL, 0x2b8324804fc1dULL
+};
+#else
 static const fe sqrtm1 = {
     -32595792, -7943725, 9377950, 3500415, 12389472, -272473, -25146209, -2005654, 326686, 11406482
 };
+#endif
 
 int ge_frombytes_negate_vartime(ge_p3 *h, const unsigned char *s) {
     fe u;
@@ -295,9 +329,15 @@ void ge_p3_dbl(ge_p1p1 *r, const ge_p3 *p) {
 r = p
 */
 
+#if defined(ED25519_FE51)
+static const fe d2 = {
+    0x69b9426b2f159ULL, 0x35050762add7aULL, 0x3cf44c0038052ULL, 0x6738cc7407977ULL, 0x2406d9dc56dffULL
+};
+#else
 static const fe d2 = {
     -21827239, -5839606, -30745221, 13898782, 229458, 15978800, -12551817, -6495438, 29715968, 9444199
 };
+#endif
 
 void ge_p3_to_cached(ge_cached *r, const ge_p3 *p) {
     fe_add(r->YplusX, p->Y, p->X);
@@ -353,7 +393,7 @@ static void cmov(ge_precomp *t, const ge_precomp *u, unsigned char b) {
 }
 
 
-static void select(ge_precomp *t, int pos, signed char b) {
+static void table_select(ge_precomp *t, int pos, signed char b) {
     ge_precomp minust;
     unsigned char bnegative = negative(b);
     unsigned char babs = b - (((-bnegative) & b) << 1);
@@ -412,7 +452,7 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
     ge_p3_0(h);
 
     for (i = 1; i < 64; i += 2) {
-        select(&t, i / 2, e[i]);
+        table_select(&t, i / 2, e[i]);
         ge_madd(&r, h, &t);
         ge_p1p1_to_p3(h, &r);
     }
@@ -427,7 +467,7 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
     ge_p1p1_to_p3(h, &r);
 
     for (i = 0; i < 64; i += 2) {
-        select(&t, i / 2, e[i]);
+        table_select(&t, i / 2, e[i]);
         ge_madd(&r, h, &t);
         ge_p1p1_to_p3(h, &r);
     }
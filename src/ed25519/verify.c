@@ -3,6 +3,9 @@
 #include "ge.h"
 #include "sc.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 static int consttime_equal(const unsigned char *x, const unsigned char *y) {
     unsigned char r = 0;
 
@@ -83,3 +86,198 @@ int ed25519_verify(const unsigned char *signature, const unsigned char *message,
 
     return 1;
 }
+
+/*
+    An expanded public key is a one byte backend tag, padding, and the odd
+    multiples of -A that ge_double_scalarmult_vartime would otherwise compute
+    on every call. The layout of the table depends on the field backend, so
+    a key expanded by another backend is ignored rather than misread.
+*/
+#define EXPANDED_TABLE_OFFSET 8
+
+typedef char expanded_public_key_size_check[EXPANDED_TABLE_OFFSET + 8 * sizeof(ge_cached) <= ED25519_EXPANDED_PUBLIC_KEY_SIZE ? 1 : -1];
+
+static int expanded_table(ge_cached *Ai, const unsigned char *expanded) {
+    if (expanded == NULL || expanded[0] != ED25519_BACKEND_ID) {
+        return 0;
+    }
+    memcpy(Ai, expanded + EXPANDED_TABLE_OFFSET, 8 * sizeof(ge_cached));
+    return 1;
+}
+
+int ed25519_expand_public_key(unsigned char *expanded, const unsigned char *public_key) {
+    ge_p3 A;
+    ge_cached Ai[8];
+
+    memset(expanded, 0, ED25519_EXPANDED_PUBLIC_KEY_SIZE);
+    if (ge_frombytes_negate_vartime(&A, public_key) != 0) {
+        return 0;
+    }
+    ge_p3_precompute_odd_multiples(Ai, &A);
+    expanded[0] = ED25519_BACKEND_ID;
+    memcpy(expanded + EXPANDED_TABLE_OFFSET, Ai, sizeof(Ai));
+    return 1;
+}
+
+int ed25519_verify_expanded(const unsigned char *signature, const unsigned char *message, size_t message_len, const unsigned char *public_key, const unsigned char *expanded) {
+    unsigned char h[64];
+    unsigned char checker[32];
+    sha512_context hash;
+    ge_cached Ai[8];
+    ge_p2 R;
+
+    if (!expanded_table(Ai, expanded)) {
+        return ed25519_verify(signature, message, message_len, public_key);
+    }
+
+    if (signature[63] & 224) {
+        return 0;
+    }
+
+    sha512_init(&hash);
+    sha512_update(&hash, signature, 32);
+    sha512_update(&hash, public_key, 32);
+    sha512_update(&hash, message, message_len);
+    sha512_final(&hash, h);
+
+    sc_reduce(h);
+    ge_double_scalarmult_precomp_vartime(&R, h, Ai, signature + 32);
+    ge_tobytes(checker, &R);
+
+    return consttime_equal(checker, signature);
+}
+
+/*
+    Verify num signatures at once. valid[i] receives exactly what ed25519_verify
+    would return for input i; the function returns 1 if every signature is valid.
+
+    No random linear combination is used: that check is only sound for the
+    cofactored verification equation and could accept signatures that
+    ed25519_verify rejects. Instead the work that can be shared is shared:
+    public keys repeated within the batch are decompressed once (or not at all
+    if expanded_keys[i] holds an ed25519_expand_public_key result; either the
+    array or any of its entries may be NULL), and the final
+    projective-to-affine conversion of all R' = sB - hA uses a single field
+    inversion (Montgomery's trick) instead of one per signature.
+*/
+int ed25519_verify_batch(const unsigned char *const *signatures, const unsigned char *const *messages, const size_t *message_lens,
+                         const unsigned char *const *public_keys, const unsigned char *const *expanded_keys, size_t num, int *valid) {
+    unsigned char h[64];
+    unsigned char checker[32];
+    sha512_context hash;
+    ge_p3 A;
+    ge_cached (*Ai)[8];
+    ge_p2 *R;
+    fe *acc;
+    size_t *key_index;
+    int *key_ok;
+    fe inv, zinv, x, y;
+    size_t i, j;
+    int all_valid = 1;
+
+    if (num == 0) {
+        return 1;
+    }
+
+    Ai = (ge_cached (*)[8]) malloc(num * sizeof(*Ai));
+    R = (ge_p2 *) malloc(num * sizeof(ge_p2));
+    acc = (fe *) malloc(num * sizeof(fe));
+    key_index = (size_t *) malloc(num * sizeof(size_t));
+    key_ok = (int *) malloc(num * sizeof(int));
+
+    if (!Ai || !R || !acc || !key_index || !key_ok) {
+        free(Ai);
+        free(R);
+        free(acc);
+        free(key_index);
+        free(key_ok);
+        for (i = 0; i < num; ++i) {
+            valid[i] = ed25519_verify_expanded(signatures[i], messages[i], message_lens[i], public_keys[i], expanded_keys ? expanded_keys[i] : NULL);
+            all_valid &= valid[i];
+        }
+        return all_valid;
+    }
+
+    for (i = 0; i < num; ++i) {
+        valid[i] = 0;
+
+        /* Reuse the decompression of an earlier identical key. */
+        key_index[i] = i;
+        for (j = 0; j < i; ++j) {
+            if (key_index[j] == j && memcmp(public_keys[i], public_keys[j], 32) == 0) {
+                key_index[i] = j;
+                break;
+            }
+        }
+        if (key_index[i] == i) {
+            key_ok[i] = expanded_table(Ai[i], expanded_keys ? expanded_keys[i] : NULL);
+            if (!key_ok[i] && ge_frombytes_negate_vartime(&A, public_keys[i]) == 0) {
+                ge_p3_precompute_odd_multiples(Ai[i], &A);
+                key_ok[i] = 1;
+            }
+        }
+
+        if ((signatures[i][63] & 224) || !key_ok[key_index[i]]) {
+            continue;
+        }
+
+        sha512_init(&hash);
+        sha512_update(&hash, signatures[i], 32);
+        sha512_update(&hash, public_keys[i], 32);
+        sha512_update(&hash, messages[i], message_lens[i]);
+        sha512_final(&hash, h);
+
+        sc_reduce(h);
+        ge_double_scalarmult_precomp_vartime(&R[i], h, Ai[key_index[i]], signatures[i] + 32);
+        valid[i] = 1;
+    }
+
+    /* Prefix products of the Z coordinates of all computed points. */
+    fe_1(inv);
+    for (i = 0; i < num; ++i) {
+        if (valid[i] == 1) {
+            fe_mul(inv, inv, R[i].Z);
+        }
+        fe_copy(acc[i], inv);
+    }
+
+    if (fe_isnonzero(inv)) {
+        fe_invert(inv, inv);
+        for (i = num; i-- > 0;) {
+            if (valid[i] != 1) {
+                continue;
+            }
+            /* inv is now 1 / (Z_0 * ... * Z_i) over the computed points. */
+            if (i > 0) {
+                fe_mul(zinv, inv, acc[i - 1]);
+            } else {
+                fe_copy(zinv, inv);
+            }
+            fe_mul(inv, inv, R[i].Z);
+            fe_mul(x, R[i].X, zinv);
+            fe_mul(y, R[i].Y, zinv);
+            fe_tobytes(checker, y);
+            checker[31] ^= fe_isnegative(x) << 7;
+            valid[i] = consttime_equal(checker, signatures[i]);
+        }
+    } else {
+        for (i = 0; i < num; ++i) {
+            if (valid[i] != 1) {
+                continue;
+            }
+            ge_tobytes(checker, &R[i]);
+            valid[i] = consttime_equal(checker, signatures[i]);
+        }
+    }
+
+    for (i = 0; i < num; ++i) {
+        all_valid &= valid[i];
+    }
+
+    free(Ai);
+    free(R);
+    free(acc);
+    free(key_index);
+    free(key_ok);
+    return all_valid;
+}
@@ -0,0 +1,366 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATHASHMAP_H
+#define BITCOIN_FLATHASHMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Hash map using open addressing over a flat array of slots, with its
+ *  entries kept in a pool of fixed-size chunks.
+ *
+ *  A slot is 8 bytes: 32 bits of the key's hash, and the index of the entry
+ *  in the pool. Lookups probe linearly and only look at an entry when the
+ *  hash bits match, and entries do not need a heap allocation each.
+ *
+ *  Entries never move, so references to them stay valid until they are
+ *  erased, as with std::unordered_map. Erasing leaves a tombstone instead of
+ *  shifting later slots, so it does not invalidate iterators to other
+ *  entries either. Inserting may invalidate iterators (not references).
+ *
+ *  Only the parts of the std::unordered_map interface that CCoinsMap needs
+ *  are provided.
+ */
+template <typename K, typename T, typename Hash = std::hash<K>, typename Equal = std::equal_to<K>>
+class flathashmap
+{
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<const K, T> value_type;
+    typedef size_t size_type;
+
+private:
+    //! log2 of the number of entries per pool chunk
+    static const uint32_t CHUNK_SHIFT = 7;
+    static const uint32_t CHUNK_ENTRIES = uint32_t(1) << CHUNK_SHIFT;
+
+    static const uint32_t EMPTY = 0;
+    static const uint32_t DELETED = 1;
+    static const uint32_t NO_ENTRY = ~uint32_t(0);
+
+    struct slot {
+        uint32_t tag;   //!< EMPTY, DELETED, or hash bits (at least 2)
+        uint32_t entry; //!< index into the pool
+    };
+
+    typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type entry_storage;
+    static_assert(sizeof(entry_storage) >= sizeof(uint32_t), "free list link must fit in an entry");
+
+    Hash m_hash;
+    Equal m_equal;
+    std::unique_ptr<slot[]> m_slots;
+    size_t m_capacity = 0; //!< number of slots, 0 or a power of two
+    size_t m_size = 0;
+    size_t m_deleted = 0;  //!< number of tombstones
+    std::vector<std::unique_ptr<entry_storage[]>> m_chunks;
+    uint32_t m_next_entry = 0; //!< entries at or past this index have never been used
+    uint32_t m_free_entry = NO_ENTRY; //!< head of the list of erased entries
+
+    static uint32_t make_tag(size_t hash)
+    {
+        const uint64_t h = hash;
+        const uint32_t tag = uint32_t(h >> 32) ^ uint32_t(h);
+        return tag < 2 ? tag + 2 : tag;
+    }
+
+    void* raw(uint32_t entry) const
+    {
+        return &m_chunks[entry >> CHUNK_SHIFT][entry & (CHUNK_ENTRIES - 1)];
+    }
+
+    value_type* get(uint32_t entry) const
+    {
+        return static_cast<value_type*>(raw(entry));
+    }
+
+    bool occupied(size_t pos) const
+    {
+        return m_slots[pos].tag > DELETED;
+    }
+
+    size_t next_occupied(size_t pos) const
+    {
+        while (pos < m_capacity && !occupied(pos)) ++pos;
+        return pos;
+    }
+
+    uint32_t alloc_entry()
+    {
+        if (m_free_entry != NO_ENTRY) {
+            const uint32_t entry = m_free_entry;
+            m_free_entry = *static_cast<uint32_t*>(raw(entry));
+            return entry;
+        }
+        if (m_next_entry == m_chunks.size() * CHUNK_ENTRIES) {
+            if (m_next_entry > NO_ENTRY - CHUNK_ENTRIES) throw std::length_error("flathashmap too large");
+            m_chunks.emplace_back(new entry_storage[CHUNK_ENTRIES]);
+        }
+        return m_next_entry++;
+    }
+
+    void free_entry(uint32_t entry)
+    {
+        new (raw(entry)) uint32_t(m_free_entry);
+        m_free_entry = entry;
+    }
+
+    /** Find key, or else the slot it would be inserted at. Needs a free slot. */
+    bool probe(const K& key, uint32_t tag, size_t& pos) const
+    {
+        const size_t mask = m_capacity - 1;
+        size_t insert_pos = m_capacity;
+        for (size_t i = tag & mask; ; i = (i + 1) & mask) {
+            const slot& s = m_slots[i];
+            if (s.tag == EMPTY) {
+                pos = insert_pos == m_capacity ? i : insert_pos;
+                return false;
+            }
+            if (s.tag == DELETED) {
+                if (insert_pos == m_capacity) insert_pos = i;
+            } else if (s.tag == tag && m_equal(get(s.entry)->first, key)) {
+                pos = i;
+                return true;
+            }
+        }
+    }
+
+    /** Make room for one more entry, keeping the load (tombstones included) under 7/8. */
+    void reserve_one()
+    {
+        if ((m_size + m_deleted + 1) * 8 <= m_capacity * 7) return;
+        size_t capacity = m_capacity < 16 ? 16 : m_capacity;
+        while (capacity < (m_size + 1) * 2) capacity *= 2;
+        rehash(capacity);
+    }
+
+    void rehash(size_t capacity)
+    {
+        // Slots are found from 32 hash bits.
+        if (capacity > (size_t(1) << 31)) throw std::length_error("flathashmap too large");
+        std::unique_ptr<slot[]> slots(new slot[capacity]());
+        const size_t mask = capacity - 1;
+        for (size_t pos = 0; pos < m_capacity; ++pos) {
+            if (!occupied(pos)) continue;
+            size_t i = m_slots[pos].tag & mask;
+            while (slots[i].tag != EMPTY) i = (i + 1) & mask;
+            slots[i] = m_slots[pos];
+        }
+        m_slots = std::move(slots);
+        m_capacity = capacity;
+        m_deleted = 0;
+    }
+
+    void insert_slot(size_t pos, uint32_t tag, uint32_t entry)
+    {
+        if (m_slots[pos].tag == DELETED) --m_deleted;
+        m_slots[pos].tag = tag;
+        m_slots[pos].entry = entry;
+        ++m_size;
+    }
+
+    template <bool Const>
+    class iterator_base
+    {
+        friend class flathashmap;
+        typedef typename std::conditional<Const, const flathashmap*, flathashmap*>::type map_pointer;
+        map_pointer m_map;
+        size_t m_pos;
+
+        iterator_base(map_pointer map, size_t pos) : m_map(map), m_pos(pos) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename flathashmap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef typename std::conditional<Const, const value_type*, value_type*>::type pointer;
+        typedef typename std::conditional<Const, const value_type&, value_type&>::type reference;
+
+        iterator_base() : m_map(nullptr), m_pos(0) {}
+        template <bool C = Const, typename = typename std::enable_if<C>::type>
+        iterator_base(const iterator_base<false>& it) : m_map(it.m_map), m_pos(it.m_pos) {}
+
+        reference operator*() const { return *m_map->get(m_map->m_slots[m_pos].entry); }
+        pointer operator->() const { return m_map->get(m_map->m_slots[m_pos].entry); }
+        iterator_base& operator++() { m_pos = m_map->next_occupied(m_pos + 1); return *this; }
+        iterator_base operator++(int) { iterator_base copy(*this); ++*this; return copy; }
+        friend bool operator==(const iterator_base& a, const iterator_base& b) { return a.m_pos == b.m_pos; }
+        friend bool operator!=(const iterator_base& a, const iterator_base& b) { return a.m_pos != b.m_pos; }
+
+        friend class iterator_base<!Const>;
+    };
+
+public:
+    typedef iterator_base<false> iterator;
+    typedef iterator_base<true> const_iterator;
+
+    flathashmap() {}
+    ~flathashmap() { clear(); }
+
+    flathashmap(const flathashmap&) = delete;
+    flathashmap& operator=(const flathashmap&) = delete;
+
+    flathashmap(flathashmap&& other) { swap(other); }
+    flathashmap& operator=(flathashmap&& other)
+    {
+        clear();
+        swap(other);
+        return *this;
+    }
+
+    void swap(flathashmap& other)
+    {
+        std::swap(m_hash, other.m_hash);
+        std::swap(m_equal, other.m_equal);
+        std::swap(m_slots, other.m_slots);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_size, other.m_size);
+        std::swap(m_deleted, other.m_deleted);
+        std::swap(m_chunks, other.m_chunks);
+        std::swap(m_next_entry, other.m_next_entry);
+        std::swap(m_free_entry, other.m_free_entry);
+    }
+
+    iterator begin() { return iterator(this, next_occupied(0)); }
+    const_iterator begin() const { return const_iterator(this, next_occupied(0)); }
+    iterator end() { return iterator(this, m_capacity); }
+    const_iterator end() const { return const_iterator(this, m_capacity); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    iterator find(const K& key)
+    {
+        size_t pos;
+        if (m_size == 0 || !probe(key, make_tag(m_hash(key)), pos)) return end();
+        return iterator(this, pos);
+    }
+
+    const_iterator find(const K& key) const
+    {
+        size_t pos;
+        if (m_size == 0 || !probe(key, make_tag(m_hash(key)), pos)) return end();
+        return const_iterator(this, pos);
+    }
+
+    size_t count(const K& key) const { return find(key) != end(); }
+
+    /** Like std::unordered_map::emplace, the entry is constructed before looking for its key. */
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        const uint32_t entry = alloc_entry();
+        value_type* value;
+        try {
+            value = new (raw(entry)) value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            free_entry(entry);
+            throw;
+        }
+        const uint32_t tag = make_tag(m_hash(value->first));
+        size_t pos;
+        try {
+            reserve_one();
+        } catch (...) {
+            value->~value_type();
+            free_entry(entry);
+            throw;
+        }
+        if (probe(value->first, tag, pos)) {
+            value->~value_type();
+            free_entry(entry);
+            return std::make_pair(iterator(this, pos), false);
+        }
+        insert_slot(pos, tag, entry);
+        return std::make_pair(iterator(this, pos), true);
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args)
+    {
+        const uint32_t tag = make_tag(m_hash(key));
+        size_t pos;
+        if (m_size && probe(key, tag, pos)) return std::make_pair(iterator(this, pos), false);
+        reserve_one();
+        probe(key, tag, pos);
+        const uint32_t entry = alloc_entry();
+        try {
+            new (raw(entry)) value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        } catch (...) {
+            free_entry(entry);
+            throw;
+        }
+        insert_slot(pos, tag, entry);
+        return std::make_pair(iterator(this, pos), true);
+    }
+
+    T& operator[](const K& key) { return try_emplace(key).first->second; }
+
+    iterator erase(const_iterator it)
+    {
+        const size_t mask = m_capacity - 1;
+        size_t pos = it.m_pos;
+        slot& s = m_slots[pos];
+        get(s.entry)->~value_type();
+        free_entry(s.entry);
+        --m_size;
+        if (m_slots[(pos + 1) & mask].tag == EMPTY) {
+            // Nothing probes past an empty slot, so neither this slot nor
+            // the tombstones right before it need to stay.
+            s.tag = EMPTY;
+            for (size_t i = (pos - 1) & mask; m_slots[i].tag == DELETED; i = (i - 1) & mask) {
+                m_slots[i].tag = EMPTY;
+                --m_deleted;
+            }
+        } else {
+            s.tag = DELETED;
+            ++m_deleted;
+        }
+        return iterator(this, next_occupied(pos + 1));
+    }
+
+    size_t erase(const K& key)
+    {
+        const_iterator it = find(key);
+        if (it == end()) return 0;
+        erase(it);
+        return 1;
+    }
+
+    /** Remove all entries and release all memory. */
+    void clear()
+    {
+        for (size_t pos = 0; pos < m_capacity; ++pos) {
+            if (occupied(pos)) get(m_slots[pos].entry)->~value_type();
+        }
+        m_slots.reset();
+        m_capacity = 0;
+        m_size = 0;
+        m_deleted = 0;
+        std::vector<std::unique_ptr<entry_storage[]>>().swap(m_chunks);
+        m_next_entry = 0;
+        m_free_entry = NO_ENTRY;
+    }
+
+    //! Number of slots
+    size_t bucket_count() const { return m_capacity; }
+    //! Number of pool chunks, and of chunk pointers room is reserved for
+    size_t chunk_count() const { return m_chunks.size(); }
+    size_t chunk_capacity() const { return m_chunks.capacity(); }
+    static size_t slot_bytes() { return sizeof(slot); }
+    static size_t chunk_bytes() { return sizeof(entry_storage) * CHUNK_ENTRIES; }
+};
+
+#endif // BITCOIN_FLATHASHMAP_H
@@ -17,7 +17,7 @@
 
 typedef uint256 ChainCode;
 
-/** A hasher class for Bitcoin's 256-bit hash (double SHA-256). */
+/** A hasher class for Bitcoin's 256-bit hash (double SHA3-256). */
 class CHash256 {
 private:
     CSHA3_256 sha;
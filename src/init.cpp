@@ -11,10 +11,14 @@
 
 #include <addrman.h>
 #include <amount.h>
+#include <blockmsgcache.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <compat/sanity.h>
+#include <crypto/equihash_solver.h>
+#include <crypto/blake2b.h>
+#include <crypto/sha3_256.h>
 #include <consensus/validation.h>
 #include <fs.h>
 #include <httpserver.h>
@@ -56,6 +60,7 @@
 #endif
 
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/bind.hpp>
@@ -207,6 +212,7 @@ void Shutdown()
     if (g_connman) g_connman->Stop();
     peerLogic.reset();
     g_connman.reset();
+    g_block_msg_cache.Clear();
 
     StopTorControl();
 
@@ -344,6 +350,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
+    strUsage += HelpMessageOpt("-compactblockindex", strprintf(_("Keep Equihash solutions of indexed blocks on disk only and read them back when headers are served (default: %u)"), DEFAULT_COMPACT_BLOCK_INDEX));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)"), BITCOIN_CONF_FILENAME));
     if (mode == HMM_BITCOIND)
     {
@@ -353,9 +360,13 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     if (showDebug) {
+        strUsage += HelpMessageOpt("-dbasyncflush", strprintf("Write coins database flushes in the background; coins being written use memory in addition to -dbcache (default: %u)", DEFAULT_DB_ASYNC_FLUSH));
         strUsage += HelpMessageOpt("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize));
     }
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dboption=[<db>:]<key>=<value>", _("Override one LevelDB setting of the profile, for all databases or for <db> (chainstate, or index which also holds the transaction index). "
+        "Keys: cache_mb (replaces the database's share of -dbcache), write_buffer_percent, max_open_files, block_size, max_file_size, bloom_bits, compression (needs LevelDB built with Snappy), reuse_logs. Can be specified multiple times"));
+    strUsage += HelpMessageOpt("-dbprofile=[<db>:]<profile>", strprintf(_("Tune LevelDB with a named profile, for all databases or for <db> (%s, default: %s)"), DBProfileNames(), DEFAULT_DB_PROFILE));
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf(_("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)"), DEFAULT_DEBUGLOGFILE));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
@@ -368,10 +379,14 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-parblocks=<n>", strprintf(_("During initial block download, let the script verification of up to <n> consecutive blocks overlap (1 to %d, 1 = off, default: %d)"),
+        MAX_SCRIPTCHECK_BLOCKS, DEFAULT_SCRIPTCHECK_BLOCKS));
+    strUsage += HelpMessageOpt("-paranoidblockreads", strprintf(_("Check the Equihash solution of every block read from disk, not only of blocks without a validated header (default: %u)"), DEFAULT_PARANOID_BLOCK_READS));
     strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-prefetchthreads=<n>", strprintf(_("Set the number of threads reading the inputs of new blocks from the UTXO database before they are connected (0 to %d, 0 = off, default: %d)"), MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS));
     strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
@@ -400,6 +415,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(_("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
     strUsage += HelpMessageOpt("-maxuploadtarget=<n>", strprintf(_("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_TARGET));
+    strUsage += HelpMessageOpt("-netthreads=<n>", strprintf(_("Number of threads sending and receiving on peer sockets, each serving its share of the peers (1 to %d, default: %d)"), MAX_NET_THREADS, DEFAULT_NET_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
@@ -408,6 +424,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+#ifdef USE_EPOLL
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("How to wait for sockets to become ready: epoll or select. select limits connections to what fits in FD_SETSIZE (default: %s)"), DEFAULT_SOCKETEVENTS));
+#endif
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -467,7 +486,9 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
+        strUsage += HelpMessageOpt("-maxblockmsgcachesize=<n>", strprintf("Keep recent blocks and their network encodings in up to <n> MiB of memory, the latest block is always kept (default: %u)", DEFAULT_MAX_BLOCK_MSG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxpubkeycachesize=<n>", strprintf("Limit the cache of decompressed public keys to <n> MiB, 0 to disable (default: %u)", DEFAULT_MAX_PUBKEY_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-maxtxfee=<amt>", strprintf(_("Maximum total fees (in %s) to use in a single wallet transaction or raw transaction; setting this too low may abort large transactions (default: %s)"),
@@ -507,7 +528,9 @@ std::string HelpMessage(HelpMessageMode mode)
 
     strUsage += HelpMessageGroup(_("Mining options:"));
     strUsage += HelpMessageOpt("-gen", strprintf(_("Generate coins (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-equihashsolver=<name>", strprintf(_("Equihash solver used for mining, one of: %s (default: %s)"), boost::algorithm::join(GetEquihashSolverNames(), ", "), DEFAULT_EQUIHASH_SOLVER));
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), 1));
+    strUsage += HelpMessageOpt("-gensolvethreads=<n>", strprintf(_("Number of the -genproclimit threads that work together on one Equihash solve and share its memory; the remaining threads run further solves concurrently, with any left over joining the last one (0 = all of them, default: %d)"), DEFAULT_GEN_SOLVE_THREADS));
     strUsage += HelpMessageOpt("-mineraddress=<addr>", _("Send mined coins to a specific single address"));
     strUsage += HelpMessageOpt("-minetolocalwallet", strprintf(
             _("Require that mined blocks use a coinbase address in the local wallet (default: %u)"),
@@ -854,6 +877,7 @@ void InitLogging()
 namespace { // Variables internal to initialization process only
 
 int nMaxConnections;
+SocketEventsMode socketEventsMode = SocketEventsMode::Select;
 int nUserMaxConnections;
 int nFD;
 ServiceFlags nLocalServices = ServiceFlags(NODE_NETWORK | NODE_NETWORK_LIMITED);
@@ -940,17 +964,41 @@ bool AppInitParameterInteraction()
         return InitError("Cannot set -bind or -whitebind together with -listen=0");
     }
 
+    // LevelDB profiles that keep more files open than the default need more file descriptors
+    int nDBFiles = 0;
+    try {
+        for (const char* db : {"chainstate", "index"}) {
+            nDBFiles += std::max<int>(ReadDBOptions(db).max_open_files - DEFAULT_DB_MAX_OPEN_FILES, 0);
+        }
+    } catch (const std::runtime_error& e) {
+        return InitError(e.what());
+    }
+
+    const std::string strSocketEvents = gArgs.GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (strSocketEvents == "select") {
+        socketEventsMode = SocketEventsMode::Select;
+#ifdef USE_EPOLL
+    } else if (strSocketEvents == "epoll") {
+        socketEventsMode = SocketEventsMode::Epoll;
+#endif
+    } else {
+        return InitError(strprintf(_("Unknown -socketevents mode: '%s'"), strSocketEvents));
+    }
+    // Only select() cannot wait on descriptors from FD_SETSIZE on
+    fSelectableSocketsOnly = socketEventsMode == SocketEventsMode::Select;
+
     // Make sure enough file descriptors are available
     int nBind = std::max(nUserBind, size_t(1));
     nUserMaxConnections = gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS), 0);
-    nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
-    if (nFD < MIN_CORE_FILEDESCRIPTORS)
+    if (fSelectableSocketsOnly)
+        nMaxConnections = std::max(std::min(nMaxConnections, FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - nDBFiles - MAX_ADDNODE_CONNECTIONS), 0);
+    nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + nDBFiles + MAX_ADDNODE_CONNECTIONS);
+    if (nFD < MIN_CORE_FILEDESCRIPTORS + nDBFiles)
         return InitError(_("Not enough file descriptors available."));
-    nMaxConnections = std::min(nFD - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS, nMaxConnections);
+    nMaxConnections = std::min(nFD - MIN_CORE_FILEDESCRIPTORS - nDBFiles - MAX_ADDNODE_CONNECTIONS, nMaxConnections);
 
     if (nMaxConnections < nUserMaxConnections)
         InitWarning(strprintf(_("Reducing -maxconnections from %d to %d, because of system limitations."), nUserMaxConnections, nMaxConnections));
@@ -1009,6 +1057,8 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fCompactBlockIndex = gArgs.GetBoolArg("-compactblockindex", DEFAULT_COMPACT_BLOCK_INDEX);
+    fParanoidBlockReads = gArgs.GetBoolArg("-paranoidblockreads", DEFAULT_PARANOID_BLOCK_READS);
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1054,6 +1104,10 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nScriptCheckBlocks = std::max(1, std::min<int>(gArgs.GetArg("-parblocks", DEFAULT_SCRIPTCHECK_BLOCKS), MAX_SCRIPTCHECK_BLOCKS));
+
+    nPrefetchThreads = std::max(0, std::min<int>(gArgs.GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS), MAX_PREFETCH_THREADS));
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = gArgs.GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1125,6 +1179,12 @@ bool AppInitParameterInteraction()
     // Option to startup with mocktime set (used for regression testing):
     SetMockTime(gArgs.GetArg("-mocktime", 0)); // SetMockTime(0) is a no-op
 
+    const std::vector<std::string> solverNames = GetEquihashSolverNames();
+    const std::string solverName = gArgs.GetArg("-equihashsolver", DEFAULT_EQUIHASH_SOLVER);
+    if (std::find(solverNames.begin(), solverNames.end(), solverName) == solverNames.end()) {
+        return InitError(strprintf(_("Unknown -equihashsolver '%s' (must be one of: %s)"), solverName, boost::algorithm::join(solverNames, ", ")));
+    }
+
     if (gArgs.IsArgSet("-mineraddress")) {
         CTxDestination addr = DecodeDestination(gArgs.GetArg("-mineraddress", ""));
         if (boost::get<CNoDestination>(&addr)) {
@@ -1209,9 +1269,15 @@ bool AppInitSanityChecks()
         return false;
     }
 
+    std::string sha3_256_algo = SHA3_256AutoDetect();
+    LogPrintf("Using the '%s' SHA3-256 implementation\n", sha3_256_algo);
+    std::string blake2b_algo = BLAKE2bAutoDetect();
+    LogPrintf("Using the '%s' BLAKE2b implementation\n", blake2b_algo);
+
     // Initialize elliptic curve code
     RandomInit();
     ECC_Start();
+    LogPrintf("Using the '%s' ed25519 field arithmetic\n", ed25519_backend_name());
     globalVerifyHandle.reset(new ECCVerifyHandle());
 
     // Sanity check
@@ -1278,7 +1344,13 @@ bool AppInitMain()
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        // Header checks share -par; they run while headers sync, mostly
+        // before there are any blocks to verify scripts for.
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderCheck);
     }
+    for (int i=0; i<nPrefetchThreads; i++)
+        threadGroup.create_thread(&ThreadPrefetchCoins);
 
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
@@ -1324,6 +1396,7 @@ bool AppInitMain()
     g_connman = std::unique_ptr<CConnman>(new CConnman(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max())));
     CConnman& connman = *g_connman;
 
+    g_block_msg_cache.SetMaxSize(std::max((int64_t)0, gArgs.GetArg("-maxblockmsgcachesize", DEFAULT_MAX_BLOCK_MSG_CACHE_SIZE)) * ((size_t) 1 << 20));
     peerLogic.reset(new PeerLogicValidation(&connman, scheduler));
     RegisterValidationInterface(peerLogic.get());
 
@@ -1441,6 +1514,17 @@ bool AppInitMain()
     nTotalCache -= nBlockTreeDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
+    // A LevelDB profile may size a database cache itself, still out of -dbcache
+    const int64_t nBlockTreeDBCacheMB = ReadDBOptions("index").cache_mb;
+    const int64_t nCoinDBCacheMB = ReadDBOptions("chainstate").cache_mb;
+    if (nBlockTreeDBCacheMB) {
+        nTotalCache += nBlockTreeDBCache;
+        nBlockTreeDBCache = std::min(nBlockTreeDBCacheMB << 20, nTotalCache / 4);
+        nTotalCache -= nBlockTreeDBCache;
+    }
+    if (nCoinDBCacheMB) {
+        nCoinDBCache = std::min(nCoinDBCacheMB << 20, nTotalCache / 2);
+    }
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
@@ -1764,6 +1848,8 @@ bool AppInitMain()
     connOptions.m_msgproc = peerLogic.get();
     connOptions.nSendBufferMaxSize = 1000*gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.socketEventsMode = socketEventsMode;
+    connOptions.nSocketThreads = std::max(1, std::min<int>(gArgs.GetArg("-netthreads", DEFAULT_NET_THREADS), MAX_NET_THREADS));
     connOptions.m_added_nodes = gArgs.GetArgs("-addnode");
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
@@ -136,6 +136,8 @@ bool ECC_InitSanityCheck() {
 }
 
 void ECC_Start() {
+    ed25519_autodetect();
+
     // 测试生成一对ed25519公私钥
     std::vector<unsigned char, secure_allocator<unsigned char>> vseed(32);
     GetRandBytes(vseed.data(), 32);
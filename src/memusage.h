@@ -5,7 +5,9 @@
 #ifndef BITCOIN_MEMUSAGE_H
 #define BITCOIN_MEMUSAGE_H
 
+#include <flathashmap.h>
 #include <indirectmap.h>
+#include <prevector.h>
 
 #include <stdlib.h>
 
@@ -164,6 +166,12 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z, typename W>
+static inline size_t DynamicUsage(const flathashmap<X, Y, Z, W>& m)
+{
+    return MallocUsage(m.slot_bytes() * m.bucket_count()) + MallocUsage(m.chunk_bytes()) * m.chunk_count() + MallocUsage(sizeof(void*) * m.chunk_capacity());
+}
+
 }
 
 #endif // BITCOIN_MEMUSAGE_H
@@ -32,6 +32,7 @@
 #include <key_io.h>
 #include <compat.h>
 #include <crypto/equihash.h>
+#include <crypto/equihash_solver.h>
 #include <boost/thread.hpp>
 
 // Unconfirmed transactions in the memory pool often depend on other
@@ -520,9 +521,9 @@ static bool ProcessBlockFound(CBlock* pblock)
 }
 
 #ifdef ENABLE_WALLET
-void static BitcoinMiner(CWallet *pwallet)
+void static BitcoinMiner(CWallet *pwallet, int nSolveThreads)
 #else
-void static BitcoinMiner()
+void static BitcoinMiner(int nSolveThreads)
 #endif
 {
     LogPrintf("BitcoinMiner started\n");
@@ -539,9 +540,9 @@ void static BitcoinMiner()
     unsigned int n = chainparams.EquihashN();
     unsigned int k = chainparams.EquihashK();
 
-    std::string solver = gArgs.GetArg("-equihashsolver", "default");
-    assert(solver == "tromp" || solver == "default");
-    LogPrintf("Using Equihash solver \"%s\" with n = %u, k = %u\n", solver, n, k);
+    // Each thread has its own solver and its buffers
+    std::unique_ptr<CEquihashSolver> solver = CreateEquihashSolver(gArgs.GetArg("-equihashsolver", DEFAULT_EQUIHASH_SOLVER), n, k, nSolveThreads);
+    LogPrintf("Using Equihash solver \"%s\" with n = %u, k = %u, %d thread(s)\n", solver->GetName(), n, k, nSolveThreads);
 
     std::mutex m_cs;
     bool cancelSolver = false;
@@ -664,7 +665,7 @@ void static BitcoinMiner()
 
                 try {
                     // If we find a valid block, we rebuild
-                    bool found = EhOptimisedSolve(n, k, curr_state, validBlock, cancelled);
+                    bool found = solver->Solve(curr_state, validBlock, cancelled);
                     if (found) {
                         break;
                     }
@@ -725,12 +726,23 @@ void GenerateBitcoins(bool fGenerate, int nThreads)
     if (nThreads == 0 || !fGenerate)
         return;
 
+    // nThreads is the total budget: it is split into concurrent solves that
+    // each use nSolveThreads threads on one shared working set. Threads left
+    // over by the division go to the last solve so none of the budget idles.
+    int nSolveThreads = gArgs.GetArg("-gensolvethreads", DEFAULT_GEN_SOLVE_THREADS);
+    if (nSolveThreads <= 0 || nSolveThreads > nThreads)
+        nSolveThreads = nThreads;
+    int nSolvers = nThreads / nSolveThreads;
+    int nLastSolveThreads = nSolveThreads + nThreads % nSolveThreads;
+    LogPrintf("Starting %d miner thread(s) with %d Equihash solver thread(s) each (%d for the last)\n", nSolvers, nSolveThreads, nLastSolveThreads);
+
     minerThreads = new boost::thread_group();
-    for (int i = 0; i < nThreads; i++) {
+    for (int i = 0; i < nSolvers; i++) {
+        int nThisSolveThreads = i == nSolvers - 1 ? nLastSolveThreads : nSolveThreads;
 #ifdef ENABLE_WALLET
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, pwallet));
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, pwallet, nThisSolveThreads));
 #else
-        minerThreads->create_thread(&BitcoinMiner);
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, nThisSolveThreads));
 #endif
     }
 }
\ No newline at end of file
@@ -24,6 +24,10 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Equihash solver used by the internal miner and the generate RPCs */
+static const char* const DEFAULT_EQUIHASH_SOLVER = "default";
+/** Number of mining threads that share one Equihash solve (0 = all of them) */
+static const int DEFAULT_GEN_SOLVE_THREADS = 1;
 
 struct CBlockTemplate
 {
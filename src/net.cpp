@@ -73,6 +73,11 @@ const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0xabb2b5f9a692e3aaULL; // SHA3_256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xe42e8de9f9a5d4d6ULL; // SHA3_256("localhostnonce")[0:8]
+
+#ifdef USE_EPOLL
+/** Marks the epoll events of listening sockets, which carry their index; node events carry the node id */
+static const uint64_t EPOLL_LISTEN_SOCKET = 1ULL << 63;
+#endif
 //
 // Global state variables
 //
@@ -489,6 +494,13 @@ void CNode::CloseSocketDisconnect()
     if (hSocket != INVALID_SOCKET)
     {
         LogPrint(BCLog::NET, "disconnecting peer=%d\n", id);
+#ifdef USE_EPOLL
+        // A closed descriptor number may be reused for a new socket at once
+        if (epollfd != -1) {
+            epoll_ctl(epollfd, EPOLL_CTL_DEL, hSocket, nullptr);
+            epollfd = -1;
+        }
+#endif
         CloseSocket(hSocket);
     }
 }
@@ -782,6 +794,9 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
             i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
 
             msg.nTime = nTimeMicros;
+            // Finish the checksum here, on the socket thread, rather than
+            // leaving it to the message handler
+            msg.GetMessageHash();
             complete = true;
         }
     }
@@ -887,27 +902,54 @@ size_t CConnman::SocketSendData(CNode *pnode) const
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
+        size_t nBatchSize = 0;
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            const auto &data = **it;
+            nBatchSize = data.size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, nBatchSize, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Hand the kernel as many queued buffers as fit in one call,
+            // straight from the (possibly shared) buffers themselves
+            struct iovec iov[MAX_SEND_IOVECS];
+            size_t nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (auto itBatch = it; itBatch != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++itBatch, ++nIov) {
+                iov[nIov].iov_base = const_cast<unsigned char*>((*itBatch)->data()) + nOffset;
+                iov[nIov].iov_len = (*itBatch)->size() - nOffset;
+                nBatchSize += iov[nIov].iov_len;
+                nOffset = 0;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
-                pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
-                // could not send full message; stop sending more
+            size_t nRemaining = nBytes;
+            while (nRemaining > 0) {
+                const auto &data = **it;
+                size_t nChunk = std::min(nRemaining, data.size() - pnode->nSendOffset);
+                pnode->nSendOffset += nChunk;
+                nRemaining -= nChunk;
+                if (pnode->nSendOffset == data.size()) {
+                    pnode->nSendOffset = 0;
+                    pnode->nSendSize -= data.size();
+                    pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                    it++;
+                }
+            }
+            if ((size_t)nBytes < nBatchSize) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -1106,7 +1148,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (fSelectableSocketsOnly && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1145,103 +1187,157 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
-    {
-        LOCK(cs_vNodes);
-        vNodes.push_back(pnode);
+    InsertNode(pnode);
+}
+
+size_t CConnman::GetSocketShard(const CNode* pnode) const
+{
+    return pnode->GetId() % nSocketThreads;
+}
+
+void CConnman::InsertNode(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (socketEventsMode == SocketEventsMode::Epoll) {
+        // Events carry the node id rather than a pointer, so that one
+        // reported for a node that is gone by then refers to nothing
+        LOCK(pnode->cs_hSocket);
+        const int epollfd = epollfds[GetSocketShard(pnode)];
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = pnode->GetId();
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) == 0) {
+            pnode->epollfd = epollfd;
+        } else {
+            LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+            pnode->CloseSocketDisconnect();
+        }
     }
+#endif
+    LOCK(cs_vNodes);
+    vNodes.push_back(pnode);
 }
 
-void CConnman::ThreadSocketHandler()
+void CConnman::DisconnectNodes()
 {
-    unsigned int nPrevNodeCount = 0;
-    while (!interruptNet)
     {
-        //
-        // Disconnect nodes
-        //
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        std::vector<CNode*> vNodesCopy = vNodes;
+        for (CNode* pnode : vNodesCopy)
         {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            std::vector<CNode*> vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy)
+            if (pnode->fDisconnect)
             {
-                if (pnode->fDisconnect)
-                {
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                // remove from vNodes
+                vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
+                // release outbound grant (if any)
+                pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                // close socket and cleanup
+                pnode->CloseSocketDisconnect();
 
-                    // hold in disconnected pool until all refs are released
-                    pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
-                }
+                // hold in disconnected pool until all refs are released
+                pnode->Release();
+                vNodesDisconnected.push_back(pnode);
             }
         }
+    }
+    {
+        // Delete disconnected nodes
+        std::list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+        for (CNode* pnode : vNodesDisconnectedCopy)
         {
-            // Delete disconnected nodes
-            std::list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            for (CNode* pnode : vNodesDisconnectedCopy)
-            {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0) {
-                    bool fDelete = false;
-                    {
-                        TRY_LOCK(pnode->cs_inventory, lockInv);
-                        if (lockInv) {
-                            TRY_LOCK(pnode->cs_vSend, lockSend);
-                            if (lockSend) {
-                                fDelete = true;
-                            }
+            // wait until threads are done using it
+            if (pnode->GetRefCount() <= 0) {
+                bool fDelete = false;
+                {
+                    TRY_LOCK(pnode->cs_inventory, lockInv);
+                    if (lockInv) {
+                        TRY_LOCK(pnode->cs_vSend, lockSend);
+                        if (lockSend) {
+                            fDelete = true;
                         }
                     }
-                    if (fDelete) {
-                        vNodesDisconnected.remove(pnode);
-                        DeleteNode(pnode);
-                    }
+                }
+                if (fDelete) {
+                    vNodesDisconnected.remove(pnode);
+                    DeleteNode(pnode);
                 }
             }
         }
-        size_t vNodesSize;
+    }
+}
+
+void CConnman::NotifyNumConnectionsChanged()
+{
+    size_t vNodesSize;
+    {
+        LOCK(cs_vNodes);
+        vNodesSize = vNodes.size();
+    }
+    if(vNodesSize != nPrevNodeCount) {
+        nPrevNodeCount = vNodesSize;
+        if(clientInterface)
+            clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+}
+
+void CConnman::ThreadSocketHandler(size_t nShard)
+{
+#ifdef USE_EPOLL
+    std::vector<struct epoll_event> vEpollEvents(MAX_EPOLL_EVENTS);
+#endif
+    // Whether the last round left socket readiness unused, so the next should not wait
+    bool fMoreReady = false;
+    // Only the first socket thread accepts connections and cleans up after disconnected nodes
+    const size_t nListenSockets = nShard == 0 ? vhListenSocket.size() : 0;
+    while (!interruptNet)
+    {
+        if (nShard == 0) {
+            DisconnectNodes();
+            NotifyNumConnectionsChanged();
+        }
+
+        // Take the nodes of this thread before waiting, ordered by id so
+        // that the nodes epoll reports on can be looked up
+        std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesSize = vNodes.size();
-        }
-        if(vNodesSize != nPrevNodeCount) {
-            nPrevNodeCount = vNodesSize;
-            if(clientInterface)
-                clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
+            for (CNode* pnode : vNodes) {
+                if (GetSocketShard(pnode) != nShard)
+                    continue;
+                pnode->AddRef();
+                vNodesCopy.push_back(pnode);
+            }
         }
+        std::sort(vNodesCopy.begin(), vNodesCopy.end(), [](const CNode* a, const CNode* b) { return a->GetId() < b->GetId(); });
 
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
+        std::vector<bool> vListenReady(nListenSockets, false);
         fd_set fdsetRecv;
         fd_set fdsetSend;
         fd_set fdsetError;
         FD_ZERO(&fdsetRecv);
         FD_ZERO(&fdsetSend);
         FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        if (socketEventsMode == SocketEventsMode::Select) {
+            struct timeval timeout;
+            timeout.tv_sec  = 0;
+            timeout.tv_usec = 50000; // frequency to poll pnode->vSend
 
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
+            SOCKET hSocketMax = 0;
+            bool have_fds = false;
 
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes)
+            for (size_t i = 0; i < nListenSockets; i++) {
+                FD_SET(vhListenSocket[i].socket, &fdsetRecv);
+                hSocketMax = std::max(hSocketMax, vhListenSocket[i].socket);
+                have_fds = true;
+            }
+
+            for (CNode* pnode : vNodesCopy)
             {
                 // Implement the following logic:
                 // * If there is data to send, select() for sending data. As this only
@@ -1277,49 +1373,79 @@ void CConnman::ThreadSocketHandler()
                     FD_SET(pnode->hSocket, &fdsetRecv);
                 }
             }
-        }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        if (interruptNet)
-            return;
+            int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                                 &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+            if (interruptNet)
+                return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
+            if (nSelect == SOCKET_ERROR)
             {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+                if (have_fds)
+                {
+                    int nErr = WSAGetLastError();
+                    LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+                    for (unsigned int i = 0; i <= hSocketMax; i++)
+                        FD_SET(i, &fdsetRecv);
+                }
+                FD_ZERO(&fdsetSend);
+                FD_ZERO(&fdsetError);
+                if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
+                    return;
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
+
+            for (size_t i = 0; i < nListenSockets; i++)
+                vListenReady[i] = FD_ISSET(vhListenSocket[i].socket, &fdsetRecv);
+        }
+#ifdef USE_EPOLL
+        else {
+            // Only sockets whose state changed are reported, and the nodes
+            // remember it. Don't wait if the last round left some unused.
+            int nEvents = epoll_wait(epollfds[nShard], vEpollEvents.data(), vEpollEvents.size(), fMoreReady ? 0 : 50);
+            if (interruptNet)
                 return;
+            if (nEvents == SOCKET_ERROR) {
+                int nErr = WSAGetLastError();
+                if (nErr != WSAEINTR)
+                    LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+                nEvents = 0;
+            }
+            fMoreReady = nEvents == (int)vEpollEvents.size();
+            for (int i = 0; i < nEvents; i++) {
+                const struct epoll_event& event = vEpollEvents[i];
+                if (event.data.u64 & EPOLL_LISTEN_SOCKET) {
+                    if ((event.data.u64 & ~EPOLL_LISTEN_SOCKET) < nListenSockets)
+                        vListenReady[event.data.u64 & ~EPOLL_LISTEN_SOCKET] = true;
+                    continue;
+                }
+                // Nodes added since vNodesCopy was taken start out ready anyway
+                const NodeId id = event.data.u64;
+                auto it = std::lower_bound(vNodesCopy.begin(), vNodesCopy.end(), id, [](const CNode* pnode, NodeId idIn) { return pnode->GetId() < idIn; });
+                if (it == vNodesCopy.end() || (*it)->GetId() != id)
+                    continue;
+                CNode* pnode = *it;
+                if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    pnode->fSocketReadable = true;
+                if (event.events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                    pnode->fSocketWritable = true;
+            }
         }
+#endif
 
         //
         // Accept new connections
         //
-        for (const ListenSocket& hListenSocket : vhListenSocket)
+        for (size_t i = 0; i < nListenSockets; i++)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (vhListenSocket[i].socket != INVALID_SOCKET && vListenReady[i])
             {
-                AcceptConnection(hListenSocket);
+                AcceptConnection(vhListenSocket[i]);
             }
         }
 
         //
         // Service each socket
         //
-        std::vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy)
-                pnode->AddRef();
-        }
         for (CNode* pnode : vNodesCopy)
         {
             if (interruptNet)
@@ -1331,13 +1457,22 @@ void CConnman::ThreadSocketHandler()
             bool recvSet = false;
             bool sendSet = false;
             bool errorSet = false;
-            {
+            if (socketEventsMode == SocketEventsMode::Select) {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
                 recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
                 sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
                 errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+            } else {
+                // Same priorities as with select(): drain the send queue before receiving more
+                bool fSending;
+                {
+                    LOCK(pnode->cs_vSend);
+                    fSending = !pnode->vSendMsg.empty();
+                }
+                sendSet = fSending && pnode->fSocketWritable;
+                recvSet = !fSending && !pnode->fPauseRecv && pnode->fSocketReadable;
             }
             if (recvSet || errorSet)
             {
@@ -1350,6 +1485,11 @@ void CConnman::ThreadSocketHandler()
                         continue;
                     nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                 }
+                // A short read emptied the socket; a full one may have left more behind
+                if (nBytes == (int)sizeof(pchBuf))
+                    fMoreReady |= pnode->fSocketReadable;
+                else
+                    pnode->fSocketReadable = false;
                 if (nBytes > 0)
                 {
                     bool notify = false;
@@ -1404,6 +1544,9 @@ void CConnman::ThreadSocketHandler()
                 if (nBytes) {
                     RecordBytesSent(nBytes);
                 }
+                // Whatever is left waits for the socket to become writable again
+                if (!pnode->vSendMsg.empty())
+                    pnode->fSocketWritable = false;
             }
 
             //
@@ -2004,10 +2147,7 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         pnode->m_manual_connection = true;
 
     m_msgproc->InitializeNode(pnode);
-    {
-        LOCK(cs_vNodes);
-        vNodes.push_back(pnode);
-    }
+    InsertNode(pnode);
 }
 
 void CConnman::ThreadMessageHandler()
@@ -2220,6 +2360,8 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nLastNodeId = 0;
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
+    nSocketThreads = 1;
+    nPrevNodeCount = 0;
     flagInterruptMsgProc = false;
     SetTryNewOutboundPeer(false);
 
@@ -2287,6 +2429,34 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         return false;
     }
 
+#ifdef USE_EPOLL
+    if (socketEventsMode == SocketEventsMode::Epoll) {
+        for (int i = 0; i < nSocketThreads; i++) {
+            int epollfd = epoll_create1(EPOLL_CLOEXEC);
+            if (epollfd == -1) {
+                LogPrintf("Failed to create epoll instance, using select() instead: %s\n", NetworkErrorString(WSAGetLastError()));
+                socketEventsMode = SocketEventsMode::Select;
+                fSelectableSocketsOnly = true;
+                break;
+            }
+            epollfds.push_back(epollfd);
+        }
+    }
+    if (socketEventsMode == SocketEventsMode::Epoll) {
+        for (size_t i = 0; i < vhListenSocket.size(); i++) {
+            // Level-triggered, as connections are accepted one per round
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u64 = EPOLL_LISTEN_SOCKET | i;
+            if (epoll_ctl(epollfds[0], EPOLL_CTL_ADD, vhListenSocket[i].socket, &event) != 0) {
+                LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+                return false;
+            }
+        }
+    }
+#endif
+    LogPrintf("Using %d network thread(s) with %s to wait for sockets\n", nSocketThreads, socketEventsMode == SocketEventsMode::Epoll ? "epoll" : "select()");
+
     for (const auto& strDest : connOptions.vSeedNodes) {
         AddOneShot(strDest);
     }
@@ -2352,7 +2522,11 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     }
 
     // Send and receive from sockets, accept connections
-    threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
+    vSocketThreadNames.clear();
+    for (int i = 0; i < nSocketThreads; i++)
+        vSocketThreadNames.push_back(i == 0 ? "net" : strprintf("net.%d", i));
+    for (int i = 0; i < nSocketThreads; i++)
+        threadSocketHandlers.emplace_back(&TraceThread<std::function<void()> >, vSocketThreadNames[i].c_str(), std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this, i)));
 
     if (!gArgs.GetBoolArg("-dnsseed", true))
         LogPrintf("DNS seeding disabled\n");
@@ -2431,8 +2605,10 @@ void CConnman::Stop()
         threadOpenAddedConnections.join();
     if (threadDNSAddressSeed.joinable())
         threadDNSAddressSeed.join();
-    if (threadSocketHandler.joinable())
-        threadSocketHandler.join();
+    for (std::thread& thread : threadSocketHandlers)
+        if (thread.joinable())
+            thread.join();
+    threadSocketHandlers.clear();
 
     if (fAddressesInitialized)
     {
@@ -2448,6 +2624,12 @@ void CConnman::Stop()
             if (!CloseSocket(hListenSocket.socket))
                 LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
 
+#ifdef USE_EPOLL
+    for (int epollfd : epollfds)
+        close(epollfd);
+    epollfds.clear();
+#endif
+
     // clean up some globals (to help leak detection)
     for (CNode *pnode : vNodes) {
         DeleteNode(pnode);
@@ -2736,6 +2918,12 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+#ifdef USE_EPOLL
+    epollfd = -1;
+#endif
+    // Until the first recv and send find out otherwise
+    fSocketReadable = true;
+    fSocketWritable = true;
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2817,20 +3005,35 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
-void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+CSharedNetMsg CConnman::ShareMessage(CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
-    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
-    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
-
+    CSharedNetMsg shared;
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
-    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
+    uint256 hash = Hash(msg.data.data(), msg.data.data() + msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
+    shared.command = std::move(msg.command);
+    shared.header = std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader));
+    if (!msg.data.empty())
+        shared.payload = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+    return shared;
+}
+
+void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+{
+    PushMessage(pnode, ShareMessage(std::move(msg)));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    size_t nMessageSize = msg.payload ? msg.payload->size() : 0;
+    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
+
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
@@ -2842,9 +3045,9 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(msg.header);
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(msg.payload);
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
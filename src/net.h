@@ -76,6 +76,25 @@ static const uint64_t MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
 /** Default for blocks only*/
 static const bool DEFAULT_BLOCKSONLY = false;
 
+/** How the socket handler waits for sockets to become ready (-socketevents) */
+enum class SocketEventsMode {
+    Select,
+    Epoll,
+};
+#ifdef USE_EPOLL
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+/** Maximum number of epoll events the socket handler takes in one wait */
+static const int MAX_EPOLL_EVENTS = 256;
+/** Maximum number of queued send buffers handed to the kernel in one call */
+static const size_t MAX_SEND_IOVECS = 64;
+/** Default number of threads sending and receiving on peer sockets (-netthreads) */
+static const int DEFAULT_NET_THREADS = 1;
+/** Maximum number of -netthreads */
+static const int MAX_NET_THREADS = 16;
+
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
@@ -109,6 +128,20 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/** Serialized bytes queued for sending, possibly shared between the send queues of many peers. */
+typedef std::shared_ptr<const std::vector<unsigned char>> CNetSendBuffer;
+
+/**
+ * A message whose header and payload are serialized, and whose checksum is
+ * computed, only once however many peers it is queued for.
+ */
+struct CSharedNetMsg
+{
+    std::string command;
+    CNetSendBuffer header;
+    CNetSendBuffer payload; // null if the message has no payload
+};
+
 class NetEventsInterface;
 class CConnman
 {
@@ -141,6 +174,8 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
+        SocketEventsMode socketEventsMode = SocketEventsMode::Select;
+        int nSocketThreads = 1;
     };
 
     void Init(const Options& connOptions) {
@@ -154,6 +189,8 @@ public:
         m_msgproc = connOptions.m_msgproc;
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
+        socketEventsMode = connOptions.socketEventsMode;
+        nSocketThreads = std::max(connOptions.nSocketThreads, 1);
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -179,6 +216,9 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
+    /** Serialize the header of a message so that it can be pushed to any number of peers. */
+    static CSharedNetMsg ShareMessage(CSerializedNetMsg&& msg);
 
     template<typename Callable>
     void ForEachNode(Callable&& func)
@@ -327,7 +367,12 @@ private:
     void ThreadOpenConnections(std::vector<std::string> connect);
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
-    void ThreadSocketHandler();
+    void InsertNode(CNode* pnode);
+    void DisconnectNodes();
+    void NotifyNumConnectionsChanged();
+    /** Which socket handler thread sends and receives for pnode */
+    size_t GetSocketShard(const CNode* pnode) const;
+    void ThreadSocketHandler(size_t nShard);
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
@@ -381,6 +426,14 @@ private:
 
     unsigned int nSendBufferMaxSize;
     unsigned int nReceiveFloodSize;
+    SocketEventsMode socketEventsMode;
+    int nSocketThreads;
+#ifdef USE_EPOLL
+    /** epoll instance of each socket handler thread, in SocketEventsMode::Epoll.
+     *  The first one also watches the listening sockets. */
+    std::vector<int> epollfds;
+#endif
+    unsigned int nPrevNodeCount;
 
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive;
@@ -424,7 +477,9 @@ private:
     CThreadInterrupt interruptNet;
 
     std::thread threadDNSAddressSeed;
-    std::thread threadSocketHandler;
+    /** Socket handler threads, each serving the nodes of one shard */
+    std::vector<std::thread> threadSocketHandlers;
+    std::vector<std::string> vSocketThreadNames;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
@@ -603,10 +658,15 @@ public:
     // socket
     std::atomic<ServiceFlags> nServices;
     SOCKET hSocket;
+#ifdef USE_EPOLL
+    // epoll instance hSocket is registered with, or -1. Protected by
+    // cs_hSocket, so the registration ends before the socket is closed.
+    int epollfd;
+#endif
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CNetSendBuffer> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -659,6 +719,11 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Readiness of hSocket last reported by epoll (edge-triggered), until
+    // a recv or send finds it used up. Only used by the node's socket
+    // handler thread.
+    bool fSocketReadable;
+    bool fSocketWritable;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -8,6 +8,7 @@
 #include <addrman.h>
 #include <arith_uint256.h>
 #include <blockencodings.h>
+#include <blockmsgcache.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
@@ -202,6 +203,14 @@ struct CNodeState {
      * otherwise: whether this peer sends non-witnesses in cmpctblocks/blocktxns.
      */
     bool fSupportsDesiredCmpctVersion;
+    //! Compact blocks sent to this peer, and the transactions besides coinbases prefilled in them
+    uint64_t nCmpctBlocksSent;
+    uint64_t nCmpctPrefilledTxSent;
+    //! getblocktxn requests received from this peer, for compact blocks it could not reconstruct
+    uint64_t nBlockTxnRequestsReceived;
+    //! Compact blocks received from this peer, and how many of them we had to send a getblocktxn for
+    uint64_t nCmpctBlocksReceived;
+    uint64_t nBlockTxnRequestsSent;
 
     /** State used to enforce CHAIN_SYNC_TIMEOUT
       * Only in effect for outbound, non-manual connections, with
@@ -255,6 +264,11 @@ struct CNodeState {
         fHaveWitness = false;
         fWantsCmpctWitness = false;
         fSupportsDesiredCmpctVersion = false;
+        nCmpctBlocksSent = 0;
+        nCmpctPrefilledTxSent = 0;
+        nBlockTxnRequestsReceived = 0;
+        nCmpctBlocksReceived = 0;
+        nBlockTxnRequestsSent = 0;
         m_chain_sync = { 0, nullptr, false, false };
         m_last_block_announcement = 0;
     }
@@ -451,6 +465,19 @@ bool CanDirectFetch(const Consensus::Params &consensusParams)
     return chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - consensusParams.nPowTargetSpacing * 20;
 }
 
+// Requires cs_main, as the solution may be trimmed from the block index
+// without it. Fails if the solution cannot be read back from disk.
+static bool AppendBlockHeader(std::vector<CBlock>& vHeaders, const CBlockIndex* pindex)
+{
+    try {
+        vHeaders.push_back(pindex->GetBlockHeader());
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        return false;
+    }
+    return true;
+}
+
 // Requires cs_main
 bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex)
 {
@@ -626,6 +653,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nCmpctBlocksSent = state->nCmpctBlocksSent;
+    stats.nCmpctPrefilledTxSent = state->nCmpctPrefilledTxSent;
+    stats.nBlockTxnRequestsReceived = state->nBlockTxnRequestsReceived;
+    stats.nCmpctBlocksReceived = state->nCmpctBlocksReceived;
+    stats.nBlockTxnRequestsSent = state->nBlockTxnRequestsSent;
     return true;
 }
 
@@ -816,9 +848,12 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &schedu
 
 /**
  * Evict orphan txn pool entries (EraseOrphanTx) based on a newly connected
- * block. Also save the time of the last tip update.
+ * block. Also save the time of the last tip update, and keep the block in
+ * memory for the peers about to ask for it.
  */
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) {
+    g_block_msg_cache.Add(pblock);
+
     LOCK(g_cs_orphans);
 
     std::vector<uint256> vOrphanErase;
@@ -850,56 +885,128 @@ void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pb
     g_last_tip_update = GetTime();
 }
 
-// All of the following cache a recent block, and are protected by cs_most_recent_block
+/**
+ * Pick the transactions of a block, besides the coinbase, that pnode is not
+ * known to have: we neither announced them to it nor heard about them from
+ * it. Those are typically still waiting to be trickled to the peer, below its
+ * fee filter, replacements or resolved orphans, or were never in our mempool
+ * at all, and any of them would cost the peer a getblocktxn round trip.
+ * Returns the number of transactions picked.
+ */
+static size_t PredictMissingTransactions(CNode* pnode, const CBlock& block, std::vector<bool>& vPrefill)
+{
+    vPrefill.assign(block.vtx.size(), false);
+    size_t nPicked = 0;
+    size_t nPrefillBytes = 0;
+    LOCK(pnode->cs_inventory);
+    for (size_t i = 1; i < block.vtx.size() && i <= std::numeric_limits<uint16_t>::max(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (pnode->filterInventoryKnown.contains(tx.GetHash()))
+            continue;
+        size_t nTxSize = tx.GetTotalSize();
+        if (nPrefillBytes + nTxSize > MAX_CMPCTBLOCK_PREFILL_BYTES)
+            continue;
+        nPrefillBytes += nTxSize;
+        vPrefill[i] = true;
+        nPicked++;
+    }
+    return nPicked;
+}
+
+/**
+ * Send a block to pnode as a compact block, prefilled with the transactions
+ * it likely misses. Peers with nothing to prefill share the encoding kept in
+ * g_block_msg_cache. Returns the number of transactions prefilled.
+ */
+static size_t SendCompactBlock(CNode* pnode, bool fWantsCmpctWitness, const CBlock& block, CConnman* connman)
+{
+    std::vector<bool> vPrefill;
+    size_t nPrefill = PredictMissingTransactions(pnode, block, vPrefill);
+
+    if (nPrefill == 0) {
+        CSharedNetMsg msg = g_block_msg_cache.GetMessage(block.GetHash(), fWantsCmpctWitness ? BlockEncoding::WITNESS_CMPCTBLOCK : BlockEncoding::CMPCTBLOCK);
+        if (msg.header) {
+            connman->PushMessage(pnode, msg);
+            return 0;
+        }
+    }
+    const CNetMsgMaker msgMaker(pnode->GetSendVersion());
+    int nSendFlags = fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+    CBlockHeaderAndShortTxIDs cmpctblock(block, fWantsCmpctWitness, vPrefill);
+    connman->PushMessage(pnode, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+    return nPrefill;
+}
+
+/** SendCompactBlock, counted in the peer's statistics. Requires cs_main. */
+static void PushCompactBlock(CNode* pnode, CNodeState& state, const CBlock& block, CConnman* connman)
+{
+    state.nCmpctBlocksSent++;
+    state.nCmpctPrefilledTxSent += SendCompactBlock(pnode, state.fWantsCmpctWitness, block, connman);
+}
+
+// The most recently announced block, protected by cs_most_recent_block.
+// Its encodings, and those of the blocks before it, are in g_block_msg_cache.
 static CCriticalSection cs_most_recent_block;
 static std::shared_ptr<const CBlock> most_recent_block;
-static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block;
-static uint256 most_recent_block_hash;
-static bool fWitnessesPresentInMostRecentCompactBlock;
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block 
  * to compatible peers.
  */
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
-    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
-    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    g_block_msg_cache.Add(pblock);
 
-    LOCK(cs_main);
+    // The peers to announce the block to, and whether they want witnesses
+    std::vector<std::pair<CNode*, bool>> vAnnounce;
+    {
+        LOCK(cs_main);
 
-    static int nHighestFastAnnounce = 0;
-    if (pindex->nHeight <= nHighestFastAnnounce)
-        return;
-    nHighestFastAnnounce = pindex->nHeight;
+        static int nHighestFastAnnounce = 0;
+        if (pindex->nHeight <= nHighestFastAnnounce)
+            return;
+        nHighestFastAnnounce = pindex->nHeight;
 
-    bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, Params().GetConsensus());
-    uint256 hashBlock(pblock->GetHash());
+        bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, Params().GetConsensus());
+        uint256 hashBlock(pblock->GetHash());
 
-    {
-        LOCK(cs_most_recent_block);
-        most_recent_block_hash = hashBlock;
-        most_recent_block = pblock;
-        most_recent_compact_block = pcmpctblock;
-        fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
+        {
+            LOCK(cs_most_recent_block);
+            most_recent_block = pblock;
+        }
+
+        connman->ForEachNode([pindex, fWitnessEnabled, &hashBlock, &vAnnounce](CNode* pnode) {
+            if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
+                return;
+            ProcessBlockAvailability(pnode->GetId());
+            CNodeState &state = *State(pnode->GetId());
+            // If the peer has, or we announced to them the previous block already,
+            // but we don't think they have this one, go ahead and announce it
+            if (state.fPreferHeaderAndIDs && (!fWitnessEnabled || state.fWantsCmpctWitness) &&
+                    !PeerHasHeader(&state, pindex) && PeerHasHeader(&state, pindex->pprev)) {
+
+                LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
+                        hashBlock.ToString(), pnode->GetId());
+                state.nCmpctBlocksSent++;
+                state.pindexBestHeaderSent = pindex;
+                vAnnounce.emplace_back(pnode->AddRef(), state.fWantsCmpctWitness);
+            }
+        });
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
-        // TODO: Avoid the repeated-serialization here
-        if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
-            return;
-        ProcessBlockAvailability(pnode->GetId());
-        CNodeState &state = *State(pnode->GetId());
-        // If the peer has, or we announced to them the previous block already,
-        // but we don't think they have this one, go ahead and announce it
-        if (state.fPreferHeaderAndIDs && (!fWitnessEnabled || state.fWantsCmpctWitness) &&
-                !PeerHasHeader(&state, pindex) && PeerHasHeader(&state, pindex->pprev)) {
-
-            LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
-                    hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
-            state.pindexBestHeaderSent = pindex;
-        }
-    });
+    // Predicting and prefilling the missing transactions is done per peer, so
+    // build the compact blocks without holding up every other peer on cs_vNodes
+    std::vector<std::pair<NodeId, size_t>> vPrefilled;
+    for (const std::pair<CNode*, bool>& announce : vAnnounce) {
+        vPrefilled.emplace_back(announce.first->GetId(), SendCompactBlock(announce.first, announce.second, *pblock, connman));
+        announce.first->Release();
+    }
+
+    LOCK(cs_main);
+    for (const std::pair<NodeId, size_t>& prefilled : vPrefilled) {
+        CNodeState* state = State(prefilled.first);
+        if (state)
+            state->nCmpctPrefilledTxSent += prefilled.second;
+    }
 }
 
 /**
@@ -1066,13 +1173,9 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
 {
     bool send = false;
     std::shared_ptr<const CBlock> a_recent_block;
-    std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
-    bool fWitnessesPresentInARecentCompactBlock;
     {
         LOCK(cs_most_recent_block);
         a_recent_block = most_recent_block;
-        a_recent_compact_block = most_recent_compact_block;
-        fWitnessesPresentInARecentCompactBlock = fWitnessesPresentInMostRecentCompactBlock;
     }
 
     bool need_activate_chain = false;
@@ -1131,8 +1234,24 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
     if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
     {
         std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
+        std::vector<unsigned char> vRawBlock;
+        CSharedNetMsg msgCachedBlock;
+        // Blocks are stored with witnesses, and cannot have any before segwit activates
+        const bool fSendRaw = inv.type == MSG_WITNESS_BLOCK || (inv.type == MSG_BLOCK && !IsWitnessEnabled(mi->second->pprev, consensusParams));
+        // A block message missing from the cache means the block is too, so
+        // only look it up once
+        const bool fCachedMsg = inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK;
+        if (fCachedMsg) {
+            msgCachedBlock = g_block_msg_cache.GetMessage(inv.hash, inv.type == MSG_WITNESS_BLOCK ? BlockEncoding::WITNESS_BLOCK : BlockEncoding::BLOCK);
+        }
+        if (msgCachedBlock.header) {
+            // Serialized once for all the peers asking for it
+        } else if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
             pblock = a_recent_block;
+        } else if (!fCachedMsg && (pblock = g_block_msg_cache.GetBlock(inv.hash))) {
+            // Recent block, still in memory
+        } else if (fSendRaw && ReadRawBlockFromDisk(vRawBlock, (*mi).second, Params().MessageStart())) {
+            // Send the block as stored, without deserializing it
         } else {
             // Send block from disk
             std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
@@ -1140,7 +1259,14 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
                 assert(!"cannot load block from disk");
             pblock = pblockRead;
         }
-        if (inv.type == MSG_BLOCK)
+        if (msgCachedBlock.header) {
+            connman->PushMessage(pfrom, msgCachedBlock);
+        } else if (!vRawBlock.empty()) {
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            msg.data = std::move(vRawBlock);
+            connman->PushMessage(pfrom, std::move(msg));
+        } else if (inv.type == MSG_BLOCK)
             connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
         else if (inv.type == MSG_WITNESS_BLOCK)
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
@@ -1179,12 +1305,7 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
             bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
             int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
             if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == mi->second->GetBlockHash()) {
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
-                } else {
-                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                }
+                PushCompactBlock(pfrom, *State(pfrom->GetId()), *pblock, connman);
             } else {
                 connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
             }
@@ -1290,8 +1411,10 @@ inline void static SendBlockTransactions(const CBlock& block, const BlockTransac
         resp.txn[i] = block.vtx[req.indexes[i]];
     }
     LOCK(cs_main);
+    CNodeState* state = State(pfrom->GetId());
+    state->nBlockTxnRequestsReceived++;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    int nSendFlags = State(pfrom->GetId())->fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+    int nSendFlags = state->fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
     connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
@@ -2032,13 +2155,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         BlockTransactionsRequest req;
         vRecv >> req;
 
-        std::shared_ptr<const CBlock> recent_block;
-        {
-            LOCK(cs_most_recent_block);
-            if (most_recent_block_hash == req.blockhash)
-                recent_block = most_recent_block;
-            // Unlock cs_most_recent_block to avoid cs_main lock inversion
-        }
+        std::shared_ptr<const CBlock> recent_block = g_block_msg_cache.GetBlock(req.blockhash);
         if (recent_block) {
             SendBlockTransactions(*recent_block, req, pfrom, connman);
             return true;
@@ -2118,7 +2235,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
         for (; pindex; pindex = chainActive.Next(pindex))
         {
-            vHeaders.push_back(pindex->GetBlockHeader());
+            if (!AppendBlockHeader(vHeaders, pindex))
+                return true;
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
                 break;
         }
@@ -2456,6 +2574,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     if (!partialBlock.IsTxAvailable(i))
                         req.indexes.push_back(i);
                 }
+                nodestate->nCmpctBlocksReceived++;
                 if (req.indexes.empty()) {
                     // Dirty hack to jump to BLOCKTXN code (TODO: move message handling into their own functions)
                     BlockTransactions txn;
@@ -2464,6 +2583,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     fProcessBLOCKTXN = true;
                 } else {
                     req.blockhash = pindex->GetBlockHash();
+                    nodestate->nBlockTxnRequestsSent++;
                     connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
                 }
             } else {
@@ -3351,14 +3471,20 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     pBestIndex = pindex;
                     if (fFoundStartingHeader) {
                         // add this to the headers message
-                        vHeaders.push_back(pindex->GetBlockHeader());
+                        if (!AppendBlockHeader(vHeaders, pindex)) {
+                            fRevertToInv = true;
+                            break;
+                        }
                     } else if (PeerHasHeader(&state, pindex)) {
                         continue; // keep looking for the first new block
                     } else if (pindex->pprev == nullptr || PeerHasHeader(&state, pindex->pprev)) {
                         // Peer doesn't have this header but they do have the prior one.
                         // Start sending headers.
                         fFoundStartingHeader = true;
-                        vHeaders.push_back(pindex->GetBlockHeader());
+                        if (!AppendBlockHeader(vHeaders, pindex)) {
+                            fRevertToInv = true;
+                            break;
+                        }
                     } else {
                         // Peer doesn't have this header or the prior one -- nothing will
                         // connect, so bail out.
@@ -3374,28 +3500,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", __func__,
                             vHeaders.front().GetHash().ToString(), pto->GetId());
 
-                    int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-
-                    bool fGotBlockFromCache = false;
-                    {
-                        LOCK(cs_most_recent_block);
-                        if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
-                            else {
-                                CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                            }
-                            fGotBlockFromCache = true;
-                        }
-                    }
-                    if (!fGotBlockFromCache) {
-                        CBlock block;
-                        bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
+                    std::shared_ptr<const CBlock> pblock = g_block_msg_cache.GetBlock(pBestIndex->GetBlockHash());
+                    if (!pblock) {
+                        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+                        bool ret = ReadBlockFromDisk(*pblockRead, pBestIndex, consensusParams);
                         assert(ret);
-                        CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
-                        connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                        pblock = pblockRead;
                     }
+                    PushCompactBlock(pto, state, *pblock, connman);
                     state.pindexBestHeaderSent = pBestIndex;
                 } else if (state.fPreferHeaders) {
                     if (vHeaders.size() > 1) {
@@ -18,6 +18,9 @@ static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** Maximum size of the transactions, besides the coinbase, prefilled in a compact
+ *  block because the peer is not known to have them */
+static const unsigned int MAX_CMPCTBLOCK_PREFILL_BYTES = 100000;
 /** Headers download timeout expressed in microseconds
  *  Timeout = base + per_header * (expected number of headers) */
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
@@ -90,6 +93,11 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    uint64_t nCmpctBlocksSent;
+    uint64_t nCmpctPrefilledTxSent;
+    uint64_t nBlockTxnRequestsReceived;
+    uint64_t nCmpctBlocksReceived;
+    uint64_t nBlockTxnRequestsSent;
 };
 
 /** Get statistics from node state */
@@ -19,6 +19,8 @@
 
 extern int nConnectTimeout;
 extern bool fNameLookup;
+/** Refuse sockets at or above FD_SETSIZE, for when the socket handler waits on them with select() */
+extern bool fSelectableSocketsOnly;
 
 //! -timeout default
 static const int DEFAULT_CONNECT_TIMEOUT = 5000;
@@ -75,25 +75,52 @@ unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nF
     return bnNew.GetCompact();
 }
 
+namespace {
+
+/** Serializes straight into an Equihash hash state, so no intermediate buffer is needed. */
+class CEquihashStateWriter
+{
+private:
+    CBLAKE2b& state;
+
+    const int nType;
+    const int nVersion;
+public:
+
+    CEquihashStateWriter(CBLAKE2b& stateIn, int nTypeIn, int nVersionIn) : state(stateIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    int GetType() const { return nType; }
+    int GetVersion() const { return nVersion; }
+
+    void write(const char *pch, size_t size) {
+        state.Write((const unsigned char*)pch, size);
+    }
+
+    template<typename T>
+    CEquihashStateWriter& operator<<(const T& obj) {
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+};
+
+} // namespace
+
 bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
 {
     unsigned int n = params.EquihashN();
     unsigned int k = params.EquihashK();
 
     // Hash state
-    crypto_generichash_blake2b_state state;
+    CBLAKE2b state(CBLAKE2b::MAX_OUTPUT_SIZE);
     EhInitialiseState(n, k, state);
 
     // I = the block header minus nonce and solution.
     CEquihashInput I{*pblock};
-    // I||V
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    // H(I||V||...
+    CEquihashStateWriter ss(state, SER_NETWORK, PROTOCOL_VERSION);
     ss << I;
     ss << pblock->nNonce;
 
-    // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
-
     bool isValid;
     EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
     if (!isValid)
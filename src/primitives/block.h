@@ -126,26 +126,26 @@ public:
 
 /**
  * Custom serializer for CBlockHeader that omits the nonce and solution, for use
- * as input to Equihash.
+ * as input to Equihash. Refers to the header rather than copying it, so the
+ * solution is not duplicated on every check.
  */
-class CEquihashInput : private CBlockHeader
+class CEquihashInput
 {
+private:
+    const CBlockHeader& header;
+
 public:
-    CEquihashInput(const CBlockHeader &header)
-    {
-        CBlockHeader::SetNull();
-        *((CBlockHeader*)this) = header;
-    }
+    CEquihashInput(const CBlockHeader &headerIn) : header(headerIn) {}
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(this->nVersion);
-        READWRITE(hashPrevBlock);
-        READWRITE(hashMerkleRoot);
-        READWRITE(nTime);
-        READWRITE(nBits);
+        READWRITE(header.nVersion);
+        READWRITE(header.hashPrevBlock);
+        READWRITE(header.hashMerkleRoot);
+        READWRITE(header.nTime);
+        READWRITE(header.nBits);
     }
 };
 
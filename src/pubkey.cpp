@@ -6,13 +6,75 @@
 #include <pubkey.h>
 
 #include <ed25519/ed25519.h>
+#include <pubkeycache.h>
 
 bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
     if (!IsValid())
         return false;
+    if (g_pubkey_cache.IsEnabled()) {
+        unsigned char expanded[ED25519_EXPANDED_PUBLIC_KEY_SIZE];
+        if (!g_pubkey_cache.Expand(*this, expanded))
+            return false;
+        return ed25519_verify_expanded(vchSig.data(), hash.begin(), hash.size(), begin(), expanded) > 0;
+    }
     return ed25519_verify(vchSig.data(), hash.begin(), hash.size(), begin()) > 0;
 }
 
+bool CPubKey::VerifyBatch(const std::vector<CPubKeyBatchEntry>& entries, std::vector<bool>& valid) {
+    valid.assign(entries.size(), false);
+
+    std::vector<size_t> batched;
+    std::vector<const unsigned char*> sigs, msgs, keys, expanded_keys;
+    std::vector<size_t> msg_lens;
+    batched.reserve(entries.size());
+    sigs.reserve(entries.size());
+    msgs.reserve(entries.size());
+    keys.reserve(entries.size());
+    msg_lens.reserve(entries.size());
+
+    // Expanded keys come from the pubkey cache; without it the batch decompresses each distinct key itself.
+    const bool fUseCache = g_pubkey_cache.IsEnabled();
+    std::vector<unsigned char> expanded;
+    if (fUseCache) {
+        expanded.resize(entries.size() * ED25519_EXPANDED_PUBLIC_KEY_SIZE);
+        expanded_keys.reserve(entries.size());
+    }
+
+    bool fAllValid = true;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const CPubKeyBatchEntry& entry = entries[i];
+        if (!entry.pubkey.IsValid() || entry.vchSig.size() != SIGNATURE_SIZE) {
+            // Leave anything unusual to the single-signature path.
+            valid[i] = entry.pubkey.Verify(entry.hash, entry.vchSig);
+            fAllValid &= valid[i];
+            continue;
+        }
+        if (fUseCache) {
+            unsigned char* expanded_key = expanded.data() + batched.size() * ED25519_EXPANDED_PUBLIC_KEY_SIZE;
+            if (!g_pubkey_cache.Expand(entry.pubkey, expanded_key)) {
+                fAllValid = false;
+                continue;
+            }
+            expanded_keys.push_back(expanded_key);
+        }
+        batched.push_back(i);
+        sigs.push_back(entry.vchSig.data());
+        msgs.push_back(entry.hash.begin());
+        msg_lens.push_back(entry.hash.size());
+        keys.push_back(entry.pubkey.begin());
+    }
+    if (batched.empty())
+        return fAllValid;
+
+    std::vector<int> results(batched.size());
+    ed25519_verify_batch(sigs.data(), msgs.data(), msg_lens.data(), keys.data(), fUseCache ? expanded_keys.data() : nullptr, batched.size(), results.data());
+    for (size_t i = 0; i < batched.size(); i++) {
+        valid[batched[i]] = results[i] > 0;
+        fAllValid &= valid[batched[i]];
+    }
+    return fAllValid;
+}
+
 bool CPubKey::IsFullyValid() const {
     return ed25519_verify_pubkey(begin());
 }
@@ -31,6 +31,8 @@ public:
 
 typedef uint256 ChainCode;
 
+struct CPubKeyBatchEntry;
+
 /** An encapsulated public key. */
 class CPubKey
 {
@@ -147,6 +149,13 @@ public:
      */
     bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
 
+    /**
+     * Verify several signatures at once, sharing work between them.
+     * valid[i] is set to what entries[i].pubkey.Verify(entries[i].hash, entries[i].vchSig)
+     * would return. Returns true if all signatures are valid.
+     */
+    static bool VerifyBatch(const std::vector<CPubKeyBatchEntry>& entries, std::vector<bool>& valid);
+
     // ed25519的签名没有延展性问题，所以无需检测S
 
     // ed25519没有ecdsa这种从签名恢复公钥的特性，所以删除RecoverCompact
@@ -155,6 +164,16 @@ public:
     bool Derive(CPubKey& pubkeyChild, ChainCode &ccChild, unsigned int nChild, const ChainCode& cc) const;
 };
 
+/** A signature to be checked by CPubKey::VerifyBatch. */
+struct CPubKeyBatchEntry
+{
+    CPubKey pubkey;
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+
+    CPubKeyBatchEntry(const CPubKey& pubkeyIn, const uint256& hashIn, const std::vector<unsigned char>& vchSigIn) : pubkey(pubkeyIn), hash(hashIn), vchSig(vchSigIn) {}
+};
+
 struct CExtPubKey {
     unsigned char nDepth;
     unsigned char vchFingerprint[4];
@@ -0,0 +1,117 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pubkeycache.h>
+
+#include <hash.h>
+#include <uint256.h>
+
+#include <algorithm>
+#include <string.h>
+
+CPubKeyCache g_pubkey_cache;
+
+CPubKeyCache::CPubKeyCache() : nMask(0), k0(0), k1(0), nHits(0), nMisses(0), nUsed(0) {}
+
+CPubKeyCache::~CPubKeyCache() {}
+
+size_t CPubKeyCache::Setup(size_t nMaxBytes, uint64_t k0In, uint64_t k1In)
+{
+    size_t nEntries = 0;
+    if (nMaxBytes >= sizeof(Slot)) {
+        nEntries = 1;
+        while (nEntries * 2 <= nMaxBytes / sizeof(Slot))
+            nEntries *= 2;
+    }
+
+    slots.reset(nEntries ? new Slot[nEntries] : nullptr);
+    for (size_t i = 0; i < nEntries; i++) {
+        slots[i].seq.store(0, std::memory_order_relaxed);
+        for (auto& word : slots[i].key)
+            word.store(0, std::memory_order_relaxed);
+        for (auto& word : slots[i].expanded)
+            word.store(0, std::memory_order_relaxed);
+    }
+    nMask = nEntries ? nEntries - 1 : 0;
+    k0 = k0In;
+    k1 = k1In;
+    nHits = 0;
+    nMisses = 0;
+    nUsed = 0;
+    return nEntries;
+}
+
+bool CPubKeyCache::Lookup(Slot& slot, const uint64_t* key, unsigned char* expanded) const
+{
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq & 1)
+        return false;
+    for (size_t i = 0; i < KEY_WORDS; i++) {
+        if (slot.key[i].load(std::memory_order_relaxed) != key[i])
+            return false;
+    }
+    for (size_t i = 0; i < EXPANDED_WORDS; i++) {
+        uint64_t word = slot.expanded[i].load(std::memory_order_relaxed);
+        size_t offset = i * 8;
+        memcpy(expanded + offset, &word, std::min<size_t>(8, ED25519_EXPANDED_PUBLIC_KEY_SIZE - offset));
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // An empty slot has a zero key, which is a valid point, but never a nonzero backend tag.
+    return slot.seq.load(std::memory_order_relaxed) == seq && expanded[0] != 0;
+}
+
+void CPubKeyCache::Insert(Slot& slot, const uint64_t* key, const unsigned char* expanded)
+{
+    uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+    if ((seq & 1) || !slot.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_relaxed))
+        return;
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (slot.expanded[0].load(std::memory_order_relaxed) == 0)
+        nUsed.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < KEY_WORDS; i++)
+        slot.key[i].store(key[i], std::memory_order_relaxed);
+    for (size_t i = 0; i < EXPANDED_WORDS; i++) {
+        uint64_t word = 0;
+        size_t offset = i * 8;
+        memcpy(&word, expanded + offset, std::min<size_t>(8, ED25519_EXPANDED_PUBLIC_KEY_SIZE - offset));
+        slot.expanded[i].store(word, std::memory_order_relaxed);
+    }
+
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+bool CPubKeyCache::Expand(const CPubKey& pubkey, unsigned char* expanded)
+{
+    if (!slots)
+        return ed25519_expand_public_key(expanded, pubkey.begin());
+
+    uint256 keyhash;
+    memcpy(keyhash.begin(), pubkey.begin(), CPubKey::PUBLIC_KEY_SIZE);
+    Slot& slot = slots[SipHashUint256(k0, k1, keyhash) & nMask];
+    uint64_t key[KEY_WORDS];
+    memcpy(key, pubkey.begin(), sizeof(key));
+
+    if (Lookup(slot, key, expanded)) {
+        nHits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    nMisses.fetch_add(1, std::memory_order_relaxed);
+
+    if (!ed25519_expand_public_key(expanded, pubkey.begin()))
+        return false;
+    Insert(slot, key, expanded);
+    return true;
+}
+
+CPubKeyCache::Stats CPubKeyCache::GetStats() const
+{
+    Stats stats;
+    stats.nHits = nHits.load(std::memory_order_relaxed);
+    stats.nMisses = nMisses.load(std::memory_order_relaxed);
+    stats.nEntries = slots ? nMask + 1 : 0;
+    stats.nUsed = nUsed.load(std::memory_order_relaxed);
+    stats.nBytes = stats.nEntries * sizeof(Slot);
+    return stats;
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PUBKEYCACHE_H
+#define BITCOIN_PUBKEYCACHE_H
+
+#include <pubkey.h>
+#include <ed25519/ed25519.h>
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+/**
+ * Public keys in the form ed25519_verify_expanded takes: decompressed (which
+ * costs a field exponentiation) and with the table of odd multiples used by
+ * the verification ladder already computed.
+ *
+ * The cache is direct-mapped on a salted SipHash of the key and every miss
+ * overwrites its slot, so keys that keep showing up (exchange and pool
+ * addresses) stay resident while one-off keys cycle through. Lookups and
+ * inserts are lock-free: each slot is a sequence lock, a reader that sees the
+ * slot change under it treats the lookup as a miss, and a writer that finds
+ * the slot busy skips the insert.
+ */
+class CPubKeyCache
+{
+public:
+    struct Stats {
+        uint64_t nHits;
+        uint64_t nMisses;
+        size_t nEntries;
+        size_t nUsed;
+        size_t nBytes;
+    };
+
+    CPubKeyCache();
+    ~CPubKeyCache();
+
+    /** Replace the cache by an empty one using at most nMaxBytes, zero disables it.
+     *  Must not run concurrently with Expand. Returns the number of entries. */
+    size_t Setup(size_t nMaxBytes, uint64_t k0, uint64_t k1);
+
+    bool IsEnabled() const { return slots != nullptr; }
+
+    /** Write the ED25519_EXPANDED_PUBLIC_KEY_SIZE byte expansion of pubkey to expanded,
+     *  from the cache if possible. Returns false if pubkey is not a valid point;
+     *  those are never cached. */
+    bool Expand(const CPubKey& pubkey, unsigned char* expanded);
+
+    Stats GetStats() const;
+
+private:
+    static const size_t KEY_WORDS = CPubKey::PUBLIC_KEY_SIZE / 8;
+    static const size_t EXPANDED_WORDS = (ED25519_EXPANDED_PUBLIC_KEY_SIZE + 7) / 8;
+
+    struct Slot {
+        /** Odd while a writer is updating the slot. */
+        std::atomic<uint64_t> seq;
+        std::atomic<uint64_t> key[KEY_WORDS];
+        std::atomic<uint64_t> expanded[EXPANDED_WORDS];
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t nMask;
+    uint64_t k0, k1;
+
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+    std::atomic<size_t> nUsed;
+
+    bool Lookup(Slot& slot, const uint64_t* key, unsigned char* expanded) const;
+    void Insert(Slot& slot, const uint64_t* key, const unsigned char* expanded);
+};
+
+/** The cache behind CPubKey::Verify and CPubKey::VerifyBatch. Disabled until set up by InitSignatureCache. */
+extern CPubKeyCache g_pubkey_cache;
+
+#endif // BITCOIN_PUBKEYCACHE_H
@@ -145,7 +145,9 @@ static bool rest_headers(HTTPRequest* req,
 
     std::vector<const CBlockIndex *> headers;
     headers.reserve(count);
-    {
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    UniValue jsonHeaders(UniValue::VARR);
+    try {
         LOCK(cs_main);
         BlockMap::const_iterator it = mapBlockIndex.find(hash);
         const CBlockIndex *pindex = (it != mapBlockIndex.end()) ? it->second : nullptr;
@@ -155,11 +157,17 @@ static bool rest_headers(HTTPRequest* req,
                 break;
             pindex = chainActive.Next(pindex);
         }
-    }
 
-    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
-    for (const CBlockIndex *pindex : headers) {
-        ssHeader << pindex->GetBlockHeader();
+        // Solutions may be trimmed from the block index once cs_main is
+        // released, so the headers are serialized while it is held.
+        for (const CBlockIndex *pindex : headers) {
+            if (rf == RF_JSON)
+                jsonHeaders.push_back(blockheaderToJSON(pindex));
+            else
+                ssHeader << pindex->GetBlockHeader();
+        }
+    } catch (const std::runtime_error& e) {
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, e.what());
     }
 
     switch (rf) {
@@ -177,13 +185,6 @@ static bool rest_headers(HTTPRequest* req,
         return true;
     }
     case RF_JSON: {
-        UniValue jsonHeaders(UniValue::VARR);
-        {
-            LOCK(cs_main);
-            for (const CBlockIndex *pindex : headers) {
-                jsonHeaders.push_back(blockheaderToJSON(pindex));
-            }
-        }
         std::string strJSON = jsonHeaders.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
@@ -210,6 +211,7 @@ static bool rest_block(HTTPRequest* req,
 
     CBlock block;
     CBlockIndex* pblockindex = nullptr;
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -219,13 +221,17 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        // The binary and hex formats are the stored bytes, unless witnesses are to be left out
+        std::vector<unsigned char> vRawBlock;
+        if (rf != RF_JSON && RPCSerializationFlags() == 0 && ReadRawBlockFromDisk(vRawBlock, pblockindex, Params().MessageStart())) {
+            ssBlock.write((const char*)vRawBlock.data(), vRawBlock.size());
+        } else if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        } else {
+            ssBlock << block;
+        }
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
         std::string binaryBlock = ssBlock.str();
@@ -6,17 +6,22 @@
 #include <rpc/blockchain.h>
 
 #include <amount.h>
+#include <blockmsgcache.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <coins.h>
 #include <consensus/validation.h>
+#include <crypto/lthash.h>
 #include <validation.h>
 #include <core_io.h>
+#include <init.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
+#include <pubkeycache.h>
 #include <rpc/server.h>
+#include <script/sigcache.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -33,8 +38,10 @@
 
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <thread>
 
 struct CUpdatedBlock
 {
@@ -101,7 +108,7 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.pushKV("time", (int64_t)blockindex->nTime);
     result.pushKV("mediantime", (int64_t)blockindex->GetMedianTimePast());
     result.pushKV("nonce", blockindex->nNonce.GetHex());
-    result.pushKV("solution", HexStr(blockindex->nSolution));
+    result.pushKV("solution", HexStr(blockindex->GetSolution()));
     result.pushKV("bits", strprintf("%08x", blockindex->nBits));
     result.pushKV("difficulty", GetDifficulty(blockindex));
     result.pushKV("chainwork", blockindex->nChainWork.GetHex());
@@ -716,15 +723,19 @@ UniValue getblockheader(const JSONRPCRequest& request)
 
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
-    if (!fVerbose)
-    {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << pblockindex->GetBlockHeader();
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
-    }
+    try {
+        if (!fVerbose)
+        {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+            ssBlock << pblockindex->GetBlockHeader();
+            std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+            return strHex;
+        }
 
-    return blockheaderToJSON(pblockindex);
+        return blockheaderToJSON(pblockindex);
+    } catch (const std::runtime_error& e) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, e.what());
+    }
 }
 
 UniValue getblock(const JSONRPCRequest& request)
@@ -799,7 +810,23 @@ UniValue getblock(const JSONRPCRequest& request)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+    if (verbosity <= 0) {
+        // Recent blocks are likely serialized already for the peers asking for them
+        CSharedNetMsg msg = g_block_msg_cache.GetMessage(hash, RPCSerializationFlags() == 0 ? BlockEncoding::WITNESS_BLOCK : BlockEncoding::BLOCK);
+        if (msg.payload)
+            return HexStr(msg.payload->begin(), msg.payload->end());
+    }
+
+    // The stored bytes are what verbosity 0 returns, unless witnesses are to be left out
+    std::vector<unsigned char> vRawBlock;
+    if (verbosity <= 0 && RPCSerializationFlags() == 0 && ReadRawBlockFromDisk(vRawBlock, pblockindex, Params().MessageStart())) {
+        return HexStr(vRawBlock.begin(), vRawBlock.end());
+    }
+
+    std::shared_ptr<const CBlock> pblockCached = verbosity > 0 ? g_block_msg_cache.GetBlock(hash) : nullptr;
+    if (pblockCached)
+        block = *pblockCached;
+    else if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
         // non-whitelisted node sends us an unrequested long chain of valid
@@ -818,20 +845,6 @@ UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nBogoSize;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
-};
-
 static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
@@ -889,6 +902,128 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
     return true;
 }
 
+//! Maximum number of threads scanning the UTXO set at once
+static const int MAX_UTXO_SCAN_THREADS = 8;
+//! Format version of dumptxoutset files
+static const uint64_t UTXO_DUMP_VERSION = 1;
+
+/** What one thread of GetUTXOStatsParallel has seen. */
+struct CCoinsScanPart
+{
+    CCoinsStats stats;
+    LtHash16 hash;
+    bool fOk = true;
+};
+
+/**
+ * Calculate statistics about the unspent transaction output set, hashing
+ * it as an unordered set so that ranges of it can be scanned in parallel.
+ * If file is given, each coin is also written to it as an outpoint and
+ * coin pair, in no particular order.
+ */
+static bool GetUTXOStatsParallel(CCoinsViewDB *view, CCoinsStats &stats, CAutoFile *file = nullptr)
+{
+    // More ranges than threads, so that threads finishing early take over work.
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors = view->RangeCursors(256);
+    if (cursors.empty())
+        return false;
+    stats.hashBlock = cursors[0]->GetBestBlock();
+    if (stats.hashBlock.IsNull())
+        return false;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(stats.hashBlock);
+        if (it == mapBlockIndex.end())
+            return false;
+        stats.nHeight = it->second->nHeight;
+    }
+
+    int nThreads = std::max(1, std::min(GetNumCores(), MAX_UTXO_SCAN_THREADS));
+    std::vector<CCoinsScanPart> parts(nThreads);
+    std::atomic<size_t> nNext(0);
+    std::atomic<bool> fAbort(false);
+    std::mutex cs_file;
+    auto scan = [&](CCoinsScanPart& part) {
+        CDataStream ssCoin(SER_DISK, CLIENT_VERSION);
+        CDataStream ssOut(SER_DISK, CLIENT_VERSION);
+        try {
+            for (size_t i = nNext++; i < cursors.size(); i = nNext++) {
+                CCoinsViewCursor *pcursor = cursors[i].get();
+                uint256 prevkey;
+                bool fFirst = true;
+                while (pcursor->Valid()) {
+                    if (fAbort || ShutdownRequested()) {
+                        part.fOk = false;
+                        fAbort = true;
+                        return;
+                    }
+                    COutPoint key;
+                    Coin coin;
+                    if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+                        LogPrintf("GetUTXOStatsParallel: unable to read value\n");
+                        part.fOk = false;
+                        fAbort = true;
+                        return;
+                    }
+                    // All outputs of a transaction are in the same range.
+                    if (fFirst || key.hash != prevkey) {
+                        part.stats.nTransactions++;
+                        prevkey = key.hash;
+                        fFirst = false;
+                    }
+                    ssCoin.clear();
+                    ssCoin << key << coin;
+                    part.hash.Insert((const unsigned char*)ssCoin.data(), ssCoin.size());
+                    part.stats.nTransactionOutputs++;
+                    part.stats.nTotalAmount += coin.out.nValue;
+                    part.stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+                                            2 /* scriptPubKey len */ + coin.out.scriptPubKey.size() /* scriptPubKey */;
+                    if (file) {
+                        ssOut.write(ssCoin.data(), ssCoin.size());
+                        if (ssOut.size() > (1 << 20)) {
+                            std::lock_guard<std::mutex> lock(cs_file);
+                            file->write(ssOut.data(), ssOut.size());
+                            ssOut.clear();
+                        }
+                    }
+                    pcursor->Next();
+                }
+            }
+            if (file && !ssOut.empty()) {
+                std::lock_guard<std::mutex> lock(cs_file);
+                file->write(ssOut.data(), ssOut.size());
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("GetUTXOStatsParallel: %s\n", e.what());
+            part.fOk = false;
+            fAbort = true;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++) {
+        threads.emplace_back(scan, std::ref(parts[i]));
+    }
+    scan(parts[0]);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    LtHash16 hash;
+    for (const CCoinsScanPart& part : parts) {
+        if (!part.fOk)
+            return false;
+        stats.nTransactions += part.stats.nTransactions;
+        stats.nTransactionOutputs += part.stats.nTransactionOutputs;
+        stats.nTotalAmount += part.stats.nTotalAmount;
+        stats.nBogoSize += part.stats.nBogoSize;
+        hash += part.hash;
+    }
+    hash.Finalize(stats.hashSerialized.begin());
+    stats.nDiskSize = view->EstimateSize();
+    return true;
+}
+
 UniValue pruneblockchain(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -940,11 +1075,16 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
             "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"   (string, optional, default=\"hash_serialized_2\") Which UTXO set hash to calculate:\n"
+            "                  \"hash_serialized_2\" hashes the set in order on one thread;\n"
+            "                  \"lthash\" hashes it as an unordered set on several threads. The result is kept,\n"
+            "                  so later calls at the same best block return at once.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -952,26 +1092,52 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (only with hash_type \"hash_serialized_2\")\n"
+            "  \"lthash\": \"hash\",      (string) The unordered set hash (only with hash_type \"lthash\")\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"lthash\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    std::string hash_type = "hash_serialized_2";
+    if (!request.params[0].isNull()) {
+        hash_type = request.params[0].get_str();
+    }
+    if (hash_type != "hash_serialized_2" && hash_type != "lthash") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + hash_type);
+    }
+
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
     FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
+    bool fOk;
+    if (hash_type == "lthash") {
+        fOk = pcoinsdbview->ReadCoinsStats(stats) && stats.hashBlock == pcoinsdbview->GetBestBlock();
+        if (fOk) {
+            stats.nDiskSize = pcoinsdbview->EstimateSize();
+        } else {
+            stats = CCoinsStats();
+            fOk = GetUTXOStatsParallel(pcoinsdbview.get(), stats);
+            if (fOk) {
+                pcoinsdbview->WriteCoinsStats(stats);
+            }
+        }
+        boost::this_thread::interruption_point();
+    } else {
+        fOk = GetUTXOStats(pcoinsdbview.get(), stats);
+    }
+    if (fOk) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
         ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
-        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        ret.pushKV(hash_type, stats.hashSerialized.GetHex());
         ret.pushKV("disk_size", stats.nDiskSize);
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
     } else {
@@ -980,6 +1146,79 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction output set to a file, reading it on several threads.\n"
+            "The file holds the format version, the best block hash and height and the number of\n"
+            "coins, followed by each outpoint and coin in no particular order.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write; relative paths are prefixed by the data directory\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,     (numeric) The number of coins written\n"
+            "  \"base_hash\": \"hex\",    (string) The block the coins are at\n"
+            "  \"base_height\": n,       (numeric) The height of that block\n"
+            "  \"lthash\": \"hash\",      (string) The unordered set hash, as in gettxoutsetinfo \"lthash\"\n"
+            "  \"path\": \"path\"         (string) The absolute path of the file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    fs::path temppath = path.string() + ".incomplete";
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+
+    FILE* filestr = fsbridge::fopen(temppath, "wb");
+    if (!filestr) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to open " + temppath.string() + " for writing");
+    }
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+    CCoinsStats stats;
+    FlushStateToDisk();
+    bool fOk;
+    try {
+        // The header is written again once the number of coins is known.
+        file << UTXO_DUMP_VERSION << stats.hashBlock << stats.nHeight << stats.nTransactionOutputs;
+        fOk = GetUTXOStatsParallel(pcoinsdbview.get(), stats, &file);
+        if (fOk) {
+            fOk = fseek(file.Get(), 0, SEEK_SET) == 0;
+        }
+        if (fOk) {
+            file << UTXO_DUMP_VERSION << stats.hashBlock << stats.nHeight << stats.nTransactionOutputs;
+            FileCommit(file.Get());
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("dumptxoutset: %s\n", e.what());
+        fOk = false;
+    }
+    file.fclose();
+    if (!fOk) {
+        fs::remove(temppath);
+        boost::this_thread::interruption_point();
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write UTXO set to " + temppath.string());
+    }
+    if (!RenameOver(temppath, path)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to rename " + temppath.string() + " to " + path.string());
+    }
+    pcoinsdbview->WriteCoinsStats(stats);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_written", (int64_t)stats.nTransactionOutputs);
+    ret.pushKV("base_hash", stats.hashBlock.GetHex());
+    ret.pushKV("base_height", (int64_t)stats.nHeight);
+    ret.pushKV("lthash", stats.hashSerialized.GetHex());
+    ret.pushKV("path", path.string());
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1372,6 +1611,74 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+UniValue getpubkeycacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getpubkeycacheinfo\n"
+            "\nReturns details on the cache of decompressed public keys used by signature verification.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": xxxxx,            (numeric) Number of keys the cache can hold, 0 if it is disabled\n"
+            "  \"used\": xxxxx,               (numeric) Number of slots that hold a key\n"
+            "  \"usage\": xxxxx,              (numeric) Memory used by the cache\n"
+            "  \"hits\": xxxxx,               (numeric) Lookups answered from the cache since startup\n"
+            "  \"misses\": xxxxx,             (numeric) Lookups that had to decompress the key\n"
+            "  \"backend\": \"xxxx\"            (string) The ed25519 field arithmetic in use\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getpubkeycacheinfo", "")
+            + HelpExampleRpc("getpubkeycacheinfo", "")
+        );
+
+    CPubKeyCache::Stats stats = g_pubkey_cache.GetStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("entries", (int64_t) stats.nEntries);
+    ret.pushKV("used", (int64_t) stats.nUsed);
+    ret.pushKV("usage", (int64_t) stats.nBytes);
+    ret.pushKV("hits", (int64_t) stats.nHits);
+    ret.pushKV("misses", (int64_t) stats.nMisses);
+    ret.pushKV("backend", ed25519_backend_name());
+    return ret;
+}
+
+UniValue getvalidationinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getvalidationinfo\n"
+            "\nReturns where the node has spent its time checking block inputs since startup.\n"
+            "Signature counters include transactions accepted to the memory pool.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": xxxxx,               (numeric) Blocks connected\n"
+            "  \"inputs\": xxxxx,               (numeric) Inputs they spent, not counting coinbases\n"
+            "  \"assumevalid_inputs\": xxxxx,   (numeric) Inputs whose scripts were not checked because of -assumevalid\n"
+            "  \"coinfetch_ns\": xxxxx,         (numeric) Time spent fetching and checking the coins spent, in nanoseconds\n"
+            "  \"sigcache_hits\": xxxxx,        (numeric) Signatures found in the signature cache\n"
+            "  \"sigs_verified\": xxxxx,        (numeric) Signatures verified, alone or as part of a batch\n"
+            "  \"verify_ns\": xxxxx,            (numeric) Time spent verifying them, in nanoseconds, summed over the script check threads\n"
+            "  \"sighash_ns\": xxxxx            (numeric) Time spent computing signature hashes, in nanoseconds, summed likewise\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationinfo", "")
+            + HelpExampleRpc("getvalidationinfo", "")
+        );
+
+    BlockInputStats inputStats = GetBlockInputStats();
+    SignatureCheckStats sigStats = GetSignatureCheckStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("blocks", (int64_t) inputStats.nBlocks);
+    ret.pushKV("inputs", (int64_t) inputStats.nInputs);
+    ret.pushKV("assumevalid_inputs", (int64_t) inputStats.nAssumedValidInputs);
+    ret.pushKV("coinfetch_ns", (int64_t) inputStats.nCoinFetchNanos);
+    ret.pushKV("sigcache_hits", (int64_t) sigStats.nCacheHits);
+    ret.pushKV("sigs_verified", (int64_t) sigStats.nVerified);
+    ret.pushKV("verify_ns", (int64_t) sigStats.nVerifyNanos);
+    ret.pushKV("sighash_ns", (int64_t) sigStats.nSighashNanos);
+    return ret;
+}
+
 UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1582,6 +1889,7 @@ UniValue savemempool(const JSONRPCRequest& request)
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
@@ -1595,9 +1903,11 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
+    { "blockchain",         "getpubkeycacheinfo",     &getpubkeycacheinfo,     {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type"} },
+    { "blockchain",         "getvalidationinfo",      &getvalidationinfo,      {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
@@ -30,6 +30,7 @@
 #include <memory>
 #include <stdint.h>
 #include <crypto/equihash.h>
+#include <crypto/equihash_solver.h>
 
 extern UniValue getgenerate(const JSONRPCRequest& request); // in rpcwallet.cpp
 
@@ -85,6 +86,35 @@ UniValue GetNetworkHashPS(int lookup, int height) {
     return workDiff.getdouble() / timeDiff;
 }
 
+UniValue getlocalsolps(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getlocalsolps\n"
+            "\nReturns the average local solutions per second since this node was started.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"solps\": xxx.xxxxx,     (numeric) Solutions per second of Equihash solver wall-clock time\n"
+            "  \"solutions\": n,         (numeric) Candidate solutions found and checked against the target\n"
+            "  \"solves\": n,            (numeric) Nonces searched\n"
+            "  \"solvetime\": xxx.xxx,   (numeric) Seconds during which at least one solver was running\n"
+            "  \"solver\": \"name\"        (string) The solver selected with -equihashsolver\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlocalsolps", "")
+            + HelpExampleRpc("getlocalsolps", "")
+       );
+
+    EquihashSolverStats stats = GetEquihashSolverStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("solps", GetLocalSolPS());
+    obj.pushKV("solutions", stats.nSolutions);
+    obj.pushKV("solves", stats.nSolves);
+    obj.pushKV("solvetime", stats.nBusyMicros / 1000000.0);
+    obj.pushKV("solver", gArgs.GetArg("-equihashsolver", DEFAULT_EQUIHASH_SOLVER));
+    return obj;
+}
+
 UniValue getnetworkhashps(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 2)
@@ -121,6 +151,12 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
     const CChainParams& params = Params();
     unsigned int n = params.EquihashN();
     unsigned int k = params.EquihashK();
+    std::unique_ptr<CEquihashSolver> solver;
+    try {
+        solver = CreateEquihashSolver(gArgs.GetArg("-equihashsolver", DEFAULT_EQUIHASH_SOLVER), n, k, GetNumCores());
+    } catch (const std::invalid_argument& e) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, e.what());
+    }
     while (nHeight < nHeightEnd)
     {
         std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript));
@@ -160,7 +196,7 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
                         // TODO(h4x3rotab): Maybe switch to EhBasicSolve and better deal with `nMaxTries`?
                         return CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus());
                     };
-            bool found = EhBasicSolveUncancellable(n, k, curr_state, validBlock);
+            bool found = solver->Solve(curr_state, validBlock, [](EhSolverCancelCheck pos) { return false; });
             --nMaxTries;
             if (found) {
                 break;
@@ -231,6 +267,7 @@ UniValue getmininginfo(const JSONRPCRequest& request)
             "  \"currentblocktx\": nnn,     (numeric) The last block transaction\n"
             "  \"difficulty\": xxx.xxxxx    (numeric) The current difficulty\n"
             "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
+            "  \"localsolps\": xxx.xxxxx    (numeric) The average local solution rate in Sol/s since this node was started\n"
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
             "  \"warnings\": \"...\"          (string) any network and blockchain warnings\n"
@@ -249,6 +286,7 @@ UniValue getmininginfo(const JSONRPCRequest& request)
     obj.pushKV("currentblocktx",   (uint64_t)nLastBlockTx);
     obj.pushKV("difficulty",       (double)GetDifficulty());
     obj.pushKV("networkhashps",    getnetworkhashps(request));
+    obj.pushKV("localsolps",       GetLocalSolPS());
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
     obj.pushKV("warnings",         GetWarnings("statusbar"));
@@ -973,6 +1011,7 @@ UniValue estimaterawfee(const JSONRPCRequest& request)
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
+    { "mining",             "getlocalsolps",          &getlocalsolps,          {} },
     { "mining",             "getnetworkhashps",       &getnetworkhashps,       {"nblocks","height"} },
     { "mining",             "getmininginfo",          &getmininginfo,          {} },
     { "mining",             "prioritisetransaction",  &prioritisetransaction,  {"txid","dummy","fee_delta"} },
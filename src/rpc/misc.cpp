@@ -3,12 +3,15 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <blockmsgcache.h>
 #include <chain.h>
+#include <chainparams.h>
 #include <clientversion.h>
 #include <core_io.h>
 #include <crypto/ripemd160.h>
 #include <init.h>
 #include <key_io.h>
+#include <memusage.h>
 #include <validation.h>
 #include <httpserver.h>
 #include <net.h>
@@ -17,6 +20,7 @@
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <timedata.h>
+#include <txdb.h>
 #include <util.h>
 #include <utilstrencodings.h>
 #ifdef ENABLE_WALLET
@@ -274,6 +278,69 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCBlockIndexMemoryInfo()
+{
+    const CChainParams& chainparams = Params();
+    const size_t nSolutionSize = (size_t(1) << chainparams.EquihashK()) * (chainparams.EquihashN() / (chainparams.EquihashK() + 1) + 1) / 8;
+    uint64_t nTrimmed = 0;
+    size_t nSolutionUsage = 0;
+    LOCK(cs_main);
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        if (item.second->HasSolution()) {
+            nSolutionUsage += memusage::DynamicUsage(item.second->nSolution);
+        } else {
+            nTrimmed++;
+        }
+    }
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("entries", uint64_t(mapBlockIndex.size()));
+    obj.pushKV("solutions_trimmed", nTrimmed);
+    obj.pushKV("solution_usage", uint64_t(nSolutionUsage));
+    obj.pushKV("solution_savings", nTrimmed * memusage::MallocUsage(nSolutionSize));
+    return obj;
+}
+
+static UniValue RPCBlockMsgCacheMemoryInfo()
+{
+    CBlockMsgCache::Stats stats = g_block_msg_cache.GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("entries", uint64_t(stats.nEntries));
+    obj.pushKV("usage", uint64_t(stats.nBytes));
+    obj.pushKV("hits", stats.nHits);
+    obj.pushKV("misses", stats.nMisses);
+    return obj;
+}
+
+static UniValue RPCDBMemoryInfo(const CDBWrapper& db)
+{
+    const CDBOptions& options = db.GetDBOptions();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("profile", options.profile);
+    obj.pushKV("usage", uint64_t(db.DynamicMemoryUsage()));
+    obj.pushKV("block_cache_size", uint64_t(db.GetBlockCacheSize()));
+    obj.pushKV("write_buffer_size", uint64_t(db.GetWriteBufferSize()));
+    obj.pushKV("max_open_files", options.max_open_files);
+    obj.pushKV("block_size", options.block_size);
+    obj.pushKV("max_file_size", options.max_file_size);
+    obj.pushKV("bloom_bits", options.bloom_bits);
+    obj.pushKV("compression", options.compression);
+    obj.pushKV("reuse_logs", options.reuse_logs);
+    return obj;
+}
+
+static UniValue RPCLevelDBMemoryInfo()
+{
+    UniValue obj(UniValue::VOBJ);
+    LOCK(cs_main);
+    if (pcoinsdbview) {
+        obj.pushKV(pcoinsdbview->GetDB().GetName(), RPCDBMemoryInfo(pcoinsdbview->GetDB()));
+    }
+    if (pblocktree) {
+        obj.pushKV(pblocktree->GetName(), RPCDBMemoryInfo(*pblocktree));
+    }
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -315,6 +382,32 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"blockindex\": {           (json object) Information about the in-memory block index\n"
+            "    \"entries\": xxxxx,       (numeric) Number of block index entries\n"
+            "    \"solutions_trimmed\": xxxxx, (numeric) Number of entries whose Equihash solution is only kept on disk (see -compactblockindex)\n"
+            "    \"solution_usage\": xxxxx, (numeric) Bytes used by the solutions still held in memory\n"
+            "    \"solution_savings\": xxxxx, (numeric) Estimated bytes saved by keeping solutions on disk\n"
+            "  },\n"
+            "  \"blockmsgcache\": {        (json object) Information about the cache of recent blocks and their network messages\n"
+            "    \"entries\": xxxxx,       (numeric) Number of blocks cached\n"
+            "    \"usage\": xxxxx,         (numeric) Bytes used by the blocks and their serialized messages (see -maxblockmsgcachesize)\n"
+            "    \"hits\": xxxxx,          (numeric) Number of lookups answered from the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Number of lookups that had to fall back to the disk\n"
+            "  },\n"
+            "  \"leveldb\": {              (json object) The LevelDB databases, by name (chainstate, index)\n"
+            "    \"name\": {\n"
+            "      \"profile\": \"name\",   (string) The profile the database was tuned with (see -dbprofile and -dboption)\n"
+            "      \"usage\": xxxxx,       (numeric) Estimated bytes used by LevelDB for the database\n"
+            "      \"block_cache_size\": xxxxx, (numeric) Size of the block cache in bytes\n"
+            "      \"write_buffer_size\": xxxxx, (numeric) Size of each of the (up to two) write buffers in bytes\n"
+            "      \"max_open_files\": xxxxx, (numeric) Number of table files kept open\n"
+            "      \"block_size\": xxxxx,  (numeric) Uncompressed size of a table block in bytes\n"
+            "      \"max_file_size\": xxxxx, (numeric) Size at which a new table file is started\n"
+            "      \"bloom_bits\": xxxxx,  (numeric) Bloom filter bits per key (0 for none)\n"
+            "      \"compression\": true|false, (boolean) Whether blocks are compressed where LevelDB supports it\n"
+            "      \"reuse_logs\": true|false (boolean) Whether the manifest and log are appended to when opening\n"
+            "    }\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -328,6 +421,9 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        obj.pushKV("blockindex", RPCBlockIndexMemoryInfo());
+        obj.pushKV("blockmsgcache", RPCBlockMsgCacheMemoryInfo());
+        obj.pushKV("leveldb", RPCLevelDBMemoryInfo());
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
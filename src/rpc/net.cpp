@@ -101,6 +101,15 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"cmpctblocks\": {\n"
+            "       \"sent\": n,              (numeric) The number of compact blocks sent to this peer\n"
+            "       \"prefilled_sent\": n,    (numeric) The transactions besides coinbases prefilled in them\n"
+            "       \"getblocktxn_received\": n, (numeric) The number of getblocktxn round trips this peer needed to reconstruct them\n"
+            "       \"roundtrip_rate_sent\": x.xxx, (numeric) getblocktxn_received per compact block sent\n"
+            "       \"received\": n,          (numeric) The number of compact blocks received from this peer\n"
+            "       \"getblocktxn_sent\": n,  (numeric) The number of getblocktxn round trips we needed to reconstruct them\n"
+            "       \"roundtrip_rate_received\": x.xxx, (numeric) getblocktxn_sent per compact block received\n"
+            "    },\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -167,6 +176,15 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            UniValue cmpctblocks(UniValue::VOBJ);
+            cmpctblocks.pushKV("sent", statestats.nCmpctBlocksSent);
+            cmpctblocks.pushKV("prefilled_sent", statestats.nCmpctPrefilledTxSent);
+            cmpctblocks.pushKV("getblocktxn_received", statestats.nBlockTxnRequestsReceived);
+            cmpctblocks.pushKV("roundtrip_rate_sent", statestats.nCmpctBlocksSent ? (double)statestats.nBlockTxnRequestsReceived / statestats.nCmpctBlocksSent : 0.0);
+            cmpctblocks.pushKV("received", statestats.nCmpctBlocksReceived);
+            cmpctblocks.pushKV("getblocktxn_sent", statestats.nBlockTxnRequestsSent);
+            cmpctblocks.pushKV("roundtrip_rate_received", statestats.nCmpctBlocksReceived ? (double)statestats.nBlockTxnRequestsSent / statestats.nCmpctBlocksReceived : 0.0);
+            obj.pushKV("cmpctblocks", cmpctblocks);
         }
         obj.pushKV("whitelisted", stats.fWhitelisted);
 
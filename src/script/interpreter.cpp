@@ -1135,6 +1135,11 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     return ss.GetHash();
 }
 
+uint256 TransactionSignatureChecker::ComputeSignatureHash(const CScript& scriptCode, int nHashType, SigVersion sigversion) const
+{
+    return SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion, this->txdata);
+}
+
 bool TransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     return pubkey.Verify(sighash, vchSig);
@@ -1153,7 +1158,7 @@ bool TransactionSignatureChecker::CheckSig(const std::vector<unsigned char>& vch
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion, this->txdata);
+    uint256 sighash = ComputeSignatureHash(scriptCode, nHashType, sigversion);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -154,6 +154,7 @@ private:
     const PrecomputedTransactionData* txdata;
 
 protected:
+    virtual uint256 ComputeSignatureHash(const CScript& scriptCode, int nHashType, SigVersion sigversion) const;
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
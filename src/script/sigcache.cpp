@@ -7,9 +7,13 @@
 
 #include <memusage.h>
 #include <pubkey.h>
+#include <pubkeycache.h>
 #include <random.h>
 #include <uint256.h>
 #include <util.h>
+#include <utiltime.h>
+
+#include <atomic>
 
 #include <cuckoocache.h>
 #include <boost/thread.hpp>
@@ -48,7 +52,7 @@ public:
         return setValid.contains(entry, erase);
     }
 
-    void Set(uint256& entry)
+    void Set(const uint256& entry)
     {
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
         setValid.insert(entry);
@@ -66,6 +70,20 @@ public:
  * signatureCache could be made local to VerifySignature.
 */
 static CSignatureCache signatureCache;
+
+/** Totals behind GetSignatureCheckStats. Updated from the script check threads. */
+std::atomic<uint64_t> nSigCacheHits(0);
+std::atomic<uint64_t> nSigsVerified(0);
+std::atomic<uint64_t> nSigVerifyNanos(0);
+std::atomic<uint64_t> nSighashNanos(0);
+
+bool CacheLookup(const uint256& entry, bool erase)
+{
+    if (!signatureCache.Get(entry, erase))
+        return false;
+    nSigCacheHits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
 } // namespace
 
 // To be called once in AppInitMain/BasicTestingSetup to initialize the
@@ -78,17 +96,89 @@ void InitSignatureCache()
     size_t nElems = signatureCache.setup_bytes(nMaxCacheSize);
     LogPrintf("Using %zu MiB out of %zu/2 requested for signature cache, able to store %zu elements\n",
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
+
+    size_t nMaxPubKeyCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxpubkeycachesize", DEFAULT_MAX_PUBKEY_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nKeys = g_pubkey_cache.Setup(nMaxPubKeyCacheSize, GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max()));
+    LogPrintf("Using %zu MiB for the public key cache, able to store %zu keys\n",
+            g_pubkey_cache.GetStats().nBytes >> 20, nKeys);
+}
+
+SignatureCheckStats GetSignatureCheckStats()
+{
+    SignatureCheckStats stats;
+    stats.nCacheHits = nSigCacheHits.load(std::memory_order_relaxed);
+    stats.nVerified = nSigsVerified.load(std::memory_order_relaxed);
+    stats.nVerifyNanos = nSigVerifyNanos.load(std::memory_order_relaxed);
+    stats.nSighashNanos = nSighashNanos.load(std::memory_order_relaxed);
+    return stats;
+}
+
+uint256 CachingTransactionSignatureChecker::ComputeSignatureHash(const CScript& scriptCode, int nHashType, SigVersion sigversion) const
+{
+    int64_t nStart = GetPerfTimeNanos();
+    uint256 sighash = TransactionSignatureChecker::ComputeSignatureHash(scriptCode, nHashType, sigversion);
+    nSighashNanos.fetch_add(GetPerfTimeNanos() - nStart, std::memory_order_relaxed);
+    return sighash;
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
-    if (signatureCache.Get(entry, !store))
+    if (CacheLookup(entry, !store))
         return true;
-    if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
+    int64_t nStart = GetPerfTimeNanos();
+    bool fValid = TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash);
+    nSigVerifyNanos.fetch_add(GetPerfTimeNanos() - nStart, std::memory_order_relaxed);
+    nSigsVerified.fetch_add(1, std::memory_order_relaxed);
+    if (!fValid)
         return false;
     if (store)
         signatureCache.Set(entry);
     return true;
 }
+
+void CSignatureBatch::Add(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, const uint256& cacheEntry)
+{
+    entries.emplace_back(pubkey, sighash, vchSig);
+    cacheEntries.push_back(cacheEntry);
+}
+
+void CSignatureBatch::Truncate(size_t n)
+{
+    if (n < entries.size()) {
+        entries.erase(entries.begin() + n, entries.end());
+        cacheEntries.erase(cacheEntries.begin() + n, cacheEntries.end());
+    }
+}
+
+bool CSignatureBatch::Verify(std::vector<bool>& valid) const
+{
+    int64_t nStart = GetPerfTimeNanos();
+    bool fAllValid = CPubKey::VerifyBatch(entries, valid);
+    nSigVerifyNanos.fetch_add(GetPerfTimeNanos() - nStart, std::memory_order_relaxed);
+    nSigsVerified.fetch_add(entries.size(), std::memory_order_relaxed);
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (valid[i] && !cacheEntries[i].IsNull())
+            signatureCache.Set(cacheEntries[i]);
+    }
+    return fAllValid;
+}
+
+uint256 DeferringTransactionSignatureChecker::ComputeSignatureHash(const CScript& scriptCode, int nHashType, SigVersion sigversion) const
+{
+    int64_t nStart = GetPerfTimeNanos();
+    uint256 sighash = TransactionSignatureChecker::ComputeSignatureHash(scriptCode, nHashType, sigversion);
+    nSighashNanos.fetch_add(GetPerfTimeNanos() - nStart, std::memory_order_relaxed);
+    return sighash;
+}
+
+bool DeferringTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
+    if (CacheLookup(entry, !store))
+        return true;
+    batch.Add(vchSig, pubkey, sighash, store ? entry : uint256());
+    return true;
+}
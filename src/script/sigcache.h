@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include <pubkey.h>
 #include <script/interpreter.h>
 
 #include <vector>
@@ -16,8 +17,8 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
-
-class CPubKey;
+// Decompressed public key cache, about 1.3KB per key
+static const unsigned int DEFAULT_MAX_PUBKEY_CACHE_SIZE = 8;
 
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
@@ -40,6 +41,20 @@ public:
     }
 };
 
+/** Signature checking done through the checkers below since startup. */
+struct SignatureCheckStats {
+    //! Signatures found in the signature cache
+    uint64_t nCacheHits;
+    //! Signatures verified, alone or as part of a batch
+    uint64_t nVerified;
+    //! Time spent verifying them
+    uint64_t nVerifyNanos;
+    //! Time spent computing signature hashes
+    uint64_t nSighashNanos;
+};
+
+SignatureCheckStats GetSignatureCheckStats();
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -48,6 +63,47 @@ private:
 public:
     CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn) {}
 
+    uint256 ComputeSignatureHash(const CScript& scriptCode, int nHashType, SigVersion sigversion) const override;
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
+};
+
+/**
+ * Signatures whose verification was deferred by a DeferringTransactionSignatureChecker,
+ * so that they can be checked together with CPubKey::VerifyBatch.
+ */
+class CSignatureBatch
+{
+private:
+    std::vector<CPubKeyBatchEntry> entries;
+    //! Signature cache entries to add once the corresponding signature is verified (null if not storing).
+    std::vector<uint256> cacheEntries;
+
+public:
+    void Add(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, const uint256& cacheEntry);
+    size_t size() const { return entries.size(); }
+    //! Drop the entries added after the first n.
+    void Truncate(size_t n);
+    //! Verify all entries. valid[i] is set for entry i; returns true if all are valid.
+    bool Verify(std::vector<bool>& valid) const;
+};
+
+/**
+ * A signature checker that reports every signature not found in the signature
+ * cache as valid, deferring its actual verification to a CSignatureBatch.
+ * A script result obtained with this checker is only meaningful if all the
+ * deferred signatures later turn out to be valid; otherwise the script has to
+ * be evaluated again with a regular checker.
+ */
+class DeferringTransactionSignatureChecker : public TransactionSignatureChecker
+{
+private:
+    bool store;
+    CSignatureBatch& batch;
+
+public:
+    DeferringTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn, CSignatureBatch& batchIn) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn), batch(batchIn) {}
+
+    uint256 ComputeSignatureHash(const CScript& scriptCode, int nHashType, SigVersion sigversion) const override;
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
 };
 
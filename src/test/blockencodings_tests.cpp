@@ -3,15 +3,23 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <blockencodings.h>
+#include <blockmsgcache.h>
 #include <consensus/merkle.h>
 #include <chainparams.h>
+#include <net.h>
+#include <net_processing.h>
+#include <netmessagemaker.h>
 #include <random.h>
+#include <rpc/server.h>
 #include <crypto/equihash.h>
+#include <validation.h>
 
 #include <test/test_bitcoin.h>
 
 #include <boost/test/unit_test.hpp>
 
+#include <univalue.h>
+
 std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
 
 struct RegtestingSetup : public TestingSetup {
@@ -415,4 +423,240 @@ BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BOOST_CHECK_EQUAL(req1.indexes[3], req2.indexes[3]);
 }
 
+BOOST_AUTO_TEST_CASE(PredictivePrefillRoundTripTest)
+{
+    CTxMemPool pool;
+    CBlock block(BuildBlockTestCase());
+
+    // Prefill the last transaction; the one between is left to the receiver's mempool
+    std::vector<bool> vPrefill(block.vtx.size(), false);
+    vPrefill[2] = true;
+    CBlockHeaderAndShortTxIDs shortIDs(block, true, vPrefill);
+    BOOST_CHECK_EQUAL(shortIDs.BlockTxCount(), block.vtx.size());
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    stream >> shortIDs2;
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK( partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK( partialBlock.IsTxAvailable(2));
+
+    CBlock block2;
+    std::vector<CTransactionRef> vtx_missing{block.vtx[1]};
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+    bool mutated;
+    BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(), BlockMerkleRoot(block2, &mutated).ToString());
+    BOOST_CHECK(!mutated);
+}
+
+// Hand a message from pnode to the message handler, as the socket handler would
+static void ProcessMessageFrom(CNode* pnode, PeerLogicValidation& peerLogic, CSerializedNetMsg&& msg)
+{
+    CSharedNetMsg shared = CConnman::ShareMessage(std::move(msg));
+    CNetMessage netmsg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    BOOST_REQUIRE_EQUAL(netmsg.readHeader(reinterpret_cast<const char*>(shared.header->data()), shared.header->size()), (int)shared.header->size());
+    if (shared.payload)
+        BOOST_REQUIRE_EQUAL(netmsg.readData(reinterpret_cast<const char*>(shared.payload->data()), shared.payload->size()), (int)shared.payload->size());
+    BOOST_REQUIRE(netmsg.complete());
+    {
+        LOCK(pnode->cs_vProcessMsg);
+        pnode->nProcessQueueSize += netmsg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+        pnode->vProcessMsg.push_back(netmsg);
+    }
+    std::atomic<bool> interruptDummy(false);
+    peerLogic.ProcessMessages(pnode, interruptDummy);
+}
+
+BOOST_AUTO_TEST_CASE(PredictivePrefillPeerTest)
+{
+    // A peer that wants new blocks announced as compact blocks, and has our tip
+    struct in_addr ipv4;
+    ipv4.s_addr = 0xa0b0c001;
+    CAddress addr(CService(CNetAddr(ipv4), Params().GetDefaultPort()), NODE_NONE);
+    CNode* pnode = new CNode(0, ServiceFlags(NODE_NETWORK | NODE_WITNESS), 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ false);
+    pnode->SetSendVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(pnode);
+    pnode->nVersion = PROTOCOL_VERSION;
+    pnode->fSuccessfullyConnected = true;
+    CConnmanTest::AddNode(*pnode);
+
+    CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+    }
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    ProcessMessageFrom(pnode, *peerLogic, msgMaker.Make(NetMsgType::SENDCMPCT, true, uint64_t(2)));
+    ProcessMessageFrom(pnode, *peerLogic, msgMaker.Make(NetMsgType::INV, std::vector<CInv>{CInv(MSG_BLOCK, pindexTip->GetBlockHash())}));
+
+    // After the coinbase, a transaction the peer knows about, one it does not,
+    // two that do not both fit under the prefill limit and a last small one
+    CBlock block;
+    block.nVersion = 42;
+    block.hashPrevBlock = pindexTip->GetBlockHash();
+    block.nBits = 0x207fffff;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    for (size_t nScriptSize : {10U, 10U, MAX_CMPCTBLOCK_PREFILL_BYTES * 6 / 10, MAX_CMPCTBLOCK_PREFILL_BYTES * 6 / 10, 10U}) {
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vin[0].scriptSig.resize(nScriptSize);
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    pnode->AddInventoryKnown(CInv(MSG_TX, block.vtx[1]->GetHash()));
+
+    const uint256 hash = block.GetHash();
+    CBlockIndex index(block);
+    index.phashBlock = &hash;
+    index.pprev = pindexTip;
+    index.nHeight = pindexTip->nHeight + 1;
+    {
+        LOCK(pnode->cs_vSend);
+        pnode->vSendMsg.clear();
+    }
+    peerLogic->NewPoWValidBlock(&index, std::make_shared<const CBlock>(block));
+
+    CBlockHeaderAndShortTxIDs cmpctblock;
+    {
+        LOCK(pnode->cs_vSend);
+        BOOST_REQUIRE_EQUAL(pnode->vSendMsg.size(), 2U);
+        CMessageHeader hdr(Params().MessageStart());
+        CDataStream(*pnode->vSendMsg[0], SER_NETWORK, PROTOCOL_VERSION) >> hdr;
+        BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::CMPCTBLOCK);
+        CDataStream(*pnode->vSendMsg[1], SER_NETWORK, PROTOCOL_VERSION) >> cmpctblock;
+    }
+    BOOST_CHECK(cmpctblock.header.GetHash() == hash);
+
+    CTxMemPool pool;
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_REQUIRE(partialBlock.InitData(cmpctblock, extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK( partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK( partialBlock.IsTxAvailable(2));
+    BOOST_CHECK( partialBlock.IsTxAvailable(3));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(4));
+    BOOST_CHECK( partialBlock.IsTxAvailable(5));
+
+    // Both counted in getpeerinfo
+    JSONRPCRequest request;
+    request.strMethod = "getpeerinfo";
+    request.params = UniValue(UniValue::VARR);
+    request.fHelp = false;
+    UniValue peers = tableRPC["getpeerinfo"]->actor(request);
+    BOOST_REQUIRE_EQUAL(peers.size(), 1U);
+    const UniValue& cmpctblocks = find_value(peers[0].get_obj(), "cmpctblocks");
+    BOOST_CHECK_EQUAL(find_value(cmpctblocks.get_obj(), "sent").get_int64(), 1);
+    BOOST_CHECK_EQUAL(find_value(cmpctblocks.get_obj(), "prefilled_sent").get_int64(), 3);
+
+    bool dummy;
+    peerLogic->FinalizeNode(pnode->GetId(), dummy);
+    CConnmanTest::ClearNodes();
+}
+
+BOOST_AUTO_TEST_CASE(BlockMsgCacheTest)
+{
+    CBlockMsgCache cache;
+    std::shared_ptr<const CBlock> pblock1 = std::make_shared<const CBlock>(BuildBlockTestCase());
+    std::shared_ptr<const CBlock> pblock2 = std::make_shared<const CBlock>(BuildBlockTestCase());
+    const uint256 hash1 = pblock1->GetHash();
+    const uint256 hash2 = pblock2->GetHash();
+
+    BOOST_CHECK(!cache.GetBlock(hash1));
+    BOOST_CHECK(!cache.GetMessage(hash1, BlockEncoding::WITNESS_BLOCK).header);
+
+    cache.Add(pblock1);
+    BOOST_CHECK(cache.GetBlock(hash1) == pblock1);
+
+    // The block message carries the block as the network serializes it
+    CSharedNetMsg msg = cache.GetMessage(hash1, BlockEncoding::WITNESS_BLOCK);
+    BOOST_CHECK_EQUAL(msg.command, NetMsgType::BLOCK);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << *pblock1;
+    BOOST_CHECK(std::vector<unsigned char>(stream.begin(), stream.end()) == *msg.payload);
+
+    // Serialized once, and the same bytes with or without witnesses when there are none
+    BOOST_CHECK(cache.GetMessage(hash1, BlockEncoding::WITNESS_BLOCK).payload == msg.payload);
+    BOOST_CHECK(cache.GetMessage(hash1, BlockEncoding::BLOCK).payload == msg.payload);
+
+    CSharedNetMsg msgCmpct = cache.GetMessage(hash1, BlockEncoding::CMPCTBLOCK);
+    BOOST_CHECK_EQUAL(msgCmpct.command, NetMsgType::CMPCTBLOCK);
+    BOOST_CHECK(cache.GetMessage(hash1, BlockEncoding::WITNESS_CMPCTBLOCK).payload == msgCmpct.payload);
+    CDataStream cmpctStream(*msgCmpct.payload, SER_NETWORK, PROTOCOL_VERSION);
+    CBlockHeaderAndShortTxIDs shortIDs;
+    cmpctStream >> shortIDs;
+    BOOST_CHECK(shortIDs.header.GetHash() == hash1);
+    BOOST_CHECK_EQUAL(shortIDs.BlockTxCount(), pblock1->vtx.size());
+
+    // Over the limit the least recently used block goes, but the last one used stays
+    cache.Add(pblock2);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 2U);
+    BOOST_CHECK(cache.GetBlock(hash1) == pblock1);
+    cache.SetMaxSize(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 1U);
+    BOOST_CHECK(cache.GetBlock(hash1) == pblock1);
+    BOOST_CHECK(!cache.GetBlock(hash2));
+}
+
+BOOST_AUTO_TEST_CASE(BlockMsgCacheWitnessTest)
+{
+    CBlockMsgCache cache;
+    CBlock block = BuildBlockTestCase();
+    CMutableTransaction tx(*block.vtx[2]);
+    tx.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(32, 0x42));
+    block.vtx[2] = MakeTransactionRef(tx);
+    std::shared_ptr<const CBlock> pblock = std::make_shared<const CBlock>(block);
+    const uint256 hash = pblock->GetHash();
+
+    BOOST_CHECK(!cache.GetMessage(hash, BlockEncoding::BLOCK).header);
+    cache.Add(pblock);
+
+    // With witnesses each flavour of a message is serialized on its own
+    CSharedNetMsg msgWitness = cache.GetMessage(hash, BlockEncoding::WITNESS_BLOCK);
+    CSharedNetMsg msgNoWitness = cache.GetMessage(hash, BlockEncoding::BLOCK);
+    BOOST_CHECK(msgWitness.payload != msgNoWitness.payload);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << *pblock;
+    BOOST_CHECK(std::vector<unsigned char>(stream.begin(), stream.end()) == *msgWitness.payload);
+    CDataStream streamNoWitness(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    streamNoWitness << *pblock;
+    BOOST_CHECK(std::vector<unsigned char>(streamNoWitness.begin(), streamNoWitness.end()) == *msgNoWitness.payload);
+    BOOST_CHECK(msgNoWitness.payload->size() < msgWitness.payload->size());
+    BOOST_CHECK(cache.GetMessage(hash, BlockEncoding::WITNESS_BLOCK).payload == msgWitness.payload);
+    BOOST_CHECK(cache.GetMessage(hash, BlockEncoding::BLOCK).payload == msgNoWitness.payload);
+
+    // Compact blocks differ in the short ids, computed from wtxids or txids
+    CSharedNetMsg msgCmpctWitness = cache.GetMessage(hash, BlockEncoding::WITNESS_CMPCTBLOCK);
+    CSharedNetMsg msgCmpct = cache.GetMessage(hash, BlockEncoding::CMPCTBLOCK);
+    BOOST_CHECK(msgCmpctWitness.payload != msgCmpct.payload);
+    CBlockHeaderAndShortTxIDs cmpctWitness, cmpct;
+    CDataStream(*msgCmpctWitness.payload, SER_NETWORK, PROTOCOL_VERSION) >> cmpctWitness;
+    CDataStream(*msgCmpct.payload, SER_NETWORK, PROTOCOL_VERSION) >> cmpct;
+    TestHeaderAndShortIDs shortIDsWitness(cmpctWitness);
+    TestHeaderAndShortIDs shortIDs(cmpct);
+    BOOST_CHECK(shortIDsWitness.header.GetHash() == hash);
+    BOOST_CHECK(shortIDs.header.GetHash() == hash);
+    BOOST_REQUIRE_EQUAL(shortIDsWitness.shorttxids.size(), 2U);
+    BOOST_REQUIRE_EQUAL(shortIDs.shorttxids.size(), 2U);
+    BOOST_CHECK_EQUAL(shortIDsWitness.shorttxids[1], shortIDsWitness.GetShortID(pblock->vtx[2]->GetWitnessHash()));
+    BOOST_CHECK_EQUAL(shortIDs.shorttxids[1], shortIDs.GetShortID(pblock->vtx[2]->GetHash()));
+    BOOST_CHECK(shortIDs.shorttxids[1] != shortIDs.GetShortID(pblock->vtx[2]->GetWitnessHash()));
+
+    CBlockMsgCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nMisses, 1U);
+    BOOST_CHECK_EQUAL(stats.nHits, 6U);
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK(stats.nBytes > msgWitness.payload->size() + msgNoWitness.payload->size());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,11 +8,13 @@
 #include <undo.h>
 #include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
+#include <txdb.h>
 #include <validation.h>
 #include <consensus/validation.h>
 
 #include <vector>
 #include <map>
+#include <set>
 
 #include <boost/test/unit_test.hpp>
 
@@ -707,6 +709,43 @@ BOOST_AUTO_TEST_CASE(ccoins_spend)
     CheckSpendCoins(VALUE1, VALUE2, ABSENT, DIRTY|FRESH, NO_ENTRY   );
 }
 
+void CheckPrefetchCoin(CAmount base_value, CAmount cache_value, CAmount expected_value, char cache_flags, char expected_flags)
+{
+    SingleEntryCacheTest test(base_value, cache_value, cache_flags);
+    Coin coin;
+    if (test.base.GetCoin(OUTPOINT, coin)) {
+        test.cache.PrefetchCoin(OUTPOINT, std::move(coin));
+    }
+    test.cache.SelfTest();
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_prefetch)
+{
+    /* Check PrefetchCoin behavior, reading a coin from the base view on the
+     * side and handing it to the cache, and checking that the resulting entry
+     * is the same as AccessCoin would leave, without overriding anything the
+     * cache already has.
+     *
+     *                 Base    Cache   Result  Cache        Result
+     *                 Value   Value   Value   Flags        Flags
+     */
+    CheckPrefetchCoin(ABSENT, ABSENT, ABSENT, NO_ENTRY   , NO_ENTRY   );
+    CheckPrefetchCoin(PRUNED, ABSENT, ABSENT, NO_ENTRY   , NO_ENTRY   );
+    CheckPrefetchCoin(VALUE1, ABSENT, VALUE1, NO_ENTRY   , 0          );
+    CheckPrefetchCoin(VALUE1, PRUNED, PRUNED, 0          , 0          );
+    CheckPrefetchCoin(VALUE1, PRUNED, PRUNED, DIRTY      , DIRTY      );
+    CheckPrefetchCoin(VALUE1, PRUNED, PRUNED, DIRTY|FRESH, DIRTY|FRESH);
+    CheckPrefetchCoin(VALUE1, VALUE2, VALUE2, 0          , 0          );
+    CheckPrefetchCoin(VALUE1, VALUE2, VALUE2, DIRTY      , DIRTY      );
+    CheckPrefetchCoin(VALUE1, VALUE2, VALUE2, DIRTY|FRESH, DIRTY|FRESH);
+}
+
 void CheckAddCoinBase(CAmount base_value, CAmount cache_value, CAmount modify_value, CAmount expected_value, char cache_flags, char expected_flags, bool coinbase)
 {
     SingleEntryCacheTest test(base_value, cache_value, cache_flags);
@@ -855,4 +894,70 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_FIXTURE_TEST_CASE(coins_db_async_flush, TestingSetup)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewCache cache(&db);
+    COutPoint outpoint(InsecureRand256(), 0);
+    Coin coin;
+    coin.out.nValue = 1;
+    coin.out.scriptPubKey = CScript() << OP_TRUE;
+    coin.nHeight = 1;
+    cache.AddCoin(outpoint, std::move(coin), false);
+    uint256 block = InsecureRand256();
+    cache.SetBestBlock(block);
+    BOOST_CHECK(cache.Flush());
+
+    // A flushed coin is visible whether or not it has reached the database yet
+    Coin read;
+    BOOST_CHECK(db.GetCoin(outpoint, read));
+    BOOST_CHECK_EQUAL(read.out.nValue, 1);
+    BOOST_CHECK(db.GetBestBlock() == block);
+    BOOST_CHECK(db.Sync());
+    BOOST_CHECK_EQUAL(db.PendingMemoryUsage(), 0U);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    BOOST_CHECK(db.HaveCoin(outpoint));
+
+    // And so is a spend
+    BOOST_CHECK(cache.SpendCoin(outpoint));
+    uint256 block2 = InsecureRand256();
+    cache.SetBestBlock(block2);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!db.HaveCoin(outpoint));
+    BOOST_CHECK(db.GetBestBlock() == block2);
+    BOOST_CHECK(db.Sync());
+    BOOST_CHECK(!db.GetCoin(outpoint, read));
+    BOOST_CHECK(db.GetBestBlock() == block2);
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_range_cursors, TestChain100Setup)
+{
+    FlushStateToDisk();
+    std::set<COutPoint> all;
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint key;
+        BOOST_CHECK(pcursor->GetKey(key));
+        all.insert(key);
+    }
+    BOOST_CHECK(!all.empty());
+
+    // The ranges cover every coin exactly once, in order, at the same block
+    for (int nRanges : {1, 7, 256}) {
+        std::vector<std::unique_ptr<CCoinsViewCursor>> cursors = pcoinsdbview->RangeCursors(nRanges);
+        BOOST_CHECK_EQUAL(cursors.size(), (size_t)nRanges);
+        std::vector<COutPoint> seen;
+        for (const auto& cursor : cursors) {
+            BOOST_CHECK(cursor->GetBestBlock() == pcursor->GetBestBlock());
+            for (; cursor->Valid(); cursor->Next()) {
+                COutPoint key;
+                Coin coin;
+                BOOST_CHECK(cursor->GetKey(key) && cursor->GetValue(coin));
+                seen.push_back(key);
+            }
+        }
+        BOOST_CHECK(std::vector<COutPoint>(all.begin(), all.end()) == seen);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <crypto/aes.h>
+#include <crypto/blake2b.h>
 #include <crypto/chacha20.h>
+#include <crypto/lthash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -11,10 +13,13 @@
 #include <crypto/sha512.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <hash.h>
 #include <random.h>
 #include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
 
+#include <sodium.h>
+
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -548,6 +553,95 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+BOOST_AUTO_TEST_CASE(sha3_256d64)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA3_256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blake2b_finalize_words)
+{
+    unsigned char personal[CBLAKE2b::PERSONAL_SIZE];
+    for (size_t j = 0; j < sizeof(personal); ++j) {
+        personal[j] = InsecureRandBits(8);
+    }
+    // Prefix lengths around each block boundary the appended word can straddle.
+    for (size_t prefix : {0, 100, 108, 124, 125, 126, 127, 128, 129, 252, 253, 255, 256, 257, 400}) {
+        std::vector<unsigned char> data(prefix);
+        for (size_t j = 0; j < prefix; ++j) {
+            data[j] = InsecureRandBits(8);
+        }
+        crypto_generichash_blake2b_state ref;
+        crypto_generichash_blake2b_init_salt_personal(&ref, nullptr, 0, 50, nullptr, personal);
+        crypto_generichash_blake2b_update(&ref, data.data(), data.size());
+        // Written in uneven pieces, to cross block boundaries within a write
+        CBLAKE2b base(50, personal);
+        for (size_t pos = 0; pos < prefix; pos += 37) {
+            base.Write(data.data() + pos, std::min<size_t>(37, prefix - pos));
+        }
+
+        unsigned char out1[9 * 50], out2[9 * 50];
+        crypto_generichash_blake2b_state state = ref;
+        crypto_generichash_blake2b_final(&state, out1, 50);
+        CBLAKE2b(base).Finalize(out2);
+        BOOST_CHECK(memcmp(out1, out2, 50) == 0);
+
+        for (size_t count = 0; count <= 9; ++count) {
+            uint32_t words[9];
+            for (size_t j = 0; j < count; ++j) {
+                words[j] = InsecureRand32();
+                state = ref;
+                unsigned char le[4];
+                WriteLE32(le, words[j]);
+                crypto_generichash_blake2b_update(&state, le, sizeof(le));
+                crypto_generichash_blake2b_final(&state, out1 + 50 * j, 50);
+            }
+            BLAKE2bFinalizeWords(base, words, count, out2);
+            BOOST_CHECK(memcmp(out1, out2, 50 * count) == 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lthash_tests)
+{
+    const unsigned char abc[] = {'a', 'b', 'c'};
+    const unsigned char def[] = {'d', 'e', 'f'};
+    unsigned char out1[LtHash16::OUTPUT_SIZE], out2[LtHash16::OUTPUT_SIZE];
+
+    LtHash16 set;
+    set.Insert(abc, sizeof(abc)).Insert(def, sizeof(def));
+    set.Finalize(out1);
+    BOOST_CHECK_EQUAL(HexStr(out1, out1 + sizeof(out1)), "ed4e97410b74e90cae62640eb5e0fc8846f56b5377b12fb24850f3b7af4b2009");
+
+    // Order does not matter, and parts combine into the whole
+    LtHash16 part1, part2;
+    part1.Insert(def, sizeof(def));
+    part2.Insert(abc, sizeof(abc));
+    part1 += part2;
+    part1.Finalize(out2);
+    BOOST_CHECK(memcmp(out1, out2, sizeof(out1)) == 0);
+
+    // Removing every element gives the empty set again
+    LtHash16 empty;
+    empty.Finalize(out1);
+    set.Remove(abc, sizeof(abc)).Remove(def, sizeof(def));
+    set.Finalize(out2);
+    BOOST_CHECK(memcmp(out1, out2, sizeof(out1)) == 0);
+    part1 -= part2;
+    part1.Remove(def, sizeof(def)).Finalize(out2);
+    BOOST_CHECK(memcmp(out1, out2, sizeof(out1)) == 0);
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
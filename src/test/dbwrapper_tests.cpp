@@ -315,6 +315,54 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
+static void SetDBArgs(const std::vector<const char*>& args)
+{
+    std::vector<const char*> argv = {"testbitcoin"};
+    argv.insert(argv.end(), args.begin(), args.end());
+    gArgs.ParseParameters(argv.size(), argv.data());
+}
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    // Without arguments, databases are opened as they always were
+    SetDBArgs({});
+    CDBOptions options = ReadDBOptions("chainstate");
+    BOOST_CHECK_EQUAL(options.profile, DEFAULT_DB_PROFILE);
+    BOOST_CHECK_EQUAL(options.max_open_files, DEFAULT_DB_MAX_OPEN_FILES);
+    BOOST_CHECK_EQUAL(options.write_buffer_percent, 25);
+    BOOST_CHECK(!options.compression);
+
+    // A global profile, a profile for one database, then overrides in the same order
+    SetDBArgs({"-dbprofile=hdd", "-dbprofile=chainstate:ssd-throughput", "-dboption=index:block_size=8192", "-dboption=max_open_files=100"});
+    options = ReadDBOptions("chainstate");
+    BOOST_CHECK_EQUAL(options.profile, "ssd-throughput");
+    BOOST_CHECK_EQUAL(options.max_open_files, 100);
+    CDBOptions ssd;
+    BOOST_CHECK(GetDBProfile("ssd-throughput", ssd));
+    BOOST_CHECK_EQUAL(options.block_size, ssd.block_size);
+    options = ReadDBOptions("index");
+    BOOST_CHECK_EQUAL(options.profile, "hdd");
+    BOOST_CHECK_EQUAL(options.block_size, 8192);
+    BOOST_CHECK_EQUAL(options.max_open_files, 100);
+
+    // The options are used when opening
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    {
+        CDBWrapper dbw(ph / "index", (1 << 20), true, false);
+        BOOST_CHECK_EQUAL(dbw.GetDBOptions().profile, "hdd");
+        BOOST_CHECK_EQUAL(dbw.GetWriteBufferSize(), (1 << 20) / 4);
+        BOOST_CHECK_EQUAL(dbw.GetBlockCacheSize(), (1 << 20) / 2);
+        BOOST_CHECK(dbw.Write('k', 'v'));
+    }
+
+    SetDBArgs({"-dbprofile=fast"});
+    BOOST_CHECK_THROW(ReadDBOptions("chainstate"), std::runtime_error);
+    SetDBArgs({"-dboption=max_open_files=1"});
+    BOOST_CHECK_THROW(ReadDBOptions("chainstate"), std::runtime_error);
+    SetDBArgs({"-dboption=chainstate:nonsense=1"});
+    BOOST_CHECK_THROW(ReadDBOptions("chainstate"), std::runtime_error);
+    BOOST_CHECK_NO_THROW(ReadDBOptions("index"));
+    SetDBArgs({});
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include <arith_uint256.h>
 #include <crypto/equihash.h>
+#include <crypto/equihash_solver.h>
 #include <test/test_bitcoin.h>
 #include <uint256.h>
 
@@ -75,6 +76,46 @@ void TestEquihashSolvers(unsigned int n, unsigned int k, const std::string &I, c
     BOOST_TEST_MESSAGE(strm.str());
     BOOST_CHECK(retOpt == solns);
     BOOST_CHECK(retOpt == ret);
+
+    // Splitting the optimised solver across threads must not change the result
+    std::set<std::vector<uint32_t>> retOptMT;
+    std::function<bool(std::vector<unsigned char>)> validBlockOptMT =
+            [&retOptMT, cBitLen](std::vector<unsigned char> soln) {
+        retOptMT.insert(GetIndicesFromMinimal(soln, cBitLen));
+        return false;
+    };
+    EhOptimisedSolve(n, k, state, validBlockOptMT, [](EhSolverCancelCheck pos) { return false; }, 3);
+    BOOST_TEST_MESSAGE("[Optimised x3] Number of solutions: " << retOptMT.size());
+    BOOST_CHECK(retOptMT == solns);
+
+    // A solver reuses its arena across solves; a second solve must not see
+    // anything left over from the first
+    std::unique_ptr<CEquihashSolver> solverDefault = CreateEquihashSolver("default", n, k, 1);
+    for (int i = 0; i < 2; i++) {
+        std::set<std::vector<uint32_t>> retArena;
+        std::function<bool(std::vector<unsigned char>)> validBlockArena =
+                [&retArena, cBitLen](std::vector<unsigned char> soln) {
+            retArena.insert(GetIndicesFromMinimal(soln, cBitLen));
+            return false;
+        };
+        solverDefault->Solve(state, validBlockArena, [](EhSolverCancelCheck pos) { return false; });
+        BOOST_CHECK(retArena == solns);
+    }
+
+    // The bucket solver can in theory drop solutions on bucket overflow, but
+    // at these parameters its buckets have ample headroom.
+    for (unsigned int nThreads : {1, 3}) {
+        std::unique_ptr<CEquihashSolver> solver = CreateEquihashSolver("tromp", n, k, nThreads);
+        std::set<std::vector<uint32_t>> retTromp;
+        std::function<bool(std::vector<unsigned char>)> validBlockTromp =
+                [&retTromp, cBitLen](std::vector<unsigned char> soln) {
+            retTromp.insert(GetIndicesFromMinimal(soln, cBitLen));
+            return false;
+        };
+        solver->Solve(state, validBlockTromp, [](EhSolverCancelCheck pos) { return false; });
+        BOOST_TEST_MESSAGE("[Tromp x" << nThreads << "] Number of solutions: " << retTromp.size());
+        BOOST_CHECK(retTromp == solns);
+    }
 }
 
 void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I, const arith_uint256 &nonce, std::vector<uint32_t> soln, bool expected) {
@@ -91,6 +132,14 @@ void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I,
     bool isValid;
     EhIsValidSolution(n, k, state, GetMinimalFromIndices(soln, cBitLen), isValid);
     BOOST_CHECK(isValid == expected);
+
+    // Block validation checks from a CBLAKE2b state instead
+    CBLAKE2b base(CBLAKE2b::MAX_OUTPUT_SIZE);
+    EhInitialiseState(n, k, base);
+    base.Write((unsigned char*)&I[0], I.size());
+    base.Write(V.begin(), V.size());
+    EhIsValidSolution(n, k, base, GetMinimalFromIndices(soln, cBitLen), isValid);
+    BOOST_CHECK(isValid == expected);
 }
 
 BOOST_AUTO_TEST_CASE(solver_testvectors) {
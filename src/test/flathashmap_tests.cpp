@@ -0,0 +1,120 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <flathashmap.h>
+#include <memusage.h>
+
+#include <test/test_bitcoin.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flathashmap_tests, BasicTestingSetup)
+
+/** A poor hash, so that probe sequences overlap and wrap around. */
+struct CollidingHash
+{
+    size_t operator()(uint32_t key) const { return key % 61; }
+};
+
+typedef flathashmap<uint32_t, std::string, CollidingHash> TestMap;
+
+static void CheckEqual(const TestMap& map, const std::unordered_map<uint32_t, std::string>& real)
+{
+    BOOST_CHECK_EQUAL(map.size(), real.size());
+    size_t count = 0;
+    for (TestMap::const_iterator it = map.begin(); it != map.end(); ++it) {
+        auto found = real.find(it->first);
+        BOOST_REQUIRE(found != real.end());
+        BOOST_CHECK_EQUAL(it->second, found->second);
+        count++;
+    }
+    BOOST_CHECK_EQUAL(count, real.size());
+}
+
+BOOST_AUTO_TEST_CASE(flathashmap_random)
+{
+    TestMap map;
+    std::unordered_map<uint32_t, std::string> real;
+    for (int i = 0; i < 20000; i++) {
+        uint32_t key = InsecureRandRange(500);
+        switch (InsecureRandRange(5)) {
+        case 0: {
+            std::string value = std::to_string(InsecureRand32());
+            bool inserted = map.emplace(key, value).second;
+            BOOST_CHECK_EQUAL(inserted, real.emplace(key, value).second);
+            break;
+        }
+        case 1: {
+            std::string value = std::to_string(InsecureRand32());
+            map[key] = value;
+            real[key] = value;
+            break;
+        }
+        case 2:
+            BOOST_CHECK_EQUAL(map.erase(key), real.erase(key));
+            break;
+        case 3: {
+            TestMap::iterator it = map.find(key);
+            BOOST_CHECK_EQUAL(it != map.end(), real.count(key) == 1);
+            if (it != map.end()) {
+                BOOST_CHECK_EQUAL(it->second, real[key]);
+            }
+            break;
+        }
+        case 4:
+            // Erase while iterating, in both of the ways the coins code does.
+            if (InsecureRandRange(100) == 0) {
+                for (TestMap::iterator it = map.begin(); it != map.end(); ) {
+                    if (InsecureRandBool()) {
+                        real.erase(it->first);
+                        if (InsecureRandBool()) {
+                            it = map.erase(it);
+                        } else {
+                            TestMap::iterator itOld = it++;
+                            map.erase(itOld);
+                        }
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            break;
+        }
+        if (i % 1000 == 0) {
+            CheckEqual(map, real);
+        }
+    }
+    CheckEqual(map, real);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(flathashmap_stable_references)
+{
+    // Entries stay put while the slot array grows and other entries come and go.
+    flathashmap<uint32_t, std::unique_ptr<int>> map;
+    map.emplace(0, std::unique_ptr<int>(new int(42)));
+    std::unique_ptr<int>& first = map.find(0)->second;
+    for (uint32_t i = 1; i < 10000; i++) {
+        map.emplace(i, std::unique_ptr<int>(new int(i)));
+        if (i % 3 == 0) map.erase(i - 1);
+    }
+    BOOST_CHECK(&first == &map.find(0)->second);
+    BOOST_CHECK_EQUAL(*first, 42);
+
+    // Erased entries are reused before the pool grows.
+    size_t usage = memusage::DynamicUsage(map);
+    for (uint32_t i = 1; i < 10000; i++) map.erase(i);
+    for (uint32_t i = 1; i < 6000; i++) map.emplace(i, nullptr);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), usage);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
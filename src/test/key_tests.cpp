@@ -5,6 +5,7 @@
 #include <key.h>
 
 #include <key_io.h>
+#include <pubkeycache.h>
 #include <script/script.h>
 #include <uint256.h>
 #include <util.h>
@@ -77,4 +78,133 @@ BOOST_AUTO_TEST_CASE(key_test1)
     BOOST_CHECK(detsig == ParseHex("1370103ed1c3dbe3787e494e4e3267a4958b07ea135f4fb53e1a7e76b1f6d04e06c2179b4c881cc07236a7f6e83557bb7ec2c4245c1d5117785ed32946e0ac01"));
 }
 
+BOOST_AUTO_TEST_CASE(key_verify_batch)
+{
+    std::vector<CKey> keys(4);
+    for (CKey& key : keys)
+        key.MakeNewKey(true);
+
+    std::vector<CPubKeyBatchEntry> entries;
+    for (int i = 0; i < 40; i++) {
+        const CKey& key = keys[i % keys.size()];
+        uint256 hash = InsecureRand256();
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        entries.emplace_back(key.GetPubKey(), hash, vchSig);
+    }
+
+    std::vector<bool> valid;
+    BOOST_CHECK(CPubKey::VerifyBatch(entries, valid));
+    BOOST_CHECK(valid == std::vector<bool>(entries.size(), true));
+
+    // Corrupt a signature, a message and a key; the other results must not change.
+    entries[3].vchSig[10] ^= 1;
+    entries[17].hash = InsecureRand256();
+    std::vector<unsigned char> vchBadKey(CPubKey::PUBLIC_KEY_SIZE, 0xff);
+    entries[30].pubkey.Set(vchBadKey.begin(), vchBadKey.end());
+    // A signature of unusual length is left to the single-signature path.
+    entries[31].vchSig.push_back(0);
+
+    BOOST_CHECK(!CPubKey::VerifyBatch(entries, valid));
+    for (size_t i = 0; i < entries.size(); i++) {
+        BOOST_CHECK_EQUAL(valid[i], entries[i].pubkey.Verify(entries[i].hash, entries[i].vchSig));
+        BOOST_CHECK_EQUAL(valid[i], i != 3 && i != 17 && i != 30);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(key_pubkey_cache)
+{
+    CPubKeyCache cache;
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    unsigned char expanded[ED25519_EXPANDED_PUBLIC_KEY_SIZE], reference[ED25519_EXPANDED_PUBLIC_KEY_SIZE];
+    BOOST_CHECK(ed25519_expand_public_key(reference, pubkey.begin()));
+
+    // Disabled: computed every time.
+    BOOST_CHECK(!cache.IsEnabled());
+    BOOST_CHECK(cache.Expand(pubkey, expanded));
+    BOOST_CHECK(memcmp(expanded, reference, sizeof(expanded)) == 0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nMisses, 0U);
+
+    // A single slot: the second lookup hits, another key evicts it.
+    BOOST_CHECK_EQUAL(cache.Setup(2000, 1, 2), 1U);
+    BOOST_CHECK(cache.Expand(pubkey, expanded));
+    BOOST_CHECK(cache.Expand(pubkey, expanded));
+    BOOST_CHECK(memcmp(expanded, reference, sizeof(expanded)) == 0);
+    CKey key2;
+    key2.MakeNewKey(true);
+    BOOST_CHECK(cache.Expand(key2.GetPubKey(), expanded));
+    BOOST_CHECK(cache.Expand(pubkey, expanded));
+    BOOST_CHECK(memcmp(expanded, reference, sizeof(expanded)) == 0);
+    CPubKeyCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 3U);
+    BOOST_CHECK_EQUAL(stats.nUsed, 1U);
+
+    // Keys that are not points are rejected and not cached; the all-zero key is a point.
+    std::vector<unsigned char> vchBadKey(CPubKey::PUBLIC_KEY_SIZE, 0xff), vchZeroKey(CPubKey::PUBLIC_KEY_SIZE, 0);
+    CPubKey badkey(vchBadKey.begin(), vchBadKey.end()), zerokey(vchZeroKey.begin(), vchZeroKey.end());
+    BOOST_CHECK(cache.Setup(1 << 20, 3, 4) > 1);
+    BOOST_CHECK(!cache.Expand(badkey, expanded));
+    BOOST_CHECK(!cache.Expand(badkey, expanded));
+    BOOST_CHECK(cache.Expand(zerokey, expanded));
+    BOOST_CHECK(cache.Expand(zerokey, expanded));
+    BOOST_CHECK_EQUAL(cache.GetStats().nHits, 1U);
+    BOOST_CHECK_EQUAL(cache.GetStats().nUsed, 1U);
+
+    // Verification through the shared cache agrees with the uncached path.
+    uint256 hash = InsecureRand256();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    BOOST_CHECK(g_pubkey_cache.IsEnabled());
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK(pubkey.Verify(hash, vchSig));
+        BOOST_CHECK(!pubkey.Verify(InsecureRand256(), vchSig));
+        BOOST_CHECK(!badkey.Verify(hash, vchSig));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(key_ed25519_backends)
+{
+    const std::string selected = ed25519_backend_name();
+    BOOST_CHECK(ed25519_select_backend("ref10"));
+
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    std::vector<uint256> hashes;
+    std::vector<std::vector<unsigned char>> sigs;
+    for (int i = 0; i < 8; i++) {
+        hashes.push_back(InsecureRand256());
+        sigs.emplace_back();
+        BOOST_CHECK(key.Sign(hashes.back(), sigs.back()));
+    }
+    unsigned char tweak[32];
+    GetRandBytes(tweak, sizeof(tweak));
+    CPubKey tweaked = pubkey;
+    ed25519_add_scalar((unsigned char*)tweaked.begin(), nullptr, tweak);
+
+    // Every other backend must produce the same keys and signatures as ref10.
+    for (const char* name : {"fe51"}) {
+        if (!ed25519_select_backend(name))
+            continue;
+        BOOST_CHECK(key.GetPubKey() == pubkey);
+        for (size_t i = 0; i < hashes.size(); i++) {
+            std::vector<unsigned char> vchSig;
+            BOOST_CHECK(key.Sign(hashes[i], vchSig));
+            BOOST_CHECK(vchSig == sigs[i]);
+            BOOST_CHECK(pubkey.Verify(hashes[i], sigs[i]));
+            sigs[i][i] ^= 1;
+            BOOST_CHECK(!pubkey.Verify(hashes[i], sigs[i]));
+            sigs[i][i] ^= 1;
+        }
+        CPubKey derived = pubkey;
+        ed25519_add_scalar((unsigned char*)derived.begin(), nullptr, tweak);
+        BOOST_CHECK(derived == tweaked);
+    }
+
+    BOOST_CHECK(ed25519_select_backend(selected.c_str()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -185,4 +185,37 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnode_shared_message)
+{
+    CConnman connman(0x1337, 0x1337);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode node1(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", false);
+    CNode node2(1, NODE_NETWORK, 0, INVALID_SOCKET, addr, 1, 1, CAddress(), "", false);
+
+    CSerializedNetMsg msg;
+    msg.command = NetMsgType::BLOCK;
+    msg.data.assign(1000, 0x5a);
+    const CSharedNetMsg shared = CConnman::ShareMessage(std::move(msg));
+    BOOST_CHECK_EQUAL(shared.header->size(), CMessageHeader::HEADER_SIZE);
+    BOOST_CHECK_EQUAL(shared.payload->size(), 1000U);
+
+    // Both peers queue the very same bytes, header and checksum included
+    connman.PushMessage(&node1, shared);
+    connman.PushMessage(&node2, shared);
+    BOOST_CHECK_EQUAL(node1.vSendMsg.size(), 2U);
+    BOOST_CHECK_EQUAL(node2.vSendMsg.size(), 2U);
+    BOOST_CHECK(node1.vSendMsg[0] == node2.vSendMsg[0]);
+    BOOST_CHECK(node1.vSendMsg[1] == node2.vSendMsg[1]);
+    BOOST_CHECK_EQUAL(node1.nSendSize, CMessageHeader::HEADER_SIZE + 1000);
+    BOOST_CHECK_EQUAL(shared.payload.use_count(), 3);
+
+    // Messages without a payload only queue their header
+    CSerializedNetMsg verack;
+    verack.command = NetMsgType::VERACK;
+    connman.PushMessage(&node1, std::move(verack));
+    BOOST_CHECK_EQUAL(node1.vSendMsg.size(), 3U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
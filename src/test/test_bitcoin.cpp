@@ -7,7 +7,9 @@
 #include <chainparams.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
+#include <crypto/blake2b.h>
 #include <crypto/equihash.h>
+#include <crypto/sha3_256.h>
 #include <validation.h>
 #include <miner.h>
 #include <net_processing.h>
@@ -43,6 +45,8 @@ extern void noui_connect();
 
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
 {
+        SHA3_256AutoDetect();
+        BLAKE2bAutoDetect();
         RandomInit();
         ECC_Start();
         SetupEnvironment();
@@ -95,6 +99,10 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderCheck);
+        for (int i=0; i < nPrefetchThreads; i++)
+            threadGroup.create_thread(&ThreadPrefetchCoins);
         g_connman = std::unique_ptr<CConnman>(new CConnman(0x1337, 0x1337)); // Deterministic randomness for tests.
         connman = g_connman.get();
         peerLogic.reset(new PeerLogicValidation(connman, scheduler));
@@ -115,6 +123,41 @@ TestingSetup::~TestingSetup()
         fs::remove_all(pathTemp);
 }
 
+void SolveBlockHeader(CBlockHeader& header)
+{
+    const CChainParams& chainparams = Params();
+    unsigned int n = chainparams.EquihashN();
+    unsigned int k = chainparams.EquihashK();
+    // Hash state
+    crypto_generichash_blake2b_state state;
+    EhInitialiseState(n, k, state);
+    // I = the block header minus nonce and solution.
+    CEquihashInput I{header};
+    // I||V
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << I;
+    // H(I||V||...
+    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+    while (true) {
+        // Yes, there is a chance every nonce could fail to satisfy the -regtest
+        // target -- 1 in 2^(2^256). That ain't gonna happen
+        header.nNonce = ArithToUint256(UintToArith256(header.nNonce) + 1);
+
+        // H(I||V||...
+        crypto_generichash_blake2b_state curr_state = state;
+        crypto_generichash_blake2b_update(&curr_state, header.nNonce.begin(), header.nNonce.size());
+
+        // (x_1, x_2, ...) = A(I, V, n, k)
+        std::function<bool(std::vector<unsigned char>)> validBlock =
+                [&header, &chainparams](std::vector<unsigned char> soln) {
+            header.nSolution = soln;
+            return CheckProofOfWork(header.GetHash(), header.nBits, chainparams.GetConsensus());
+        };
+        if (EhBasicSolveUncancellable(n, k, curr_state, validBlock))
+            return;
+    }
+}
+
 TestChain100Setup::TestChain100Setup() : TestingSetup(CBaseChainParams::REGTEST)
 {
     // CreateAndProcessBlock() does not support building SegWit blocks, so don't activate in these tests.
@@ -147,42 +190,7 @@ TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransaction>&
         block.vtx.push_back(MakeTransactionRef(tx));
     block.hashMerkleRoot = BlockMerkleRoot(block);
 
-    unsigned int n = chainparams.EquihashN();
-    unsigned int k = chainparams.EquihashK();
-    // Hash state
-    crypto_generichash_blake2b_state state;
-    EhInitialiseState(n, k, state);
-    // I = the block header minus nonce and solution.
-    CEquihashInput I{block};
-    // I||V
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << I;
-    // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
-    while (true) {
-            // Yes, there is a chance every nonce could fail to satisfy the -regtest
-            // target -- 1 in 2^(2^256). That ain't gonna happen
-            block.nNonce = ArithToUint256(UintToArith256(block.nNonce) + 1);
-
-            // H(I||V||...
-            crypto_generichash_blake2b_state curr_state;
-            curr_state = state;
-            crypto_generichash_blake2b_update(&curr_state,
-                                              block.nNonce.begin(),
-                                              block.nNonce.size());
-
-            // (x_1, x_2, ...) = A(I, V, n, k)
-            std::function<bool(std::vector<unsigned char>)> validBlock =
-                    [&block](std::vector<unsigned char> soln) {     
-                block.nSolution = soln;
-                return CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus());
-            };
-            bool found = EhBasicSolveUncancellable(n, k, curr_state, validBlock);
-            if (found) {
-                goto endloop;
-            }
-        }
-endloop:
+    SolveBlockHeader(block);
 
     std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(block);
     ProcessNewBlock(chainparams, shared_pblock, true, nullptr);
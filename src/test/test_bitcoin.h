@@ -68,9 +68,13 @@ struct TestingSetup: public BasicTestingSetup {
 };
 
 class CBlock;
+class CBlockHeader;
 struct CMutableTransaction;
 class CScript;
 
+/** Find an Equihash solution for header as it stands that meets its target. */
+void SolveBlockHeader(CBlockHeader& header);
+
 //
 // Testing fixture that pre-creates a
 // 100-block REGTEST-mode block chain
@@ -9,6 +9,7 @@
 #include <pubkey.h>
 #include <txmempool.h>
 #include <random.h>
+#include <script/sigcache.h>
 #include <script/standard.h>
 #include <script/sign.h>
 #include <test/test_bitcoin.h>
@@ -91,6 +92,43 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(block_validation_stats, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    const BlockInputStats inputsBefore = GetBlockInputStats();
+    const SignatureCheckStats sigsBefore = GetSignatureCheckStats();
+    CBlock block = CreateAndProcessBlock({spend}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+
+    // Only the connected block counts, not the validity test while mining it
+    const BlockInputStats inputs = GetBlockInputStats();
+    BOOST_CHECK_EQUAL(inputs.nBlocks, inputsBefore.nBlocks + 1);
+    BOOST_CHECK_EQUAL(inputs.nInputs, inputsBefore.nInputs + 1);
+    BOOST_CHECK_EQUAL(inputs.nAssumedValidInputs, inputsBefore.nAssumedValidInputs);
+    BOOST_CHECK(inputs.nCoinFetchNanos > inputsBefore.nCoinFetchNanos);
+
+    // The signature was verified once, with its hash computed to do so
+    const SignatureCheckStats sigs = GetSignatureCheckStats();
+    BOOST_CHECK_EQUAL(sigs.nVerified, sigsBefore.nVerified + 1);
+    BOOST_CHECK(sigs.nVerifyNanos > sigsBefore.nVerifyNanos);
+    BOOST_CHECK(sigs.nSighashNanos > sigsBefore.nSighashNanos);
+}
+
 // Run CheckInputs (using pcoinsTip) on the given transaction, for all script
 // flags.  Test that CheckInputs passes for all flags that don't overlap with
 // the failing_flags argument, but otherwise fails.
@@ -371,4 +409,73 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(script_check_batch_fallback, BasicTestingSetup)
+{
+    // Eight P2PKH spends of one credit, batched as a check-queue chunk would be
+    const size_t nChecks = 8;
+    const size_t nBad = 5;
+    CKey key;
+    key.MakeNewKey(true);
+    CMutableTransaction credit;
+    credit.vin.resize(1);
+    credit.vout.resize(nChecks);
+    for (CTxOut& out : credit.vout) {
+        out.nValue = 1;
+        out.scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    }
+    const CTransaction txCredit(credit);
+
+    std::vector<CTransaction> vSpends;
+    for (size_t i = 0; i < nChecks; i++) {
+        CMutableTransaction spend;
+        spend.vin.resize(1);
+        spend.vin[0].prevout = COutPoint(txCredit.GetHash(), i);
+        spend.vout.resize(1);
+        spend.vout[0].nValue = 1;
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(txCredit.vout[i].scriptPubKey, spend, 0, SIGHASH_ALL, 1, SIGVERSION_BASE);
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        if (i == nBad)
+            vchSig[10] ^= 1;
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(key.GetPubKey());
+        vSpends.emplace_back(spend);
+    }
+    std::vector<PrecomputedTransactionData> txdata;
+    for (const CTransaction& tx : vSpends)
+        txdata.emplace_back(tx);
+
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC;
+    auto MakeChecks = [&](size_t nCount) {
+        std::vector<CScriptCheck> vChecks;
+        for (size_t i = 0; i < nCount; i++)
+            vChecks.emplace_back(txCredit.vout[i], vSpends[i], 0, flags, false, &txdata[i]);
+        return vChecks;
+    };
+
+    // A batch of good signatures verifies at once
+    std::vector<CScriptCheck> vGood = MakeChecks(nBad);
+    BOOST_CHECK(CScriptCheck::RunBatch(vGood));
+
+    // With one bad signature the batch fails, and checking one by one pins
+    // the failure on the bad input alone
+    std::vector<CScriptCheck> vChecks = MakeChecks(nChecks);
+    BOOST_CHECK(!CScriptCheck::RunBatch(vChecks));
+    for (size_t i = 0; i < nChecks; i++) {
+        if (i == nBad)
+            BOOST_CHECK_EQUAL(vChecks[i].GetScriptError(), SCRIPT_ERR_EVAL_FALSE);
+        else
+            BOOST_CHECK(vChecks[i].GetScriptError() != SCRIPT_ERR_EVAL_FALSE);
+    }
+
+    // Checks that record their failure report it through the flag instead
+    std::atomic<bool> fFailed(false);
+    std::vector<CScriptCheck> vScriptChecks = MakeChecks(nChecks);
+    std::vector<CBlockScriptCheck> vBlockChecks;
+    for (CScriptCheck& check : vScriptChecks)
+        vBlockChecks.emplace_back(check, &fFailed);
+    BOOST_CHECK(CBlockScriptCheck::RunBatch(vBlockChecks));
+    BOOST_CHECK(fFailed);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,414 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <chainparams.h>
+#include <consensus/consensus.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <streams.h>
+#include <txdb.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validation_tests, TestChain100Setup)
+
+/** Solve a header on top of prev, without a block behind it. */
+static CBlockHeader MineHeader(const CBlockHeader& prev)
+{
+    CBlockHeader header;
+    header.nVersion = prev.nVersion;
+    header.hashPrevBlock = prev.GetHash();
+    header.hashMerkleRoot = ArithToUint256(UintToArith256(prev.hashMerkleRoot) + 1);
+    header.nTime = prev.nTime + 1;
+    header.nBits = prev.nBits;
+    SolveBlockHeader(header);
+    return header;
+}
+
+/** Solve a block at height nHeight on top of prev, with a coinbase paying to scriptPubKey and txns. */
+static CBlock MineBlock(const CBlockHeader& prev, int nHeight, const std::vector<CMutableTransaction>& txns = {}, const CScript& scriptPubKey = CScript() << OP_TRUE)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 0;
+    coinbase.vout[0].scriptPubKey = scriptPubKey;
+
+    CBlock block;
+    block.nVersion = prev.nVersion;
+    block.hashPrevBlock = prev.GetHash();
+    block.nTime = prev.nTime + 1;
+    block.nBits = prev.nBits;
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    for (const CMutableTransaction& tx : txns)
+        block.vtx.push_back(MakeTransactionRef(tx));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    SolveBlockHeader(block);
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(process_new_block_headers)
+{
+    const CChainParams& chainparams = Params();
+    std::vector<CBlockHeader> known;
+    CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+        for (int i = 1; i <= chainActive.Height(); i++) {
+            known.push_back(chainActive[i]->GetBlockHeader());
+        }
+    }
+
+    // Headers already in the block index are accepted as before
+    CValidationState state;
+    const CBlockIndex* pindex = nullptr;
+    BOOST_CHECK(ProcessNewBlockHeaders(known, state, chainparams, &pindex));
+    BOOST_CHECK(pindex == tip);
+
+    // A batch of new headers is checked up front and linked in order
+    std::vector<CBlockHeader> headers = known;
+    CBlockHeader prev = tip->GetBlockHeader();
+    for (int i = 0; i < 4; i++) {
+        headers.push_back(MineHeader(prev));
+        prev = headers.back();
+    }
+    BOOST_CHECK(ProcessNewBlockHeaders(headers, state, chainparams, &pindex));
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK(pindex->GetBlockHash() == headers.back().GetHash());
+    BOOST_CHECK_EQUAL(pindex->nHeight, tip->nHeight + 4);
+
+    // A bad solution in the middle of a batch stops it there, with the
+    // same rejection as a serial check
+    CBlockHeader good = MineHeader(prev);
+    CBlockHeader bad = MineHeader(good);
+    bad.nSolution[0] ^= 1;
+    CBlockHeader after = MineHeader(bad);
+    CBlockHeader first_invalid;
+    pindex = nullptr;
+    BOOST_CHECK(!ProcessNewBlockHeaders({good, bad, after}, state, chainparams, &pindex, &first_invalid));
+    BOOST_CHECK(first_invalid.GetHash() == bad.GetHash());
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "invalid-solution");
+    BOOST_CHECK(pindex->GetBlockHash() == good.GetHash());
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mapBlockIndex.count(bad.GetHash()) == 0);
+        BOOST_CHECK(mapBlockIndex.count(after.GetHash()) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pre_check_block_headers)
+{
+    const CChainParams& chainparams = Params();
+    CBlockHeader tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip()->GetBlockHeader();
+    }
+    CBlockHeader good = MineHeader(tip);
+    CBlockHeader bad = MineHeader(good);
+    bad.nSolution[0] ^= 1;
+    CBlockHeader after = MineHeader(bad);
+    CBlockHeader after2 = MineHeader(after);
+    CBlockHeader orphan = MineHeader(good);
+    CBlockHeader orphan_child = MineHeader(orphan);
+
+    // Everything before the first bad solution is checked in parallel
+    std::vector<char> vChecked = PreCheckBlockHeaders({good, bad, after, after2}, chainparams);
+    BOOST_CHECK(vChecked[0] && !vChecked[1]);
+
+    // Checked one at a time, nothing past a bad solution is checked at all,
+    // however many good solutions follow it
+    const int nScriptCheckThreadsOld = nScriptCheckThreads;
+    nScriptCheckThreads = 0;
+    vChecked = PreCheckBlockHeaders({bad, after, after2}, chainparams);
+    BOOST_CHECK(vChecked == std::vector<char>({false, false, false}));
+    vChecked = PreCheckBlockHeaders({good, bad, after, after2}, chainparams);
+    BOOST_CHECK(vChecked == std::vector<char>({true, false, false, false}));
+    nScriptCheckThreads = nScriptCheckThreadsOld;
+
+    // Headers that cannot connect are not checked, whatever their solutions
+    vChecked = PreCheckBlockHeaders({orphan, orphan_child}, chainparams);
+    BOOST_CHECK(vChecked == std::vector<char>({false, false}));
+    vChecked = PreCheckBlockHeaders({good, orphan_child}, chainparams);
+    BOOST_CHECK(vChecked == std::vector<char>({true, false}));
+    vChecked = PreCheckBlockHeaders({good, orphan, orphan_child}, chainparams);
+    BOOST_CHECK(vChecked == std::vector<char>({true, true, true}));
+}
+
+BOOST_AUTO_TEST_CASE(compact_block_index)
+{
+    BOOST_CHECK(fCompactBlockIndex);
+    FlushStateToDisk();
+
+    LOCK(cs_main);
+    CBlockIndex* tip = chainActive.Tip();
+    BOOST_CHECK(!tip->HasSolution());
+
+    // Headers served from a trimmed entry still carry the solution
+    CBlockHeader header = tip->GetBlockHeader();
+    BOOST_CHECK(!header.nSolution.empty());
+    BOOST_CHECK(header.GetHash() == tip->GetBlockHash());
+
+    // Rewriting a trimmed entry keeps the solution in the database
+    CDiskBlockIndex diskindex(tip);
+    BOOST_CHECK(diskindex.nSolution == header.nSolution);
+    BOOST_CHECK(diskindex.GetBlockHash() == tip->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_CASE(read_raw_block)
+{
+    const CChainParams& chainparams = Params();
+    for (int height : {0, 1, 50, 100}) {
+        CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = chainActive[height];
+        }
+        // Raw reads return exactly what deserializing and serializing would
+        std::vector<unsigned char> raw;
+        BOOST_CHECK(ReadRawBlockFromDisk(raw, pindex, chainparams.MessageStart()));
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+        BOOST_CHECK(std::vector<unsigned char>(ss.begin(), ss.end()) == raw);
+
+        // A different network's magic is refused
+        CMessageHeader::MessageStartChars magic;
+        memcpy(magic, chainparams.MessageStart(), sizeof(magic));
+        magic[0] ^= 1;
+        BOOST_CHECK(!ReadRawBlockFromDisk(raw, pindex, magic));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(load_external_block_file)
+{
+    const CChainParams& chainparams = Params();
+    CBlockHeader prev;
+    {
+        LOCK(cs_main);
+        prev = chainActive[99]->GetBlockHeader();
+    }
+    CBlock fork = MineBlock(prev, 100);
+    CBlock child = MineBlock(fork, 101);
+
+    // Garbage and a bad size before the blocks, a cut off block after them,
+    // and a record that does not deserialize but claims the first block as
+    // part of itself
+    fs::path path = GetDataDir() / "import.dat";
+    {
+        CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!fileout.IsNull());
+        fileout << std::vector<unsigned char>(100, 0xfa);
+        fileout << FLATDATA(chainparams.MessageStart()) << (unsigned int)79;
+        const std::vector<unsigned char> garbage(200, 0xff);
+        fileout << FLATDATA(chainparams.MessageStart());
+        fileout << (unsigned int)(garbage.size() + 8 + ::GetSerializeSize(fork, SER_DISK, CLIENT_VERSION));
+        fileout.write((const char*)garbage.data(), garbage.size());
+        for (const CBlock& block : {fork, child}) {
+            fileout << FLATDATA(chainparams.MessageStart()) << (unsigned int)::GetSerializeSize(block, SER_DISK, CLIENT_VERSION) << block;
+        }
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << fork;
+        fileout << FLATDATA(chainparams.MessageStart()) << (unsigned int)ss.size();
+        fileout.write(ss.data(), ss.size() / 2);
+    }
+
+    BOOST_CHECK(LoadExternalBlockFile(chainparams, fsbridge::fopen(path, "rb")));
+    LOCK(cs_main);
+    for (const CBlock& block : {fork, child}) {
+        BlockMap::iterator it = mapBlockIndex.find(block.GetHash());
+        BOOST_REQUIRE(it != mapBlockIndex.end());
+        BOOST_CHECK(it->second->nStatus & BLOCK_HAVE_DATA);
+    }
+    BOOST_CHECK_EQUAL(mapBlockIndex[child.GetHash()]->nHeight, 101);
+}
+
+/** Records the block notifications of the validation interface. */
+class BlockNotifications : public CValidationInterface
+{
+public:
+    std::vector<uint256> vConnected;
+    std::vector<uint256> vDisconnected;
+    std::vector<std::pair<uint256, bool>> vChecked;
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override
+    {
+        vConnected.push_back(block->GetHash());
+    }
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override
+    {
+        vDisconnected.push_back(block->GetHash());
+    }
+    void BlockChecked(const CBlock& block, const CValidationState& state) override
+    {
+        vChecked.emplace_back(block.GetHash(), state.IsValid());
+    }
+};
+
+struct RegTestingSetup : public TestingSetup {
+    RegTestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+};
+
+BOOST_FIXTURE_TEST_CASE(deferred_script_checks_rollback, RegTestingSetup)
+{
+    const CChainParams& chainparams = Params();
+    // Coins that can only be spent with a zero on the stack
+    const CScript scriptNot = CScript() << OP_NOT;
+    auto Spend = [](const CBlock& block, opcodetype op) {
+        CMutableTransaction spend;
+        spend.vin.resize(1);
+        spend.vin[0].prevout = COutPoint(block.vtx[0]->GetHash(), 0);
+        spend.vin[0].scriptSig = CScript() << op;
+        spend.vout.resize(1);
+        spend.vout[0].nValue = 0;
+        spend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        return spend;
+    };
+
+    // A chain old enough to be in initial block download, so that the
+    // script checks of blocks connected together overlap
+    std::vector<CBlock> blocks;
+    CBlockHeader prev;
+    {
+        LOCK(cs_main);
+        prev = chainActive.Tip()->GetBlockHeader();
+    }
+    for (int nHeight = 1; nHeight <= COINBASE_MATURITY; nHeight++) {
+        blocks.push_back(MineBlock(prev, nHeight, {}, scriptNot));
+        BOOST_REQUIRE(ProcessNewBlock(chainparams, std::make_shared<const CBlock>(blocks.back()), true, nullptr));
+        prev = blocks.back();
+    }
+    BOOST_REQUIRE(IsInitialBlockDownload());
+    BOOST_REQUIRE(nScriptCheckThreads && nScriptCheckBlocks >= 4);
+
+    // Four more blocks, of which the second has a script that fails
+    std::vector<CBlock> tail;
+    tail.push_back(MineBlock(prev, COINBASE_MATURITY + 1, {Spend(blocks[0], OP_0)}));
+    tail.push_back(MineBlock(tail.back(), COINBASE_MATURITY + 2, {Spend(blocks[1], OP_1)}));
+    tail.push_back(MineBlock(tail.back(), COINBASE_MATURITY + 3));
+    tail.push_back(MineBlock(tail.back(), COINBASE_MATURITY + 4));
+    CValidationState state;
+    BOOST_REQUIRE(ProcessNewBlockHeaders({tail.begin(), tail.end()}, state, chainparams));
+
+    // Store the later blocks first, so that all four connect in one go
+    for (size_t i = tail.size(); i-- > 1; ) {
+        BOOST_CHECK(ProcessNewBlock(chainparams, std::make_shared<const CBlock>(tail[i]), true, nullptr));
+    }
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Height() == COINBASE_MATURITY);
+    }
+    BlockNotifications notifications;
+    RegisterValidationInterface(&notifications);
+    BOOST_CHECK(ProcessNewBlock(chainparams, std::make_shared<const CBlock>(tail[0]), true, nullptr));
+    SyncWithValidationInterfaceQueue();
+    UnregisterValidationInterface(&notifications);
+
+    // The chain is rolled back to before the failing block, which alone is
+    // marked invalid, and only the block kept was announced
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == tail[0].GetHash());
+        const CBlockIndex* pindex = mapBlockIndex[tail[0].GetHash()];
+        BOOST_CHECK(pindex->IsValid(BLOCK_VALID_SCRIPTS));
+        pindex = mapBlockIndex[tail[1].GetHash()];
+        BOOST_CHECK(pindex->nStatus & BLOCK_FAILED_VALID);
+        for (size_t i = 2; i < tail.size(); i++) {
+            pindex = mapBlockIndex[tail[i].GetHash()];
+            BOOST_CHECK(!(pindex->nStatus & BLOCK_FAILED_VALID));
+            BOOST_CHECK(!pindex->IsValid(BLOCK_VALID_SCRIPTS));
+            BOOST_CHECK(!chainActive.Contains(pindex));
+        }
+    }
+    BOOST_CHECK(notifications.vConnected == std::vector<uint256>({tail[0].GetHash()}));
+    BOOST_CHECK(notifications.vDisconnected.empty());
+    BOOST_REQUIRE_EQUAL(notifications.vChecked.size(), 2U);
+    BOOST_CHECK(notifications.vChecked[0] == std::make_pair(tail[0].GetHash(), true));
+    BOOST_CHECK(notifications.vChecked[1] == std::make_pair(tail[1].GetHash(), false));
+}
+
+/** A block on top of the tip spending the given outpoint, enough to prefetch its inputs. */
+static CBlock SpendingBlock(const COutPoint& outpoint)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = outpoint;
+    spend.vout.resize(1);
+
+    CBlock block;
+    {
+        LOCK(cs_main);
+        block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    }
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    block.vtx.push_back(MakeTransactionRef(std::move(spend)));
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_block_inputs)
+{
+    const COutPoint outpoint(coinbaseTxns[0].GetHash(), 0);
+    const COutPoint outpoint2(coinbaseTxns[1].GetHash(), 0);
+    const CBlock block = SpendingBlock(outpoint);
+    size_t nLoaded;
+
+    // Coins only in the database are read and added to the cache
+    FlushStateToDisk();
+    CBlockInputsPrefetch prefetch;
+    BOOST_CHECK(prefetch.Collect(block));
+    BOOST_CHECK_EQUAL(prefetch.GetReadCount(), 1U);
+    prefetch.Read();
+    BOOST_CHECK(prefetch.Apply(nLoaded));
+    BOOST_CHECK_EQUAL(nLoaded, 1U);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(pcoinsTip->HaveCoinInCache(outpoint));
+    }
+
+    // A coin spent and flushed between the read and the insert stays spent
+    FlushStateToDisk();
+    BOOST_CHECK(prefetch.Collect(block));
+    prefetch.Read();
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(pcoinsTip->SpendCoin(outpoint));
+    }
+    FlushStateToDisk();
+    BOOST_CHECK(!prefetch.Apply(nLoaded));
+    BOOST_CHECK_EQUAL(nLoaded, 0U);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!pcoinsTip->HaveCacheEntry(outpoint));
+        BOOST_CHECK(!pcoinsTip->HaveCoin(outpoint));
+    }
+
+    // A coin spent in the cache only is not read from the database at all
+    const CBlock block2 = SpendingBlock(outpoint2);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(pcoinsTip->SpendCoin(outpoint2));
+        BOOST_CHECK(pcoinsTip->HaveCacheEntry(outpoint2));
+    }
+    BOOST_CHECK(!prefetch.Collect(block2));
+    BOOST_CHECK_EQUAL(prefetch.GetInputCount(), 1U);
+    BOOST_CHECK_EQUAL(prefetch.GetReadCount(), 0U);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!pcoinsTip->HaveCoin(outpoint2));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
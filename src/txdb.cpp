@@ -7,8 +7,10 @@
 
 #include <chainparams.h>
 #include <hash.h>
+#include <memusage.h>
 #include <random.h>
 #include <pow.h>
+#include <reverselock.h>
 #include <uint256.h>
 #include <util.h>
 #include <ui_interface.h>
@@ -30,6 +32,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_COINS_STATS = 'S';
 
 namespace {
 
@@ -59,15 +62,54 @@ CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(Get
 {
 }
 
+CCoinsViewDB::~CCoinsViewDB()
+{
+    {
+        WaitableLock lock(cs_pending);
+        m_stop = true;
+    }
+    cv_pending.notify_all();
+    // The writer commits what is pending before it exits.
+    if (m_writer.joinable())
+        m_writer.join();
+}
+
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        WaitableLock lock(cs_pending);
+        if (m_pending) {
+            CCoinsMap::const_iterator it = m_pending->coins.find(outpoint);
+            if (it != m_pending->coins.end()) {
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    {
+        WaitableLock lock(cs_pending);
+        if (m_pending) {
+            CCoinsMap::const_iterator it = m_pending->coins.find(outpoint);
+            if (it != m_pending->coins.end())
+                return !it->second.coin.IsSpent();
+        }
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    {
+        WaitableLock lock(cs_pending);
+        if (m_pending)
+            return m_pending->hashBlock;
+    }
+    return ReadBestBlock();
+}
+
+uint256 CCoinsViewDB::ReadBestBlock() const {
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -75,6 +117,11 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
+    Sync();
+    return ReadHeadBlocks();
+}
+
+std::vector<uint256> CCoinsViewDB::ReadHeadBlocks() const {
     std::vector<uint256> vhashHeadBlocks;
     if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
         return std::vector<uint256>();
@@ -83,6 +130,77 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!gArgs.GetBoolArg("-dbasyncflush", DEFAULT_DB_ASYNC_FLUSH)) {
+        if (!Sync())
+            return false;
+        bool ret = WriteCoins(mapCoins, hashBlock);
+        mapCoins.clear();
+        return ret;
+    }
+
+    WaitableLock lock(cs_pending);
+    // Only one write at a time, so that the database moves from one best
+    // block to the next.
+    cv_pending.wait(lock, [this]{ return !m_pending || m_write_failed; });
+    if (m_write_failed)
+        return false;
+    std::unique_ptr<PendingWrite> pending(new PendingWrite);
+    pending->coins = std::move(mapCoins);
+    pending->hashBlock = hashBlock;
+    m_pending = std::move(pending);
+    if (!m_writer.joinable())
+        m_writer = std::thread(&CCoinsViewDB::ThreadWriteCoins, this);
+    cv_pending.notify_all();
+    return true;
+}
+
+void CCoinsViewDB::ThreadWriteCoins()
+{
+    RenameThread("bitcoin-coinsdb");
+    WaitableLock lock(cs_pending);
+    while (true) {
+        cv_pending.wait(lock, [this]{ return (m_pending && !m_write_failed) || m_stop; });
+        if (!m_pending || m_write_failed)
+            return;
+        const PendingWrite* pending = m_pending.get();
+        bool ret;
+        {
+            // Readers only look the pending coins up, so they can be written
+            // out without holding the lock.
+            reverse_lock<WaitableLock> unlock(lock);
+            int64_t nStart = GetTimeMicros();
+            try {
+                ret = WriteCoins(pending->coins, pending->hashBlock);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+                ret = false;
+            }
+            LogPrint(BCLog::COINDB, "Background coins write took %.2fs\n", (GetTimeMicros() - nStart) * 0.000001);
+        }
+        if (ret) {
+            m_pending.reset();
+        } else {
+            // Keep answering reads from the pending coins; the next
+            // BatchWrite or Sync reports the failure.
+            LogPrintf("%s: failed to write to coin database\n", __func__);
+            m_write_failed = true;
+        }
+        cv_pending.notify_all();
+    }
+}
+
+bool CCoinsViewDB::Sync() const {
+    WaitableLock lock(cs_pending);
+    cv_pending.wait(lock, [this]{ return !m_pending || m_write_failed; });
+    return !m_write_failed;
+}
+
+size_t CCoinsViewDB::PendingMemoryUsage() const {
+    WaitableLock lock(cs_pending);
+    return m_pending ? memusage::DynamicUsage(m_pending->coins) : 0;
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -90,10 +208,10 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
     assert(!hashBlock.IsNull());
 
-    uint256 old_tip = GetBestBlock();
+    uint256 old_tip = ReadBestBlock();
     if (old_tip.IsNull()) {
         // We may be in the middle of replaying.
-        std::vector<uint256> old_heads = GetHeadBlocks();
+        std::vector<uint256> old_heads = ReadHeadBlocks();
         if (old_heads.size() == 2) {
             assert(old_heads[0] == hashBlock);
             old_tip = old_heads[1];
@@ -107,7 +225,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent())
@@ -117,8 +235,6 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -173,20 +289,71 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // The cursor reads the database directly.
+    Sync();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     i->pcursor->Seek(DB_COIN);
-    // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
+    i->CacheKey();
+    return i;
+}
+
+std::vector<std::unique_ptr<CCoinsViewCursor>> CCoinsViewDB::RangeCursors(int nRanges) const
+{
+    assert(nRanges > 0 && nRanges <= 256);
+    std::shared_ptr<const leveldb::Snapshot> snapshot;
+    {
+        // Snapshot while holding the lock, so that no background write can
+        // start in between and leave the snapshot half way to the next block.
+        WaitableLock lock(cs_pending);
+        cv_pending.wait(lock, [this]{ return !m_pending || m_write_failed; });
+        if (m_write_failed)
+            return std::vector<std::unique_ptr<CCoinsViewCursor>>();
+        snapshot = db.GetSnapshot();
+    }
+
+    // Read the best block through the snapshot too.
+    uint256 hashBestChain;
+    {
+        std::unique_ptr<CDBIterator> it(db.NewIterator(snapshot.get()));
+        it->Seek(DB_BEST_BLOCK);
+        char key;
+        if (it->Valid() && it->GetKey(key) && key == DB_BEST_BLOCK)
+            it->GetValue(hashBestChain);
+    }
+
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    for (int i = 0; i < nRanges; i++) {
+        unsigned int nBegin = 256 * i / nRanges;
+        unsigned int nEnd = 256 * (i + 1) / nRanges;
+        CCoinsViewDBCursor *cursor = new CCoinsViewDBCursor(db.NewIterator(snapshot.get()), hashBestChain, snapshot, nEnd);
+        cursors.emplace_back(cursor);
+        uint256 start;
+        *start.begin() = nBegin;
+        cursor->pcursor->Seek(std::make_pair(DB_COIN, start));
+        cursor->CacheKey();
+    }
+    return cursors;
+}
+
+bool CCoinsViewDB::ReadCoinsStats(CCoinsStats &stats) const {
+    return db.Read(DB_COINS_STATS, stats);
+}
+
+bool CCoinsViewDB::WriteCoinsStats(const CCoinsStats &stats) {
+    return db.Write(DB_COINS_STATS, stats);
+}
+
+void CCoinsViewDBCursor::CacheKey()
+{
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry) || (entry.key == DB_COIN && *keyTmp.second.hash.begin() >= nEnd)) {
+        keyTmp.first = 0; // Make sure Valid() and GetKey() return false
     } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+        keyTmp.first = entry.key;
     }
-    return i;
 }
 
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
@@ -217,12 +384,8 @@ bool CCoinsViewDBCursor::Valid() const
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
-    CoinEntry entry(&keyTmp.second);
-    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
-        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
-    } else {
-        keyTmp.first = entry.key;
-    }
+    // Invalidates the cached key after the last record
+    CacheKey();
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -237,6 +400,10 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &hash, CDiskBlockIndex &diskindex) {
+    return Read(std::make_pair(DB_BLOCK_INDEX, hash), diskindex);
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
 }
@@ -260,7 +427,7 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, bool fTrimSolutions)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -285,7 +452,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
                 pindexNew->nTime          = diskindex.nTime;
                 pindexNew->nBits          = diskindex.nBits;
                 pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
+                // With a compact block index the solution stays on disk
+                if (!fTrimSolutions)
+                    pindexNew->nSolution  = diskindex.nSolution;
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
 
@@ -9,9 +9,12 @@
 #include <coins.h>
 #include <dbwrapper.h>
 #include <chain.h>
+#include <sync.h>
 
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -25,6 +28,8 @@ static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -dbasyncflush default
+static const bool DEFAULT_DB_ASYNC_FLUSH = true;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -38,6 +43,34 @@ static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
+/** Statistics about the unspent transaction output set at one block. */
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    uint256 hashSerialized;
+    uint64_t nDiskSize;
+    CAmount nTotalAmount;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(hashSerialized);
+        READWRITE(nTotalAmount);
+    }
+};
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -68,8 +101,34 @@ class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    /**
+     * With -dbasyncflush, BatchWrite hands the coins to a background thread
+     * and returns. Until they are committed, reads are answered from them
+     * first, so the view always reflects the last BatchWrite. The database
+     * itself goes from the old to the new best block through the usual
+     * DB_HEAD_BLOCKS marker, so a crash mid-write is recovered by
+     * ReplayBlocks as before.
+     */
+    struct PendingWrite {
+        CCoinsMap coins;
+        uint256 hashBlock;
+    };
+    mutable CWaitableCriticalSection cs_pending;
+    mutable CConditionVariable cv_pending;
+    //! Coins waiting to be committed, if any (guarded by cs_pending)
+    std::unique_ptr<const PendingWrite> m_pending;
+    bool m_write_failed = false;
+    bool m_stop = false;
+    std::thread m_writer;
+
+    uint256 ReadBestBlock() const;
+    std::vector<uint256> ReadHeadBlocks() const;
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock);
+    void ThreadWriteCoins();
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
@@ -81,6 +140,25 @@ public:
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    //! Wait for coins handed to BatchWrite to be on disk. Returns false if writing them failed.
+    bool Sync() const;
+    //! Memory used by coins that are still being written
+    size_t PendingMemoryUsage() const;
+
+    /**
+     * Split the coins into nRanges cursors by the leading byte of their
+     * txid (at most 256), all reading the same state of the database, so
+     * that the set can be scanned in parallel. Returns no cursors if coins
+     * handed to BatchWrite failed to be written.
+     */
+    std::vector<std::unique_ptr<CCoinsViewCursor>> RangeCursors(int nRanges) const;
+
+    const CDBWrapper& GetDB() const { return db; }
+
+    //! Statistics kept from the last full scan, with an unordered set hash
+    bool ReadCoinsStats(CCoinsStats &stats) const;
+    bool WriteCoinsStats(const CCoinsStats &stats);
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -97,10 +175,16 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, std::shared_ptr<const leveldb::Snapshot> snapshotIn = nullptr, unsigned int nEndIn = 256):
+        CCoinsViewCursor(hashBlockIn), snapshot(std::move(snapshotIn)), pcursor(pcursorIn), nEnd(nEndIn) {}
+    void CacheKey();
+
+    //! Kept alive for as long as the iterator reading from it
+    std::shared_ptr<const leveldb::Snapshot> snapshot;
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
+    //! Stop at the first txid whose leading byte is at least this
+    unsigned int nEnd;
 
     friend class CCoinsViewDB;
 };
@@ -116,6 +200,7 @@ public:
 
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &info);
+    bool ReadDiskBlockIndex(const uint256 &hash, CDiskBlockIndex &diskindex);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool &fReindexing);
@@ -123,7 +208,7 @@ public:
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, bool fTrimSolutions = false);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -10,6 +10,7 @@
 #include <utiltime.h>
 
 #include <atomic>
+#include <chrono>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread.hpp>
@@ -52,6 +53,11 @@ int64_t GetTimeMicros()
     return now;
 }
 
+int64_t GetPerfTimeNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 int64_t GetSystemTimeInSeconds()
 {
     return GetTimeMicros()/1000000;
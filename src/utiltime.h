@@ -22,6 +22,8 @@
 int64_t GetTime();
 int64_t GetTimeMillis();
 int64_t GetTimeMicros();
+/** Monotonic time in nanoseconds, for timing short operations. Not mockable. */
+int64_t GetPerfTimeNanos();
 int64_t GetSystemTimeInSeconds(); // Like GetTime(), but not mockable
 void SetMockTime(int64_t nMockTimeIn);
 int64_t GetMockTime();
@@ -42,6 +42,14 @@
 
 #include <future>
 #include <sstream>
+#include <thread>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -49,6 +57,7 @@
 
 #define MICRO 0.000001
 #define MILLI 0.001
+#define NANO 0.000000001
 
 /**
  * Global state
@@ -84,6 +93,7 @@ enum DisconnectResult
 };
 
 class ConnectTrace;
+class CDeferredScriptChecks;
 
 /**
  * CChainState stores and provides an API to update our local knowledge of the
@@ -150,16 +160,17 @@ public:
 
     bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock);
 
-    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex);
+    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckedPOW = false);
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock);
 
     // Block (dis)connection on a given view:
     DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
     bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false);
+                    CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false,
+                    CDeferredScriptChecks* pdeferred = nullptr);
 
     // Block disconnection on our pcoinsTip:
-    bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool);
+    bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool, bool fNotify = true);
 
     // Manual block validity manipulation:
     bool PreciousBlock(CValidationState& state, const CChainParams& params, CBlockIndex *pindex);
@@ -176,7 +187,8 @@ public:
 
 private:
     bool ActivateBestChainStep(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace);
-    bool ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool);
+    bool ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool, CDeferredScriptChecks* pdeferred);
+    bool CompleteDeferredScriptChecks(CValidationState& state, const CChainParams& chainparams, CDeferredScriptChecks& deferred, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool, CBlockIndex*& pindexInvalid);
 
     CBlockIndex* AddToBlockIndex(const CBlockHeader& block);
     /** Create a new block index entry for a given block hash */
@@ -201,6 +213,8 @@ CBlockIndex *pindexBestHeader = nullptr;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nScriptCheckBlocks = DEFAULT_SCRIPTCHECK_BLOCKS;
+int nPrefetchThreads = DEFAULT_PREFETCH_THREADS;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fTxIndex = false;
@@ -210,6 +224,8 @@ bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fCompactBlockIndex = DEFAULT_COMPACT_BLOCK_INDEX;
+bool fParanoidBlockReads = DEFAULT_PARANOID_BLOCK_READS;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -1085,7 +1101,7 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+static bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckSolution)
 {
     block.SetNull();
 
@@ -1103,7 +1119,7 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     }
 
     // Check Equihash solution
-    if (!CheckEquihashSolution(&block, Params())) {
+    if (fCheckSolution && !CheckEquihashSolution(&block, Params())) {
         return error("ReadBlockFromDisk: Errors in block header at %s (bad Equihash solution)", pos.ToString());
     }
 
@@ -1114,15 +1130,24 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     return true;
 }
 
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+{
+    return ReadBlockFromDisk(block, pos, consensusParams, true);
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
     CDiskBlockPos blockPos;
+    bool fCheckSolution;
     {
         LOCK(cs_main);
         blockPos = pindex->GetBlockPos();
+        // The solution of an indexed header was verified when it was
+        // accepted, and the hash check below ties what we read back to it.
+        fCheckSolution = fParanoidBlockReads || !pindex->IsValid(BLOCK_VALID_HEADER);
     }
 
-    if (!ReadBlockFromDisk(block, blockPos, consensusParams))
+    if (!ReadBlockFromDisk(block, blockPos, consensusParams, fCheckSolution))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
@@ -1130,6 +1155,162 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+namespace {
+
+/** A read-only mapping of a block file, as far as it had been written when mapped. */
+class CMappedBlockFile
+{
+public:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    uint64_t nLastUsed = 0;
+
+    CMappedBlockFile() = default;
+    CMappedBlockFile(const CMappedBlockFile&) = delete;
+    CMappedBlockFile& operator=(const CMappedBlockFile&) = delete;
+    ~CMappedBlockFile()
+    {
+#ifndef WIN32
+        if (data) munmap((void*)data, size);
+#endif
+    }
+};
+
+//! Mappings are only used where address space is plentiful
+static const bool fMapBlockFiles = sizeof(void*) >= 8;
+//! Block files kept mapped at once
+static const size_t MAX_MAPPED_BLOCK_FILES = 64;
+//! Bytes of a raw block looked at to find its header, whatever the Equihash parameters
+static const size_t MAX_RAW_BLOCK_HEADER_SIZE = 1 << 16;
+
+CCriticalSection cs_mapped_block_files;
+std::map<int, std::shared_ptr<CMappedBlockFile>> mapMappedBlockFiles;
+uint64_t nMappedBlockFilesUse = 0;
+
+/**
+ * Map block file nFile, covering at least its first nNeeded bytes. Mappings
+ * are shared; readers keep theirs alive while the cache drops or replaces
+ * it. Returns nullptr where mapping is unavailable.
+ */
+std::shared_ptr<const CMappedBlockFile> MapBlockFile(int nFile, size_t nNeeded)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    if (!fMapBlockFiles)
+        return nullptr;
+    LOCK(cs_mapped_block_files);
+    std::shared_ptr<CMappedBlockFile>& mapped = mapMappedBlockFiles[nFile];
+    if (!mapped || mapped->size < nNeeded) {
+        // Map the file afresh, as it may have grown since it was last mapped.
+        mapped.reset();
+        fs::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd == -1) {
+            mapMappedBlockFiles.erase(nFile);
+            return nullptr;
+        }
+        struct stat st;
+        void* data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= nNeeded && st.st_size > 0) {
+            data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (data == MAP_FAILED) {
+            mapMappedBlockFiles.erase(nFile);
+            return nullptr;
+        }
+        mapped = std::make_shared<CMappedBlockFile>();
+        mapped->data = (const unsigned char*)data;
+        mapped->size = st.st_size;
+        if (mapMappedBlockFiles.size() > MAX_MAPPED_BLOCK_FILES) {
+            // Drop the least recently used other mapping.
+            auto lru = mapMappedBlockFiles.end();
+            for (auto it = mapMappedBlockFiles.begin(); it != mapMappedBlockFiles.end(); ++it) {
+                if (it->first != nFile && (lru == mapMappedBlockFiles.end() || it->second->nLastUsed < lru->second->nLastUsed))
+                    lru = it;
+            }
+            mapMappedBlockFiles.erase(lru);
+        }
+    }
+    mapped->nLastUsed = ++nMappedBlockFilesUse;
+    return mapped;
+#endif
+}
+
+/** Forget the mapping of a block file that is about to be deleted. */
+void UnmapBlockFile(int nFile)
+{
+    LOCK(cs_mapped_block_files);
+    mapMappedBlockFiles.erase(nFile);
+}
+
+} // namespace
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    CDiskBlockPos blockPos;
+    {
+        LOCK(cs_main);
+        blockPos = pindex->GetBlockPos();
+    }
+    // The block is preceded by the network magic and its size.
+    const unsigned int nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+    if (blockPos.IsNull() || blockPos.nPos < nHeaderSize)
+        return error("%s: no block position for %s", __func__, pindex->ToString());
+    const size_t nStart = blockPos.nPos - nHeaderSize;
+
+    unsigned char header[nHeaderSize];
+    std::shared_ptr<const CMappedBlockFile> mapped = MapBlockFile(blockPos.nFile, blockPos.nPos);
+    if (mapped) {
+        memcpy(header, mapped->data + nStart, nHeaderSize);
+    } else {
+        CAutoFile filein(OpenBlockFile(CDiskBlockPos(blockPos.nFile, nStart), true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed for %s", __func__, blockPos.ToString());
+        try {
+            filein.read((char*)header, nHeaderSize);
+        } catch (const std::exception& e) {
+            return error("%s: Read from block file failed: %s for %s", __func__, e.what(), blockPos.ToString());
+        }
+    }
+    if (memcmp(header, message_start, CMessageHeader::MESSAGE_START_SIZE))
+        return error("%s: Block magic mismatch for %s", __func__, blockPos.ToString());
+    const uint32_t nSize = ReadLE32(header + CMessageHeader::MESSAGE_START_SIZE);
+    if (nSize > MAX_BLOCK_SERIALIZED_SIZE)
+        return error("%s: Block data is larger than maximum deserialization size for %s: %u versus %u", __func__, blockPos.ToString(), nSize, MAX_BLOCK_SERIALIZED_SIZE);
+
+    if (mapped && mapped->size < (size_t)blockPos.nPos + nSize) {
+        mapped = MapBlockFile(blockPos.nFile, (size_t)blockPos.nPos + nSize);
+    }
+    if (mapped) {
+        block.assign(mapped->data + blockPos.nPos, mapped->data + blockPos.nPos + nSize);
+    } else {
+        CAutoFile filein(OpenBlockFile(blockPos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed for %s", __func__, blockPos.ToString());
+        try {
+            block.resize(nSize);
+            filein.read((char*)block.data(), nSize);
+        } catch (const std::exception& e) {
+            return error("%s: Read from block file failed: %s for %s", __func__, e.what(), blockPos.ToString());
+        }
+    }
+
+    // The block was fully checked when it was accepted; make sure these are
+    // still its bytes by hashing the header.
+    CBlockHeader blockHeader;
+    try {
+        CDataStream ssHeader((const char*)block.data(), (const char*)block.data() + std::min<size_t>(block.size(), MAX_RAW_BLOCK_HEADER_SIZE), SER_DISK, CLIENT_VERSION);
+        ssHeader >> blockHeader;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), blockPos.ToString());
+    }
+    if (blockHeader.GetHash() != pindex->GetBlockHash())
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__, pindex->ToString(), blockPos.ToString());
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     if (nHeight == 0) {
@@ -1147,10 +1328,12 @@ CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
     return nSubsidy;
 }
 
+// Once IsInitialBlockDownload() has returned false, it must remain false,
+// until the block index is unloaded.
+static std::atomic<bool> latchToFalse{false};
+
 bool IsInitialBlockDownload()
 {
-    // Once this function has returned false, it must remain false.
-    static std::atomic<bool> latchToFalse{false};
     // Optimization: pre-test latch before taking the lock.
     if (latchToFalse.load(std::memory_order_relaxed))
         return false;
@@ -1319,6 +1502,83 @@ bool CScriptCheck::operator()() {
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
 }
 
+bool CScriptCheck::RunDeferred(CSignatureBatch& batch) {
+    const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+    const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
+    return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, DeferringTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata, batch), &error);
+}
+
+bool CScriptCheck::RunBatch(std::vector<CScriptCheck>& vChecks) {
+    if (vChecks.size() < 2) {
+        for (CScriptCheck& check : vChecks)
+            if (!check())
+                return false;
+        return true;
+    }
+
+    // First pass: evaluate every script with signature checks deferred. The
+    // range of batch entries each check added is remembered so that a failing
+    // signature can be traced back to its check.
+    CSignatureBatch batch;
+    std::vector<std::pair<size_t, size_t>> vRanges(vChecks.size());
+    for (size_t i = 0; i < vChecks.size(); i++) {
+        size_t nBegin = batch.size();
+        if (vChecks[i].RunDeferred(batch)) {
+            vRanges[i] = std::make_pair(nBegin, batch.size());
+            continue;
+        }
+        // The script failed even with all signatures assumed valid; it may
+        // still succeed for real (e.g. a CHECKSIG NOT construction), so drop
+        // its deferred signatures and evaluate it normally.
+        batch.Truncate(nBegin);
+        vRanges[i] = std::make_pair(nBegin, nBegin);
+        if (!vChecks[i]())
+            return false;
+    }
+
+    std::vector<bool> vValid;
+    if (batch.Verify(vValid))
+        return true;
+
+    // Some deferred signature was invalid, so the first pass result of its
+    // check cannot be trusted. Evaluate those checks again individually.
+    for (size_t i = 0; i < vChecks.size(); i++) {
+        bool fAllValid = true;
+        for (size_t j = vRanges[i].first; j < vRanges[i].second; j++)
+            fAllValid &= vValid[j];
+        if (!fAllValid && !vChecks[i]())
+            return false;
+    }
+    return true;
+}
+
+bool CBlockScriptCheck::operator()() {
+    if (check())
+        return true;
+    if (!pfFailed)
+        return false;
+    *pfFailed = true;
+    return true;
+}
+
+bool CBlockScriptCheck::RunBatch(std::vector<CBlockScriptCheck>& vChecks) {
+    std::vector<CScriptCheck> vScriptChecks(vChecks.size());
+    for (size_t i = 0; i < vChecks.size(); i++)
+        vScriptChecks[i].swap(vChecks[i].check);
+    bool fOk = CScriptCheck::RunBatch(vScriptChecks);
+    for (size_t i = 0; i < vChecks.size(); i++)
+        vChecks[i].check.swap(vScriptChecks[i]);
+    if (fOk)
+        return true;
+
+    // The batch does not say which check failed; when that matters, find
+    // out one by one.
+    for (CBlockScriptCheck& check : vChecks)
+        if (!check())
+            return false;
+    return true;
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -1673,13 +1933,185 @@ static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& stat
     return true;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CBlockScriptCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck() {
     RenameThread("bitcoin-scriptch");
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Script checks of consecutive blocks connected in one ActivateBestChainStep.
+ * ConnectBlock queues them without waiting, so that the check threads stay
+ * busy while the next blocks are read and their inputs fetched, and all of
+ * them are waited for at once before the step completes.
+ */
+class CDeferredScriptChecks
+{
+public:
+    struct Block {
+        CBlockIndex* pindex;
+        const CBlock* pblock;
+        std::vector<PrecomputedTransactionData> txdata; //!< referenced by the queued checks
+        std::atomic<bool> fFailed{false};
+
+        Block(CBlockIndex* pindexIn, const CBlock* pblockIn) : pindex(pindexIn), pblock(pblockIn) {}
+    };
+
+    /** Keep a block alive until its checks are done. */
+    void Hold(std::shared_ptr<const CBlock> pblock)
+    {
+        vHeld.push_back(std::move(pblock));
+    }
+
+    Block& Add(CBlockIndex* pindex, const CBlock& block)
+    {
+        vBlocks.emplace_back(new Block(pindex, &block));
+        return *vBlocks.back();
+    }
+
+    void Add(std::vector<CBlockScriptCheck>& vChecks)
+    {
+        if (!control)
+            control.reset(new CCheckQueueControl<CBlockScriptCheck>(&scriptcheckqueue));
+        control->Add(vChecks);
+    }
+
+    bool IsPending(const CBlockIndex* pindex) const
+    {
+        return !vBlocks.empty() && vBlocks.back()->pindex == pindex;
+    }
+
+    bool empty() const { return vBlocks.empty(); }
+
+    /** Wait for every queued check. Failures are left in the blocks' flags. */
+    const std::vector<std::unique_ptr<Block>>& Wait()
+    {
+        if (control) {
+            control->Wait();
+            control.reset();
+        }
+        return vBlocks;
+    }
+
+    void Clear()
+    {
+        assert(!control);
+        vBlocks.clear();
+        vHeld.clear();
+    }
+
+private:
+    // Declared so that the checks are waited for before what they use goes away
+    std::vector<std::shared_ptr<const CBlock>> vHeld;
+    std::vector<std::unique_ptr<Block>> vBlocks;
+    std::unique_ptr<CCheckQueueControl<CBlockScriptCheck>> control;
+};
+
+static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true);
+
+/**
+ * Closure representing the context-free checks of one header (Equihash
+ * solution and proof of work). The outcome is recorded per header, so that
+ * a batch can be checked in parallel and still be accepted in order. As the
+ * batch is accepted only up to its first invalid header, headers after a
+ * known failure are skipped.
+ */
+class CHeaderCheck
+{
+private:
+    const CBlockHeader *pheader;
+    const Consensus::Params *pconsensusParams;
+    char *pfValid;
+    size_t nIndex;
+    std::atomic<size_t> *pnFirstInvalid;
+
+public:
+    CHeaderCheck(): pheader(nullptr), pconsensusParams(nullptr), pfValid(nullptr), nIndex(0), pnFirstInvalid(nullptr) {}
+    CHeaderCheck(const CBlockHeader& headerIn, const Consensus::Params& consensusParamsIn, char* pfValidIn, size_t nIndexIn, std::atomic<size_t>* pnFirstInvalidIn) :
+        pheader(&headerIn), pconsensusParams(&consensusParamsIn), pfValid(pfValidIn), nIndex(nIndexIn), pnFirstInvalid(pnFirstInvalidIn) {}
+
+    bool operator()() {
+        if (nIndex > pnFirstInvalid->load())
+            return true;
+        CValidationState state;
+        *pfValid = CheckBlockHeader(*pheader, state, *pconsensusParams);
+        if (!*pfValid) {
+            size_t nFirst = pnFirstInvalid->load();
+            while (nIndex < nFirst && !pnFirstInvalid->compare_exchange_weak(nFirst, nIndex)) {}
+        }
+        // A failure only concerns this header and the ones after it; the
+        // ones before it are still needed.
+        return true;
+    }
+
+    void swap(CHeaderCheck& check) {
+        std::swap(pheader, check.pheader);
+        std::swap(pconsensusParams, check.pconsensusParams);
+        std::swap(pfValid, check.pfValid);
+        std::swap(nIndex, check.nIndex);
+        std::swap(pnFirstInvalid, check.pnFirstInvalid);
+    }
+};
+
+// Equihash checks are expensive, so hand them out a few at a time.
+static CCheckQueue<CHeaderCheck> headercheckqueue(8);
+
+void ThreadHeaderCheck() {
+    RenameThread("bitcoin-headerch");
+    headercheckqueue.Thread();
+}
+
+/**
+ * Closure representing one coin to read from the UTXO database ahead of
+ * ConnectBlock.
+ */
+class CCoinsPrefetch
+{
+private:
+    const CCoinsView *pview;
+    const COutPoint *poutpoint;
+    Coin *pcoin;
+    char *pfFound;
+    std::atomic<int64_t> *pnReadMicros;
+
+public:
+    CCoinsPrefetch(): pview(nullptr), poutpoint(nullptr), pcoin(nullptr), pfFound(nullptr), pnReadMicros(nullptr) {}
+    CCoinsPrefetch(const CCoinsView& viewIn, const COutPoint& outpointIn, Coin& coinIn, char* pfFoundIn, std::atomic<int64_t>& nReadMicrosIn) :
+        pview(&viewIn), poutpoint(&outpointIn), pcoin(&coinIn), pfFound(pfFoundIn), pnReadMicros(&nReadMicrosIn) {}
+
+    bool operator()() {
+        int64_t nStart = GetTimeMicros();
+        try {
+            *pfFound = pview->GetCoin(*poutpoint, *pcoin);
+        } catch (const std::exception&) {
+            // ConnectBlock will read it again and handle the error there.
+            *pfFound = false;
+        }
+        *pnReadMicros += GetTimeMicros() - nStart;
+        return true;
+    }
+
+    void swap(CCoinsPrefetch& check) {
+        std::swap(pview, check.pview);
+        std::swap(poutpoint, check.poutpoint);
+        std::swap(pcoin, check.pcoin);
+        std::swap(pfFound, check.pfFound);
+        std::swap(pnReadMicros, check.pnReadMicros);
+    }
+};
+
+static CCheckQueue<CCoinsPrefetch> prefetchqueue(16);
+
+void ThreadPrefetchCoins() {
+    RenameThread("bitcoin-prefetch");
+    prefetchqueue.Thread();
+}
+
+/** Bumped whenever a block is connected to or disconnected from pcoinsTip and
+ *  whenever pcoinsTip is written to the database. Protected by cs_main. */
+static uint64_t nCoinsTipSequence = 0;
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1761,12 +2193,20 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
+static BlockInputStats blockInputStats = {};
+
+BlockInputStats GetBlockInputStats()
+{
+    LOCK(cs_main);
+    return blockInputStats;
+}
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck,
+                  CDeferredScriptChecks* pdeferred)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -1907,14 +2347,23 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    // Leave the script checks running for pdeferred to collect, if given.
+    const bool fDeferChecks = pdeferred && fScriptChecks && nScriptCheckThreads && !fJustCheck;
+    CCheckQueueControl<CBlockScriptCheck> control(fScriptChecks && nScriptCheckThreads && !fDeferChecks ? &scriptcheckqueue : nullptr);
+    CDeferredScriptChecks::Block* pdeferredBlock = fDeferChecks ? &pdeferred->Add(pindex, block) : nullptr;
+
+    // Signatures checked by mempool acceptance in the meantime end up in
+    // these numbers too; they are meant for tuning, not exact.
+    const SignatureCheckStats sigStatsStart = GetSignatureCheckStats();
+    int64_t nCoinFetchNanos = 0;
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<PrecomputedTransactionData> txdata;
+    std::vector<PrecomputedTransactionData> txdataLocal;
+    std::vector<PrecomputedTransactionData>& txdata = pdeferredBlock ? pdeferredBlock->txdata : txdataLocal;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
@@ -1925,9 +2374,11 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         if (!tx.IsCoinBase())
         {
             CAmount txfee = 0;
+            int64_t nFetchStart = GetPerfTimeNanos();
             if (!Consensus::CheckTxInputs(tx, state, view, pindex->nHeight, txfee)) {
                 return error("%s: Consensus::CheckTxInputs: %s, %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
             }
+            nCoinFetchNanos += GetPerfTimeNanos() - nFetchStart;
             nFees += txfee;
             if (!MoneyRange(nFees)) {
                 return state.DoS(100, error("%s: accumulated fee in the block out of range.", __func__),
@@ -1965,7 +2416,14 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : nullptr))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
-            control.Add(vChecks);
+            std::vector<CBlockScriptCheck> vBlockChecks;
+            vBlockChecks.reserve(vChecks.size());
+            for (CScriptCheck& check : vChecks)
+                vBlockChecks.emplace_back(check, pdeferredBlock ? &pdeferredBlock->fFailed : nullptr);
+            if (pdeferredBlock)
+                pdeferred->Add(vBlockChecks);
+            else
+                control.Add(vBlockChecks);
         }
 
         CTxUndo undoDummy;
@@ -1988,14 +2446,29 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
+    if (LogAcceptCategory(BCLog::BENCH)) {
+        // With deferred script checks only part of the verification has happened yet
+        const SignatureCheckStats sigStats = GetSignatureCheckStats();
+        LogPrint(BCLog::BENCH, "      - Signatures: %u verified in %.2fms, %u cached, sighash %.2fms, coin fetch %.2fms%s [%.2fs verify, %.2fs sighash, %.2fs coins]\n",
+                 (unsigned)(sigStats.nVerified - sigStatsStart.nVerified), (sigStats.nVerifyNanos - sigStatsStart.nVerifyNanos) * MICRO,
+                 (unsigned)(sigStats.nCacheHits - sigStatsStart.nCacheHits), (sigStats.nSighashNanos - sigStatsStart.nSighashNanos) * MICRO,
+                 nCoinFetchNanos * MICRO, fScriptChecks ? "" : ", scripts assumed valid",
+                 sigStats.nVerifyNanos * NANO, sigStats.nSighashNanos * NANO, (blockInputStats.nCoinFetchNanos + nCoinFetchNanos) * NANO);
+    }
 
     if (fJustCheck)
         return true;
 
+    blockInputStats.nBlocks++;
+    blockInputStats.nInputs += nInputs - 1;
+    if (!fScriptChecks)
+        blockInputStats.nAssumedValidInputs += nInputs - 1;
+    blockInputStats.nCoinFetchNanos += nCoinFetchNanos;
+
     if (!WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
         return false;
 
-    if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+    if (!pdeferredBlock && !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
     }
@@ -2065,7 +2538,8 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
-        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
+        // Don't start early while the previous flush is still being written, as that would wait for it.
+        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024) && pcoinsdbview->PendingMemoryUsage() == 0;
         // The cache is over the limit, we have to write now.
         bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
@@ -2091,17 +2565,29 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                 }
                 std::vector<const CBlockIndex*> vBlocks;
                 vBlocks.reserve(setDirtyBlockIndex.size());
+                std::vector<CBlockIndex*> vTrim;
                 for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
                     vBlocks.push_back(*it);
+                    if (fCompactBlockIndex && (*it)->HasSolution())
+                        vTrim.push_back(*it);
                     setDirtyBlockIndex.erase(it++);
                 }
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Failed to write to block index database");
                 }
+                // The solutions can now be read back from the block tree
+                // database, so there is no need to keep them in memory.
+                for (CBlockIndex* pindex : vTrim) {
+                    pindex->TrimSolution();
+                }
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune)
+            // Finally remove any pruned files, once the chainstate no
+            // longer needs them to be replayed.
+            if (fFlushForPrune) {
+                if (!pcoinsdbview->Sync())
+                    return AbortNode(state, "Failed to write to coin database");
                 UnlinkPrunedFiles(setFilesToPrune);
+            }
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2114,8 +2600,13 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
+            nCoinsTipSequence++;
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            // Other flushes are written in the background while validation
+            // goes on; callers asking for everything to be on disk wait.
+            if (mode == FLUSH_STATE_ALWAYS && !pcoinsdbview->Sync())
+                return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
         }
     }
@@ -2214,8 +2705,10 @@ void static UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainPar
   * If disconnectpool is nullptr, then no disconnected transactions are added to
   * disconnectpool (note that the caller is responsible for mempool consistency
   * in any case).
+  *
+  * fNotify is false when the block's connection was never announced.
   */
-bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool)
+bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool, bool fNotify)
 {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
@@ -2233,6 +2726,7 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
+        nCoinsTipSequence++;
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
@@ -2257,7 +2751,8 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
     UpdateTip(pindexDelete->pprev, chainparams);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
-    GetMainSignals().BlockDisconnected(pblock);
+    if (fNotify)
+        GetMainSignals().BlockDisconnected(pblock);
     return true;
 }
 
@@ -2312,6 +2807,14 @@ public:
         blocksConnected.emplace_back();
     }
 
+    /** Forget the last block connected, which has been disconnected again before being announced. */
+    void BlockDisconnected() {
+        assert(!blocksConnected.back().pindex);
+        blocksConnected.pop_back();
+        assert(!blocksConnected.empty());
+        blocksConnected.back() = PerBlockConnectTrace();
+    }
+
     std::vector<PerBlockConnectTrace>& GetBlocksConnected() {
         // We always keep one extra block at the end of our list because
         // blocks are added after all the conflicted transactions have
@@ -2336,9 +2839,11 @@ public:
  * Connect a new block to chainActive. pblock is either nullptr or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
  *
- * The block is added to connectTrace if connection succeeds.
+ * The block is added to connectTrace if connection succeeds. If pdeferred is
+ * given, its script checks may still be running when this returns; see
+ * CompleteDeferredScriptChecks.
  */
-bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool)
+bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool, CDeferredScriptChecks* pdeferred)
 {
     assert(pindexNew->pprev == chainActive.Tip());
     // Read block from disk.
@@ -2359,8 +2864,12 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
         CCoinsViewCache view(pcoinsTip.get());
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
-        GetMainSignals().BlockChecked(blockConnecting, state);
+        if (pdeferred)
+            pdeferred->Hold(pthisBlock);
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, false, pdeferred);
+        // A block with script checks outstanding is reported once they are done
+        if (!rv || !pdeferred || !pdeferred->IsPending(pindexNew))
+            GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
                 InvalidBlockFound(pindexNew, state);
@@ -2370,11 +2879,13 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
         bool flushed = view.Flush();
         assert(flushed);
+        nCoinsTipSequence++;
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
-    // Write the chain state to disk, if necessary.
-    if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED))
+    // Write the chain state to disk, if necessary. Not while it contains
+    // blocks with script checks outstanding, though.
+    if ((!pdeferred || pdeferred->empty()) && !FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED))
         return false;
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
@@ -2463,6 +2974,63 @@ void CChainState::PruneBlockIndexCandidates() {
     assert(!setBlockIndexCandidates.empty());
 }
 
+/**
+ * Wait for the script checks ConnectTip left running and report the blocks
+ * they belong to. If any failed, the chain is rolled back to before the
+ * earliest failing block, which is marked invalid and returned in
+ * pindexInvalid. Returns false only on a system error.
+ */
+bool CChainState::CompleteDeferredScriptChecks(CValidationState& state, const CChainParams& chainparams, CDeferredScriptChecks& deferred, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool, CBlockIndex*& pindexInvalid)
+{
+    AssertLockHeld(cs_main);
+    if (deferred.empty())
+        return true;
+
+    int64_t nTimeStart = GetTimeMicros();
+    const SignatureCheckStats sigStatsStart = GetSignatureCheckStats();
+    unsigned int nBlocks = 0;
+    for (const auto& block : deferred.Wait()) {
+        // A block that failed to connect has been reported already, and the
+        // ones after a failing block are rolled back without being reported,
+        // as they would not have been connected without the deferral
+        if (!chainActive.Contains(block->pindex) || pindexInvalid)
+            continue;
+        nBlocks++;
+        CValidationState stateBlock;
+        if (block->fFailed) {
+            stateBlock.DoS(100, error("ConnectBlock(): CheckQueue failed for %s", block->pindex->GetBlockHash().ToString()),
+                           REJECT_INVALID, "block-validation-failed");
+            if (!pindexInvalid)
+                pindexInvalid = block->pindex;
+        } else if (!block->pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+            block->pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            setDirtyBlockIndex.insert(block->pindex);
+        }
+        GetMainSignals().BlockChecked(*block->pblock, stateBlock);
+    }
+    const SignatureCheckStats sigStats = GetSignatureCheckStats();
+    LogPrint(BCLog::BENCH, "  - Verify deferred scripts of %u blocks: %.2fms, %u more signatures verified in %.2fms\n", nBlocks, (GetTimeMicros() - nTimeStart) * MILLI,
+             (unsigned)(sigStats.nVerified - sigStatsStart.nVerified), (sigStats.nVerifyNanos - sigStatsStart.nVerifyNanos) * MICRO);
+
+    if (pindexInvalid) {
+        // Nothing from the failing block on has been announced yet
+        while (chainActive.Tip() != pindexInvalid->pprev) {
+            if (!DisconnectTip(state, chainparams, &disconnectpool, false)) {
+                deferred.Clear();
+                return false;
+            }
+            connectTrace.BlockDisconnected();
+        }
+        CValidationState stateInvalid;
+        stateInvalid.DoS(100, false, REJECT_INVALID, "block-validation-failed");
+        InvalidBlockFound(pindexInvalid, stateInvalid);
+    }
+    deferred.Clear();
+
+    // Catch up on the writes ConnectTip held back
+    return FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED);
+}
+
 /**
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either nullptr or a pointer to a CBlock corresponding to pindexMostWork.
@@ -2486,6 +3054,12 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
         fBlocksDisconnected = true;
     }
 
+    // During initial block download, let the script checks of a few blocks
+    // overlap rather than returning after each block.
+    CDeferredScriptChecks deferred;
+    CDeferredScriptChecks* pdeferred = nScriptCheckThreads && nScriptCheckBlocks > 1 && IsInitialBlockDownload() ? &deferred : nullptr;
+    int nConnected = 0;
+
     // Build list of new blocks to connect.
     std::vector<CBlockIndex*> vpindexToConnect;
     bool fContinue = true;
@@ -2505,7 +3079,7 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
 
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
+            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool, pdeferred)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -2516,6 +3090,10 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
                     break;
                 } else {
                     // A system error occurred (disk space, database error, ...).
+                    // Don't leave blocks with unchecked scripts in the chain.
+                    CValidationState stateDummy;
+                    CBlockIndex* pindexInvalid = nullptr;
+                    CompleteDeferredScriptChecks(stateDummy, chainparams, deferred, connectTrace, disconnectpool, pindexInvalid);
                     // Make the mempool consistent with the current tip, just in case
                     // any observers try to use it before shutdown.
                     UpdateMempoolForReorg(disconnectpool, false);
@@ -2524,7 +3102,10 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
             } else {
                 PruneBlockIndexCandidates();
                 if (!pindexOldTip || chainActive.Tip()->nChainWork > pindexOldTip->nChainWork) {
-                    // We're in a better position than we were. Return temporarily to release the lock.
+                    // We're in a better position than we were. Return temporarily to release the lock,
+                    // unless the next block's script checks can overlap with this one's.
+                    if (pdeferred && !deferred.empty() && ++nConnected < nScriptCheckBlocks)
+                        continue;
                     fContinue = false;
                     break;
                 }
@@ -2532,6 +3113,16 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
         }
     }
 
+    CBlockIndex* pindexInvalid = nullptr;
+    if (!CompleteDeferredScriptChecks(state, chainparams, deferred, connectTrace, disconnectpool, pindexInvalid)) {
+        UpdateMempoolForReorg(disconnectpool, false);
+        return false;
+    }
+    if (pindexInvalid) {
+        fBlocksDisconnected = true;
+        fInvalidFound = true;
+    }
+
     if (fBlocksDisconnected) {
         // If any blocks were disconnected, disconnectpool may be non empty.  Add
         // any disconnected transactions back to the mempool.
@@ -2964,7 +3555,7 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
     return true;
 }
 
-static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW)
 {
     // Check Equihash solution is valid
     if (fCheckPOW && !CheckEquihashSolution(&block, Params())) {
@@ -3227,7 +3818,7 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckedPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3246,7 +3837,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!fCheckedPOW && !CheckBlockHeader(block, state, chainparams.GetConsensus()))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3286,15 +3877,84 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
     return true;
 }
 
+/**
+ * Run the context-free checks of the headers that ProcessNewBlockHeaders()
+ * may go on to accept, spread over the header check threads and without
+ * holding cs_main. Headers already known are left unchecked, as
+ * AcceptBlockHeader() does not check them either. Nothing is checked past a
+ * header that is known to be invalid or that neither follows the previous
+ * header nor a valid indexed block, nor past the first header that fails,
+ * since acceptance stops there: a peer cannot make us verify a whole message
+ * of solutions it has already given away as bad.
+ */
+std::vector<char> PreCheckBlockHeaders(const std::vector<CBlockHeader>& headers, const CChainParams& chainparams)
+{
+    std::vector<char> vChecked(headers.size(), false);
+    std::vector<char> vValid(headers.size(), false);
+    {
+        LOCK(cs_main);
+        uint256 hashPrev;
+        for (size_t i = 0; i < headers.size(); i++) {
+            const uint256 hash = headers[i].GetHash();
+            BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+            if (mi != mapBlockIndex.end()) {
+                if (mi->second->nStatus & BLOCK_FAILED_MASK)
+                    break;
+            } else {
+                if (i == 0 || headers[i].hashPrevBlock != hashPrev) {
+                    BlockMap::const_iterator miPrev = mapBlockIndex.find(headers[i].hashPrevBlock);
+                    if (miPrev == mapBlockIndex.end() || (miPrev->second->nStatus & BLOCK_FAILED_MASK))
+                        break;
+                }
+                vChecked[i] = true;
+            }
+            hashPrev = hash;
+        }
+    }
+
+    // The check queue hands out its last checks first, so add them in
+    // reverse to have the earliest headers checked first.
+    std::atomic<size_t> nFirstInvalid(headers.size());
+    std::vector<CHeaderCheck> vChecks;
+    vChecks.reserve(headers.size());
+    for (size_t i = headers.size(); i-- > 0; ) {
+        if (vChecked[i]) {
+            vChecks.emplace_back(headers[i], chainparams.GetConsensus(), &vValid[i], i, &nFirstInvalid);
+        }
+    }
+    int64_t nTimeStart = GetTimeMicros();
+    size_t nChecks = vChecks.size();
+    if (nScriptCheckThreads && nChecks > 1) {
+        CCheckQueueControl<CHeaderCheck> control(&headercheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        for (auto it = vChecks.rbegin(); it != vChecks.rend(); ++it) {
+            (*it)();
+        }
+    }
+    LogPrint(BCLog::BENCH, "  - Check %u of %u headers: %.2fms\n", (unsigned int)nChecks, (unsigned int)headers.size(), MILLI * (GetTimeMicros() - nTimeStart));
+
+    // Headers that failed or were skipped are checked again in
+    // AcceptBlockHeader() if it gets to them, which then reports the failure
+    // as before.
+    for (size_t i = 0; i < headers.size(); i++) {
+        vChecked[i] = vChecked[i] && vValid[i];
+    }
+    return vChecked;
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+    const std::vector<char> vCheckedPOW = PreCheckBlockHeaders(headers, chainparams);
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex, vCheckedPOW[i])) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3337,7 +3997,8 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
     CBlockIndex *pindexDummy = nullptr;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    // A block that passed CheckBlock already had its header checked
+    if (!AcceptBlockHeader(block, state, chainparams, &pindex, block.fChecked))
         return false;
 
     // Try to process all requested blocks that we don't have, but only
@@ -3408,6 +4069,112 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
     return true;
 }
 
+bool CBlockInputsPrefetch::Collect(const CBlock& block)
+{
+    LOCK(cs_main);
+    vOutPoints.clear();
+    nInputs = 0;
+    // Only a block on top of the coins tip can use what we load.
+    if (!pcoinsTip || block.hashPrevBlock != pcoinsTip->GetBestBlock())
+        return false;
+    std::vector<uint256> vTxids;
+    vTxids.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        vTxids.push_back(tx->GetHash());
+    }
+    std::sort(vTxids.begin(), vTxids.end());
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin) {
+            // Outputs created within the block are not in the database.
+            if (std::binary_search(vTxids.begin(), vTxids.end(), txin.prevout.hash))
+                continue;
+            nInputs++;
+            // A spent entry holds a spend the database does not know about
+            // yet, so only outpoints the cache knows nothing of are read.
+            if (!pcoinsTip->HaveCacheEntry(txin.prevout))
+                vOutPoints.push_back(txin.prevout);
+        }
+    }
+    pview = pcoinsdbview.get();
+    nSequence = nCoinsTipSequence;
+    return !vOutPoints.empty();
+}
+
+void CBlockInputsPrefetch::Read()
+{
+    AssertLockNotHeld(cs_main);
+    vCoins.assign(vOutPoints.size(), Coin());
+    vFound.assign(vOutPoints.size(), false);
+    std::atomic<int64_t> nReadMicrosTotal(0);
+    {
+        CCheckQueueControl<CCoinsPrefetch> control(&prefetchqueue);
+        std::vector<CCoinsPrefetch> vChecks;
+        vChecks.reserve(vOutPoints.size());
+        for (size_t i = 0; i < vOutPoints.size(); i++) {
+            vChecks.emplace_back(*pview, vOutPoints[i], vCoins[i], &vFound[i], nReadMicrosTotal);
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+    nReadMicros = nReadMicrosTotal;
+}
+
+bool CBlockInputsPrefetch::Apply(size_t& nLoaded)
+{
+    LOCK(cs_main);
+    nLoaded = 0;
+    // If pcoinsTip was written to the database or moved on, what was read
+    // may be older than the cache: a coin spent and flushed meanwhile would
+    // come back to life.
+    if (nSequence != nCoinsTipSequence)
+        return false;
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        if (vFound[i]) {
+            pcoinsTip->PrefetchCoin(vOutPoints[i], std::move(vCoins[i]));
+            nLoaded++;
+        }
+    }
+    return true;
+}
+
+static int64_t nTimePrefetch = 0;
+static int64_t nTimePrefetchSaved = 0;
+
+/**
+ * Load the coins spent by a block that extends the coins tip into pcoinsTip,
+ * reading them from the UTXO database in parallel, so that ConnectBlock does
+ * not have to wait on the database one input at a time.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockNotHeld(cs_main);
+    if (nPrefetchThreads <= 0)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    CBlockInputsPrefetch prefetch;
+    if (!prefetch.Collect(block))
+        return;
+    prefetch.Read();
+    size_t nLoaded;
+    if (!prefetch.Apply(nLoaded)) {
+        LogPrint(BCLog::BENCH, "  - Prefetch inputs of %s: tip changed, discarded\n", block.GetHash().ToString());
+        return;
+    }
+    const size_t nInputs = prefetch.GetInputCount();
+    const size_t nRead = prefetch.GetReadCount();
+    int64_t nTime = GetTimeMicros() - nTimeStart;
+    int64_t nSaved = std::max<int64_t>(prefetch.GetReadMicros() - nTime, 0);
+    nTimePrefetch += nTime;
+    nTimePrefetchSaved += nSaved;
+    LogPrint(BCLog::BENCH, "  - Prefetch %u inputs (%u cached, %u loaded, hit ratio %.1f%%): %.2fms, %.2fms saved [%.2fs, %.2fs saved]\n",
+        (unsigned)nInputs, (unsigned)(nInputs - nRead), (unsigned)nLoaded,
+        100.0 * (nInputs - nRead + nLoaded) / nInputs,
+        nTime * MILLI, nSaved * MILLI, nTimePrefetch * MICRO, nTimePrefetchSaved * MICRO);
+}
+
 bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool *fNewBlock)
 {
     AssertLockNotHeld(cs_main);
@@ -3434,6 +4201,8 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
 
     NotifyHeaderTip();
 
+    PrefetchBlockInputs(*pblock);
+
     CValidationState state; // Only used to report errors, not invalidity - ignore it
     if (!g_chainstate.ActivateBestChain(state, chainparams, pblock))
         return error("%s: ActivateBestChain failed", __func__);
@@ -3521,6 +4290,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        UnmapBlockFile(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3687,7 +4457,7 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
 
 bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash){ return this->InsertBlockIndex(hash); }))
+    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash){ return this->InsertBlockIndex(hash); }, fCompactBlockIndex))
         return false;
 
     boost::this_thread::interruption_point();
@@ -4152,6 +4922,7 @@ void UnloadBlockIndex()
     }
     mapBlockIndex.clear();
     fHavePruned = false;
+    latchToFalse = false;
 
     g_chainstate.UnloadBlockIndex();
 }
@@ -4213,6 +4984,185 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+namespace {
+
+/** Bounds on the blocks between the reader and the ordered stage of a block import */
+static const size_t MAX_IMPORT_BLOCKS_IN_FLIGHT = 1024;
+static const uint64_t MAX_IMPORT_BYTES_IN_FLIGHT = 16 * MAX_BLOCK_SERIALIZED_SIZE;
+
+/**
+ * Pipeline behind LoadExternalBlockFile. A reader thread reads the blocks out
+ * of the file, worker threads run the context-free CheckBlock on them
+ * (including the Equihash solution), and Next() hands them to the caller in
+ * file order, which is left to do the work that needs cs_main.
+ */
+class CBlockImportPipeline
+{
+public:
+    struct Entry {
+        uint64_t nPos;                  //!< position of the block in the file
+        uint64_t nSize;                 //!< its size there
+        std::shared_ptr<CBlock> pblock;
+        bool fDone = false;
+
+        Entry(uint64_t nPosIn, uint64_t nSizeIn) : nPos(nPosIn), nSize(nSizeIn), pblock(std::make_shared<CBlock>()) {}
+    };
+
+    CBlockImportPipeline(const CChainParams& chainparams, CBufferedFile& blkdat, int nWorkers) :
+        m_chainparams(chainparams), m_blkdat(blkdat)
+    {
+        m_reader = std::thread(&CBlockImportPipeline::ThreadRead, this);
+        for (int i = 0; i < nWorkers; i++) {
+            m_workers.emplace_back(&CBlockImportPipeline::ThreadCheck, this);
+        }
+    }
+
+    ~CBlockImportPipeline()
+    {
+        {
+            WaitableLock lock(m_cs);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_reader.join();
+        for (std::thread& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    /** The next block record in file order, or nullptr at the end of the file. */
+    std::shared_ptr<Entry> Next()
+    {
+        WaitableLock lock(m_cs);
+        m_cv.wait(lock, [this]{ return m_ordered.empty() ? m_read_done : m_ordered.front()->fDone; });
+        if (m_ordered.empty()) {
+            if (!m_read_error.empty())
+                throw std::runtime_error(m_read_error);
+            return nullptr;
+        }
+        std::shared_ptr<Entry> entry = std::move(m_ordered.front());
+        m_ordered.pop_front();
+        m_bytes_in_flight -= entry->nSize;
+        m_cv.notify_all();
+        return entry;
+    }
+
+private:
+    const CChainParams& m_chainparams;
+    CBufferedFile& m_blkdat;
+    std::thread m_reader;
+    std::vector<std::thread> m_workers;
+
+    CWaitableCriticalSection m_cs;
+    CConditionVariable m_cv;
+    std::deque<std::shared_ptr<Entry>> m_ordered; //!< every record not yet handed out, in file order
+    std::deque<std::shared_ptr<Entry>> m_unchecked; //!< records no worker has taken yet
+    uint64_t m_bytes_in_flight = 0;
+    bool m_read_done = false;
+    std::string m_read_error;
+    bool m_stop = false;
+
+    /**
+     * Scans for message starts and reads the blocks as the serial import did,
+     * so that a record that is cut short or fails to deserialize resyncs one
+     * byte past its message start.
+     */
+    void ThreadRead()
+    {
+        RenameThread("bitcoin-blkread");
+        CBufferedFile& blkdat = m_blkdat;
+        try {
+            uint64_t nRewind = blkdat.GetPos();
+            while (!blkdat.eof()) {
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(m_chainparams.MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, m_chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    break;
+                }
+                std::shared_ptr<Entry> entry;
+                try {
+                    // read block
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    entry = std::make_shared<Entry>(nBlockPos, nSize);
+                    blkdat >> *entry->pblock;
+                    nRewind = blkdat.GetPos();
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                    continue;
+                }
+
+                WaitableLock lock(m_cs);
+                m_cv.wait(lock, [this]{
+                    return m_stop || m_ordered.empty() ||
+                        (m_ordered.size() < MAX_IMPORT_BLOCKS_IN_FLIGHT && m_bytes_in_flight < MAX_IMPORT_BYTES_IN_FLIGHT);
+                });
+                if (m_stop)
+                    return;
+                m_ordered.push_back(entry);
+                m_unchecked.push_back(entry);
+                m_bytes_in_flight += nSize;
+                m_cv.notify_all();
+            }
+        } catch (const std::exception& e) {
+            WaitableLock lock(m_cs);
+            m_read_error = e.what();
+        }
+        {
+            WaitableLock lock(m_cs);
+            m_read_done = true;
+        }
+        m_cv.notify_all();
+    }
+
+    void ThreadCheck()
+    {
+        RenameThread("bitcoin-blkcheck");
+        while (true) {
+            std::shared_ptr<Entry> entry;
+            {
+                WaitableLock lock(m_cs);
+                m_cv.wait(lock, [this]{ return m_stop || m_read_done || !m_unchecked.empty(); });
+                if (m_stop || m_unchecked.empty())
+                    return;
+                entry = std::move(m_unchecked.front());
+                m_unchecked.pop_front();
+            }
+
+            // The result is cached in the block; a block that fails is
+            // checked again by AcceptBlock, which records why.
+            try {
+                CValidationState state;
+                CheckBlock(*entry->pblock, state, m_chainparams.GetConsensus());
+            } catch (const std::exception&) {
+            }
+
+            {
+                WaitableLock lock(m_cs);
+                entry->fDone = true;
+            }
+            m_cv.notify_all();
+        }
+    }
+};
+
+} // namespace
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -4223,41 +5173,20 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        // Script check threads have nothing to do while blocks are only
+        // being accepted, so take as many for the context-free checks.
+        CBlockImportPipeline pipeline(chainparams, blkdat, std::max(nScriptCheckThreads, 1));
+        while (true) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
+            std::shared_ptr<CBlockImportPipeline::Entry> entry = pipeline.Next();
+            if (!entry)
                 break;
-            }
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                    dbp->nPos = entry->nPos;
+                std::shared_ptr<CBlock> pblock = std::move(entry->pblock);
                 CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
 
                 // detect out of order blocks, and store them for later
                 uint256 hash = block.GetHash();
@@ -4301,7 +5230,8 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                     while (range.first != range.second) {
                         std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
                         std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+                        // AcceptBlock checks the solution, no need to do it here as well
+                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus(), false))
                         {
                             LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
                                     head.ToString());
@@ -37,6 +37,7 @@ class CCoinsViewDB;
 class CInv;
 class CConnman;
 class CScriptCheck;
+class CSignatureBatch;
 class CBlockPolicyEstimator;
 class CTxMemPool;
 class CValidationState;
@@ -80,6 +81,14 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of blocks whose script checks may overlap */
+static const int MAX_SCRIPTCHECK_BLOCKS = 32;
+/** -parblocks default (number of blocks whose script checks may overlap during initial block download, 1 = off) */
+static const int DEFAULT_SCRIPTCHECK_BLOCKS = 8;
+/** Maximum number of UTXO prefetch threads allowed */
+static const int MAX_PREFETCH_THREADS = 16;
+/** -prefetchthreads default (number of threads reading block inputs ahead of ConnectBlock, 0 = off) */
+static const int DEFAULT_PREFETCH_THREADS = 4;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -130,6 +139,10 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+/** Default for -compactblockindex */
+static const bool DEFAULT_COMPACT_BLOCK_INDEX = true;
+/** Default for -paranoidblockreads */
+static const bool DEFAULT_PARANOID_BLOCK_READS = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
@@ -168,11 +181,17 @@ extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
+extern int nScriptCheckBlocks;
+extern int nPrefetchThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Whether block index entries drop their Equihash solution once it is on disk */
+extern bool fCompactBlockIndex;
+/** Whether blocks read back for an indexed header have their Equihash solution checked again */
+extern bool fParanoidBlockReads;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
@@ -240,6 +259,37 @@ static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
  */
 bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool* fNewBlock);
 
+/**
+ * Loads the coins spent by a block that extends the coins tip into pcoinsTip
+ * ahead of ConnectBlock, reading them from the UTXO database in parallel
+ * without holding cs_main. ProcessNewBlock() does this for every new block.
+ */
+class CBlockInputsPrefetch
+{
+public:
+    /** Pick the inputs pcoinsTip would have to read from the database.
+     *  Returns false if there are none. Takes cs_main. */
+    bool Collect(const CBlock& block);
+    /** Read the picked coins from the database. Call without cs_main held. */
+    void Read();
+    /** Add the coins read to pcoinsTip, unless it moved on or was written to
+     *  the database since Collect(). Takes cs_main. */
+    bool Apply(size_t& nLoaded);
+
+    size_t GetInputCount() const { return nInputs; }
+    size_t GetReadCount() const { return vOutPoints.size(); }
+    int64_t GetReadMicros() const { return nReadMicros; }
+
+private:
+    std::vector<COutPoint> vOutPoints;
+    std::vector<Coin> vCoins;
+    std::vector<char> vFound;
+    const CCoinsView* pview = nullptr;
+    uint64_t nSequence = 0;
+    size_t nInputs = 0;
+    int64_t nReadMicros = 0;
+};
+
 /**
  * Process incoming block headers.
  *
@@ -253,6 +303,14 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
  */
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex=nullptr, CBlockHeader *first_invalid=nullptr);
 
+/**
+ * Check the proof of work of the headers ProcessNewBlockHeaders() may accept,
+ * in parallel. Returns, for each header, whether it was checked and found valid.
+ *
+ * Call without cs_main held.
+ */
+std::vector<char> PreCheckBlockHeaders(const std::vector<CBlockHeader>& headers, const CChainParams& chainparams);
+
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
@@ -272,8 +330,25 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header checking thread, used to check batches of headers in parallel */
+void ThreadHeaderCheck();
+/** Run an instance of the UTXO prefetch thread, used to read the inputs of a new block ahead of connecting it */
+void ThreadPrefetchCoins();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
+
+/** Inputs of the blocks connected since startup, see getvalidationinfo. */
+struct BlockInputStats {
+    uint64_t nBlocks;
+    //! Inputs spent, not counting coinbases
+    uint64_t nInputs;
+    //! Inputs whose scripts were not checked because of -assumevalid
+    uint64_t nAssumedValidInputs;
+    //! Time spent fetching and checking the coins spent
+    uint64_t nCoinFetchNanos;
+};
+
+BlockInputStats GetBlockInputStats();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, bool fAllowSlow = false, CBlockIndex* blockIndex = nullptr);
 /** Find the best known block, and make it the tip of the block chain */
@@ -376,6 +451,13 @@ public:
 
     bool operator()();
 
+    /**
+     * Run a chunk of checks, verifying the signatures they need as one batch.
+     * Checks whose batched signatures fail are evaluated again on their own,
+     * so the result is exactly that of running every check individually.
+     */
+    static bool RunBatch(std::vector<CScriptCheck>& vChecks);
+
     void swap(CScriptCheck &check) {
         std::swap(ptxTo, check.ptxTo);
         std::swap(m_tx_out, check.m_tx_out);
@@ -387,6 +469,39 @@ public:
     }
 
     ScriptError GetScriptError() const { return error; }
+
+private:
+    //! Evaluate the script assuming all signatures not in the cache are valid, deferring them to batch.
+    bool RunDeferred(CSignatureBatch& batch);
+};
+
+/**
+ * A script check as queued by ConnectBlock. When the outcome of a block's
+ * checks is collected only after later blocks were connected, a failure is
+ * recorded in the block's flag and the queue carries on, so that it can be
+ * traced back to the earliest bad block. Otherwise a failure stops the
+ * queue as usual.
+ */
+class CBlockScriptCheck
+{
+private:
+    CScriptCheck check;
+    std::atomic<bool> *pfFailed;
+
+public:
+    CBlockScriptCheck(): pfFailed(nullptr) {}
+    CBlockScriptCheck(CScriptCheck& checkIn, std::atomic<bool>* pfFailedIn) : pfFailed(pfFailedIn) {
+        check.swap(checkIn);
+    }
+
+    bool operator()();
+
+    static bool RunBatch(std::vector<CBlockScriptCheck>& vChecks);
+
+    void swap(CBlockScriptCheck& other) {
+        check.swap(other.check);
+        std::swap(pfFailed, other.pfFailed);
+    }
 };
 
 /** Initializes the script-execution cache */
@@ -396,6 +511,12 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Read a block as it is stored, for sending it on without deserializing.
+ * Block files are memory-mapped where possible. Only the header hash is
+ * checked against the index; the bytes use the witness serialization.
+ */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
 /** Functions for validating blocks and updating the block tree */
 